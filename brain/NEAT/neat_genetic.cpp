@@ -3,6 +3,87 @@
 #include "brain/NEAT/neat_genome.h"
 #include "brain/error_macros.h"
 #include "brain/math/math_funcs.h"
+#include "brain/math/matrix_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GENETIC_POPCNT_ENABLED
+#endif
+
+/**
+ * @brief count_common_bits returns the bits set in both buffers
+ */
+static uint32_t count_common_bits(
+		const uint64_t *p_a,
+		const uint64_t *p_b,
+		uint32_t p_size) {
+
+	uint32_t count(0);
+	for (uint32_t i(0); i < p_size; ++i) {
+		count += __builtin_popcountll(p_a[i] & p_b[i]);
+	}
+	return count;
+}
+
+/**
+ * @brief count_bits returns the bits set in the buffer
+ */
+static uint32_t count_bits(const uint64_t *p_a, uint32_t p_size) {
+	uint32_t count(0);
+	for (uint32_t i(0); i < p_size; ++i) {
+		count += __builtin_popcountll(p_a[i]);
+	}
+	return count;
+}
+
+#ifdef GENETIC_POPCNT_ENABLED
+
+/// The same functions using the popcnt instruction, that is always available
+/// with AVX2
+#pragma GCC push_options
+#pragma GCC target("popcnt")
+
+static uint32_t count_common_bits_popcnt(
+		const uint64_t *p_a,
+		const uint64_t *p_b,
+		uint32_t p_size) {
+
+	uint32_t count(0);
+	for (uint32_t i(0); i < p_size; ++i) {
+		count += __builtin_popcountll(p_a[i] & p_b[i]);
+	}
+	return count;
+}
+
+static uint32_t count_bits_popcnt(const uint64_t *p_a, uint32_t p_size) {
+	uint32_t count(0);
+	for (uint32_t i(0); i < p_size; ++i) {
+		count += __builtin_popcountll(p_a[i]);
+	}
+	return count;
+}
+
+#pragma GCC pop_options
+
+#endif
+
+static _FORCE_INLINE_ uint32_t popcount_common(
+		const uint64_t *p_a,
+		const uint64_t *p_b,
+		uint32_t p_size) {
+#ifdef GENETIC_POPCNT_ENABLED
+	if (brain::kernels::get_isa() >= brain::kernels::ISA_AVX2)
+		return count_common_bits_popcnt(p_a, p_b, p_size);
+#endif
+	return count_common_bits(p_a, p_b, p_size);
+}
+
+static _FORCE_INLINE_ uint32_t popcount(const uint64_t *p_a, uint32_t p_size) {
+#ifdef GENETIC_POPCNT_ENABLED
+	if (brain::kernels::get_isa() >= brain::kernels::ISA_AVX2)
+		return count_bits_popcnt(p_a, p_size);
+#endif
+	return count_bits(p_a, p_size);
+}
 
 real_t brain::NtGenetic::compatibility(
 		const NtGenome &p_genome_1,
@@ -11,68 +92,176 @@ real_t brain::NtGenetic::compatibility(
 		real_t p_excesses_significance,
 		real_t p_weights_significance) {
 
-	ERR_FAIL_COND_V(!p_genome_1.get_link_count(), -1);
-	ERR_FAIL_COND_V(!p_genome_2.get_link_count(), -1);
-
 	real_t D(0);
 	real_t E(0);
 
-	// Find smallest and bigger genome
-
-	const uint32_t biggest_innovation(
-			MAX(p_genome_1.get_innovation_number(),
-					p_genome_2.get_innovation_number()));
-
-	// Count disjoints, Count excesses by checking if both have the
-	// innovation number
 	real_t g1_weights_sum(0.f);
 	real_t g2_weights_sum(0.f);
 
-	for (
-			int innovation(0), g1_i(0), g2_i(0);
-			innovation <= biggest_innovation;
-			++innovation) {
-
-		bool g1_has_innovation(false);
-		bool g2_has_innovation(false);
-		bool someone_is_over(false);
-
-		if (g1_i < p_genome_1.get_link_count()) {
-			const NtLinkGene *link = p_genome_1.get_link(g1_i);
-			if (innovation == link->innovation_number) {
-				g1_has_innovation = true;
-				g1_weights_sum += link->weight;
-				++g1_i;
-			}
-		} else {
-			someone_is_over = true;
-		}
+	const uint32_t g1_count = p_genome_1.get_link_count();
+	const uint32_t g2_count = p_genome_2.get_link_count();
+
+	/// Step 1. Merge join the genes, the discrepancies found while both
+	/// genomes have genes are disjoints
+	uint32_t g1_i(0);
+	uint32_t g2_i(0);
+	while (g1_i < g1_count && g2_i < g2_count) {
+		const NtLinkGene *link_1 = p_genome_1.get_link(g1_i);
+		const NtLinkGene *link_2 = p_genome_2.get_link(g2_i);
 
-		if (g2_i < p_genome_2.get_link_count()) {
-			const NtLinkGene *link = p_genome_2.get_link(g2_i);
-			if (innovation == link->innovation_number) {
-				g2_has_innovation = true;
-				g2_weights_sum += link->weight;
-				++g2_i;
-			}
+		if (link_1->innovation_number == link_2->innovation_number) {
+			g1_weights_sum += link_1->weight;
+			g2_weights_sum += link_2->weight;
+			++g1_i;
+			++g2_i;
+		} else if (link_1->innovation_number < link_2->innovation_number) {
+			g1_weights_sum += link_1->weight;
+			++g1_i;
+			D += 1;
 		} else {
-			someone_is_over = true;
+			g2_weights_sum += link_2->weight;
+			++g2_i;
+			D += 1;
 		}
+	}
 
-		if (g1_has_innovation != g2_has_innovation) {
+	/// Step 2. The genes that overflow the other genome are excesses
+	for (; g1_i < g1_count; ++g1_i) {
+		g1_weights_sum += p_genome_1.get_link(g1_i)->weight;
+		E += 1;
+	}
+	for (; g2_i < g2_count; ++g2_i) {
+		g2_weights_sum += p_genome_2.get_link(g2_i)->weight;
+		E += 1;
+	}
 
-			if (!someone_is_over) {
-				// This discrepancy is a disjoint
-				D += 1;
-			} else {
-				// This discrepancy is a excess
-				E += 1;
-			}
+	return compute_compatibility(
+			D,
+			E,
+			g1_weights_sum,
+			g1_count,
+			g2_weights_sum,
+			g2_count,
+			p_disjoints_significance,
+			p_excesses_significance,
+			p_weights_significance);
+}
+
+void brain::NtGenetic::make_innovation_bitset(
+		const NtGenome &p_genome,
+		NtInnovationBitset &r_bitset) {
+
+	r_bitset.words.clear();
+	r_bitset.first_word = 0;
+	r_bitset.link_count = p_genome.get_link_count();
+	r_bitset.biggest_innovation_number = 0;
+	r_bitset.weights_sum = 0;
+
+	if (!r_bitset.link_count)
+		return;
+
+	const uint32_t first_word = p_genome.get_link(0)->innovation_number / 64;
+	const uint32_t last_word = p_genome.get_link(r_bitset.link_count - 1)->innovation_number / 64;
+
+	ERR_FAIL_COND(last_word < first_word);
+
+	r_bitset.first_word = first_word;
+	r_bitset.words.resize(last_word - first_word + 1, 0);
+
+	for (uint32_t i(0); i < r_bitset.link_count; ++i) {
+		const NtLinkGene *link = p_genome.get_link(i);
+		r_bitset.words[link->innovation_number / 64 - first_word] |= uint64_t(1) << (link->innovation_number % 64);
+		r_bitset.weights_sum += link->weight;
+		r_bitset.biggest_innovation_number = MAX(r_bitset.biggest_innovation_number, link->innovation_number);
+	}
+}
+
+real_t brain::NtGenetic::compatibility(
+		const NtInnovationBitset &p_bitset_1,
+		const NtInnovationBitset &p_bitset_2,
+		real_t p_disjoints_significance,
+		real_t p_excesses_significance,
+		real_t p_weights_significance) {
+
+	/// Step 1. Count the shared genes on the overlapping words
+	const uint32_t begin = MAX(p_bitset_1.first_word, p_bitset_2.first_word);
+	const uint32_t end = MIN(
+			p_bitset_1.first_word + p_bitset_1.words.size(),
+			p_bitset_2.first_word + p_bitset_2.words.size());
+
+	uint32_t shared(0);
+	if (begin < end) {
+		shared = popcount_common(
+				p_bitset_1.words.data() + begin - p_bitset_1.first_word,
+				p_bitset_2.words.data() + begin - p_bitset_2.first_word,
+				end - begin);
+	}
+
+	/// Step 2. The excesses are the genes of the most innovative genome
+	/// that come after the last gene of the other one
+	const NtInnovationBitset *innovative = &p_bitset_1;
+	uint32_t last_innovation = p_bitset_2.biggest_innovation_number;
+	if (p_bitset_1.biggest_innovation_number < p_bitset_2.biggest_innovation_number) {
+		innovative = &p_bitset_2;
+		last_innovation = p_bitset_1.biggest_innovation_number;
+	}
+
+	uint32_t excesses(0);
+	{
+		const uint32_t excess_begin = last_innovation + 1;
+		const uint32_t word = excess_begin / 64;
+		const uint32_t words_end = innovative->first_word + innovative->words.size();
+
+		if (word < innovative->first_word) {
+			excesses = innovative->link_count;
+		} else if (word < words_end) {
+			const uint64_t *words = innovative->words.data() + word - innovative->first_word;
+			excesses = __builtin_popcountll(words[0] & (~uint64_t(0) << (excess_begin % 64)));
+			excesses += popcount(words + 1, words_end - word - 1);
 		}
 	}
 
-	real_t W = Math::abs(Math::abs((g1_weights_sum / p_genome_1.get_link_count())) -
-						 Math::abs((g2_weights_sum / p_genome_2.get_link_count())));
+	/// Step 3. All the other discrepancies are disjoints
+	const uint32_t disjoints =
+			p_bitset_1.link_count + p_bitset_2.link_count - 2 * shared - excesses;
+
+	return compute_compatibility(
+			disjoints,
+			excesses,
+			p_bitset_1.weights_sum,
+			p_bitset_1.link_count,
+			p_bitset_2.weights_sum,
+			p_bitset_2.link_count,
+			p_disjoints_significance,
+			p_excesses_significance,
+			p_weights_significance);
+}
+
+real_t brain::NtGenetic::compute_compatibility(
+		real_t p_disjoints,
+		real_t p_excesses,
+		real_t p_weights_sum_1,
+		uint32_t p_link_count_1,
+		real_t p_weights_sum_2,
+		uint32_t p_link_count_2,
+		real_t p_disjoints_significance,
+		real_t p_excesses_significance,
+		real_t p_weights_significance) {
+
+	real_t D(p_disjoints);
+	real_t E(p_excesses);
+
+	// When a genome has no links all the genes of the other are excesses,
+	// and its average weight is 0
+	if (!p_link_count_1 || !p_link_count_2) {
+		D = 0;
+		E = p_link_count_1 + p_link_count_2;
+	}
+
+	const real_t avg_weight_1 = p_link_count_1 ? p_weights_sum_1 / p_link_count_1 : 0;
+	const real_t avg_weight_2 = p_link_count_2 ? p_weights_sum_2 / p_link_count_2 : 0;
+
+	real_t W = Math::abs(Math::abs(avg_weight_1) - Math::abs(avg_weight_2));
 
 	/// The research says that for smaller genome the normalization is not necessary
 	/// and can be set 1.
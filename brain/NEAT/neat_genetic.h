@@ -1,11 +1,38 @@
 #pragma once
 
 #include "brain/math/math_defs.h"
+#include "brain/typedefs.h"
+#include <vector>
 
 namespace brain {
 
 class NtGenome;
 
+/**
+ * @brief The NtInnovationBitset struct has one bit per innovation number of a
+ * genome, so the genes that two genomes share are counted with a popcount.
+ *
+ * The bits go from the word of the smallest innovation number to the word of
+ * the biggest one, so it's compact only when the genome innovation numbers are
+ * close to each other.
+ */
+struct NtInnovationBitset {
+	/**
+	 * @brief first_word is the index of the first word, the bit of the
+	 * innovation number `i` is the bit `i % 64` of the word `i / 64`
+	 */
+	uint32_t first_word = 0;
+	std::vector<uint64_t> words;
+
+	uint32_t link_count = 0;
+	uint32_t biggest_innovation_number = 0;
+
+	/**
+	 * @brief weights_sum is the sum of all the link weights, in the genes order
+	 */
+	real_t weights_sum = 0;
+};
+
 /**
  * @brief The NtGenetic class is a collection of functions to perform genetic
  * operations
@@ -45,6 +72,9 @@ public:
 	 * For example a p_weights_significance of 0 make sure that until the topology
 	 * is changed the result is 0.
 	 *
+	 * The genes are ordered by innovation number, so they are compared
+	 * with a merge join in O(genes count).
+	 *
 	 * @param p_genome_1
 	 * @param p_genome_2
 	 * @param p_disjoints_significance
@@ -58,6 +88,51 @@ public:
 			real_t p_disjoints_significance,
 			real_t p_excesses_significance,
 			real_t p_weights_significance);
+
+	/**
+	 * @brief make_innovation_bitset builds the bitset of the genome
+	 * @param p_genome
+	 * @param r_bitset
+	 */
+	static void make_innovation_bitset(
+			const NtGenome &p_genome,
+			NtInnovationBitset &r_bitset);
+
+	/**
+	 * @brief compatibility returns the same value of the above function,
+	 * computed from the genomes bitsets: the shared genes and the excesses are
+	 * counted using popcount, so the cost depends on the bitsets size
+	 * rather than on the genes count.
+	 * @param p_bitset_1
+	 * @param p_bitset_2
+	 * @param p_disjoints_significance
+	 * @param p_excesses_significance
+	 * @param p_weights_significance
+	 * @return
+	 */
+	static real_t compatibility(
+			const NtInnovationBitset &p_bitset_1,
+			const NtInnovationBitset &p_bitset_2,
+			real_t p_disjoints_significance,
+			real_t p_excesses_significance,
+			real_t p_weights_significance);
+
+private:
+	/**
+	 * @brief compute_compatibility is the equation shared by the
+	 * compatibility functions, it handles the genomes without links so the
+	 * two functions always agree
+	 */
+	static real_t compute_compatibility(
+			real_t p_disjoints,
+			real_t p_excesses,
+			real_t p_weights_sum_1,
+			uint32_t p_link_count_1,
+			real_t p_weights_sum_2,
+			uint32_t p_link_count_2,
+			real_t p_disjoints_significance,
+			real_t p_excesses_significance,
+			real_t p_weights_significance);
 };
 
 } // namespace brain
@@ -93,11 +93,22 @@ uint32_t brain::NtGenome::add_neuron(
 
 	const uint32_t id(neuron_genes.size());
 
-	neuron_genes.push_back(
-			NtNeuronGene(
-					id,
-					p_type,
-					p_activation_func));
+	if (id < spare_neuron_genes.size()) {
+		// Reuse the gene removed by clear, with its links vectors memory
+		NtNeuronGene &gene = spare_neuron_genes[id];
+		gene.id = id;
+		gene.type = p_type;
+		gene.activation_func = p_activation_func;
+		gene.incoming_links.clear();
+		gene.outcoming_links.clear();
+		neuron_genes.push_back(std::move(gene));
+	} else {
+		neuron_genes.push_back(
+				NtNeuronGene(
+						id,
+						p_type,
+						p_activation_func));
+	}
 	return id;
 }
 
@@ -200,30 +211,30 @@ void brain::NtGenome::mutate_all_link_weights(map_real_2_ptr p_map_func, void *p
 	}
 }
 
-void brain::NtGenome::mutate_random_link_weight(map_real_2_ptr p_map_func, void *p_data) {
+void brain::NtGenome::mutate_random_link_weight(map_real_2_ptr p_map_func, void *p_data, RandomPCG &r_rand) {
 
 	ERR_FAIL_COND(!link_genes.size());
 
 	NtLinkGene &lg =
-			link_genes[static_cast<int>(Math::random(0, link_genes.size() - 1) + 0.5)];
+			link_genes[static_cast<int>(r_rand.random(0, link_genes.size() - 1) + 0.5)];
 	lg.weight = p_map_func(lg.weight, p_data);
 }
 
-void brain::NtGenome::mutate_random_link_toggle_activation() {
+void brain::NtGenome::mutate_random_link_toggle_activation(RandomPCG &r_rand) {
 
 	ERR_FAIL_COND(!link_genes.size());
 
 	NtLinkGene &lg =
-			link_genes[static_cast<int>(Math::random(0, link_genes.size() - 1) + 0.5)];
+			link_genes[static_cast<int>(r_rand.random(0, link_genes.size() - 1) + 0.5)];
 	lg.active = !lg.active;
 }
 
 bool brain::NtGenome::mutate_add_random_link(
 		real_t p_spawn_recurrent_threshold,
-		std::vector<NtInnovation> &r_innovations,
-		uint32_t &r_current_innovation_number) {
+		NtInnovationRegistry &r_innovations,
+		RandomPCG &r_rand) {
 
-	const bool spawn_recurrent = Math::randd() < p_spawn_recurrent_threshold;
+	const bool spawn_recurrent = r_rand.randd() < p_spawn_recurrent_threshold;
 	const int max_tries(10);
 
 	// Taking the non inputs to make it easier choose a non input neuron
@@ -245,12 +256,12 @@ bool brain::NtGenome::mutate_add_random_link(
 	for (int tries = 0; tries < max_tries; ++tries) {
 
 		// Spawn a recurrent link
-		if (spawn_recurrent && Math::randd() < 0.1) {
+		if (spawn_recurrent && r_rand.randd() < 0.1) {
 			// Spawn a self recurrent link
 			/// Since a self recurrent can spawn by taking everything randomly
 			/// a 10% of chance seems fine to me
 			parent_neuron_id =
-					non_input_neurons[(int)(Math::random(0, non_input_neurons_last_index) + 0.5f)];
+					non_input_neurons[(int)(r_rand.random(0, non_input_neurons_last_index) + 0.5f)];
 
 			child_neuron_id = parent_neuron_id;
 
@@ -258,10 +269,10 @@ bool brain::NtGenome::mutate_add_random_link(
 
 			// Take everything randomly
 			parent_neuron_id =
-					neuron_genes[(int)(Math::random(0, neurons_last_index) + 0.5f)].id;
+					neuron_genes[(int)(r_rand.random(0, neurons_last_index) + 0.5f)].id;
 
 			child_neuron_id =
-					non_input_neurons[(int)(Math::random(0, non_input_neurons_last_index) + 0.5f)];
+					non_input_neurons[(int)(r_rand.random(0, non_input_neurons_last_index) + 0.5f)];
 		}
 
 		if (-1 != find_link(parent_neuron_id, child_neuron_id))
@@ -281,42 +292,28 @@ bool brain::NtGenome::mutate_add_random_link(
 		return false;
 
 	// Search if this innovation already exist
-	int innovation_index = find_innovation(
-			r_innovations,
-			NtInnovation::INNOVATION_LINK,
-			parent_neuron_id,
-			child_neuron_id,
-			spawn_recurrent,
-			0);
-
 	uint32_t innovation_num;
+	if (!r_innovations.find_innovation(
+				NtInnovation::INNOVATION_LINK,
+				parent_neuron_id,
+				child_neuron_id,
+				spawn_recurrent,
+				0,
+				innovation_num)) {
 
-	if (0 <= innovation_index) {
-		// This mutation is not an innovation
-		innovation_num = r_innovations[innovation_index].innovation_number;
-
-	} else {
-
-		// TODO please add a function that returns this
-		// in this way is not secure enough
 		// This is a novel innovation
-		innovation_num = ++r_current_innovation_number;
-
-		// TODO Please add a function to handle this properly,
-		// in this way is error prone
-		r_innovations.push_back(
-				{ NtInnovation::INNOVATION_LINK,
-						parent_neuron_id,
-						child_neuron_id,
-						spawn_recurrent,
-						innovation_num,
-						0 });
+		innovation_num = r_innovations.add_innovation(
+				NtInnovation::INNOVATION_LINK,
+				parent_neuron_id,
+				child_neuron_id,
+				spawn_recurrent,
+				0);
 	}
 
 	add_link(
 			parent_neuron_id,
 			child_neuron_id,
-			Math::random(-1, 1), // Weight <-- Just a random num
+			r_rand.random(-1, 1), // Weight <-- Just a random num
 			spawn_recurrent,
 			innovation_num);
 
@@ -325,8 +322,8 @@ bool brain::NtGenome::mutate_add_random_link(
 }
 
 bool brain::NtGenome::mutate_add_random_neuron(
-		std::vector<NtInnovation> &r_innovations,
-		uint32_t &r_current_innovation_number) {
+		NtInnovationRegistry &r_innovations,
+		RandomPCG &r_rand) {
 
 	/// Step 1. Find the link to split
 
@@ -350,7 +347,7 @@ bool brain::NtGenome::mutate_add_random_neuron(
 			/// Iterate in reverse so all active older links will have more
 			/// probability to get split
 			for (auto it = active_links.rbegin(); it != active_links.rend(); ++it) {
-				if (Math::randd() < 0.3f) {
+				if (r_rand.randd() < 0.3f) {
 					link_to_split = link_genes[*it];
 					found = true;
 					break;
@@ -361,7 +358,7 @@ bool brain::NtGenome::mutate_add_random_neuron(
 
 		// Take one random link with normal distribution
 		const int link_id = active_links[static_cast<int>(
-				Math::random(0.f, active_links.size() - 1.f) + 0.5f)];
+				r_rand.random(0.f, active_links.size() - 1.f) + 0.5f)];
 
 		link_to_split = link_genes[link_id];
 		found = true;
@@ -374,36 +371,25 @@ bool brain::NtGenome::mutate_add_random_neuron(
 			NtNeuronGene::NEURON_GENE_TYPE_HIDDEN,
 			BrainArea::ACTIVATION_LEAKY_RELU);
 
-	// TODO please handle this properly
-	int innovation_index = find_innovation(
-			r_innovations,
-			NtInnovation::INNOVATION_NODE,
-			link_to_split.parent_neuron_id,
-			link_to_split.child_neuron_id,
-			false,
-			new_neuron_id);
-
+	// The neuron innovation has two numbers, one per link
 	uint32_t in_link_innovation_number;
-	uint32_t out_link_innovation_number;
+	if (!r_innovations.find_innovation(
+				NtInnovation::INNOVATION_NODE,
+				link_to_split.parent_neuron_id,
+				link_to_split.child_neuron_id,
+				false, // <-- doesn't matter in this case
+				new_neuron_id,
+				in_link_innovation_number)) {
 
-	if (0 <= innovation_index) {
-		in_link_innovation_number = r_innovations[innovation_index].innovation_number;
-		out_link_innovation_number = in_link_innovation_number + 1;
-	} else {
-		// TODO please add a function that returns the next innovation num
 		// Novel innovation
-		in_link_innovation_number = ++r_current_innovation_number;
-		out_link_innovation_number = ++r_current_innovation_number;
-
-		// TODO pelase handle this properly
-		r_innovations.push_back(
-				{ NtInnovation::INNOVATION_NODE,
-						link_to_split.parent_neuron_id,
-						link_to_split.child_neuron_id,
-						false, // <-- doesn't matter in this case
-						in_link_innovation_number,
-						new_neuron_id });
+		in_link_innovation_number = r_innovations.add_innovation(
+				NtInnovation::INNOVATION_NODE,
+				link_to_split.parent_neuron_id,
+				link_to_split.child_neuron_id,
+				false,
+				new_neuron_id);
 	}
+	const uint32_t out_link_innovation_number = in_link_innovation_number + 1;
 
 	suppress_link(link_to_split.id);
 
@@ -430,7 +416,8 @@ bool brain::NtGenome::mate_multipoint(
 		real_t p_mom_fitness,
 		const NtGenome &p_daddy,
 		real_t p_daddy_fitness,
-		bool p_average) {
+		bool p_average,
+		RandomPCG &r_rand) {
 
 	clear();
 
@@ -483,7 +470,7 @@ bool brain::NtGenome::mate_multipoint(
 				gene_to_add = *genome_inn;
 				gene_to_add.weight = (genome_inn->weight + genome_obs->weight) * 0.5;
 
-				if (Math::randd() < 0.5) {
+				if (r_rand.randd() < 0.5) {
 					gene_to_add.active = genome_inn->active;
 				} else {
 					gene_to_add.active = genome_obs->active;
@@ -491,7 +478,7 @@ bool brain::NtGenome::mate_multipoint(
 
 			} else {
 				// select one randomly
-				if (Math::randd() < 0.5) {
+				if (r_rand.randd() < 0.5) {
 					gene_to_add = *genome_inn;
 				} else {
 					gene_to_add = *genome_obs;
@@ -540,7 +527,8 @@ bool brain::NtGenome::mate_multipoint(
 
 bool brain::NtGenome::mate_singlepoint(
 		const NtGenome &p_mom,
-		const NtGenome &p_daddy) {
+		const NtGenome &p_daddy,
+		RandomPCG &r_rand) {
 
 	clear();
 
@@ -552,7 +540,7 @@ bool brain::NtGenome::mate_singlepoint(
 		smaller = &p_mom;
 	}
 
-	const int cross_point = static_cast<int>(Math::random(0, smaller->get_link_count() - 1) + 0.5);
+	const int cross_point = static_cast<int>(r_rand.random(0, smaller->get_link_count() - 1) + 0.5);
 
 	// Copy genes from the smaller genome
 	for (int i(0); i < cross_point; ++i) {
@@ -594,7 +582,7 @@ bool brain::NtGenome::mate_singlepoint(
 			link.weight *= 0.5;
 
 			if (link.active != s.active) {
-				link.active = Math::randd() < 0.5f;
+				link.active = r_rand.randd() < 0.5f;
 			}
 		}
 
@@ -676,6 +664,7 @@ bool brain::NtGenome::mate_singlepoint(
 void brain::NtGenome::generate_neural_network(SharpBrainArea &r_brain_area) const {
 
 	r_brain_area.clear();
+	r_brain_area.begin_bulk_construction();
 
 	for (auto it = neuron_genes.begin(); it != neuron_genes.end(); ++it) {
 
@@ -705,9 +694,21 @@ void brain::NtGenome::generate_neural_network(SharpBrainArea &r_brain_area) cons
 				it->weight,
 				it->recurrent);
 	}
+
+	r_brain_area.end_bulk_construction();
 }
 
 void brain::NtGenome::clear() {
+
+	// Move the neuron genes in the spare ones, so add_neuron reuses them
+	for (uint32_t i(0); i < neuron_genes.size(); ++i) {
+		if (i < spare_neuron_genes.size()) {
+			spare_neuron_genes[i] = std::move(neuron_genes[i]);
+		} else {
+			spare_neuron_genes.push_back(std::move(neuron_genes[i]));
+		}
+	}
+
 	neuron_genes.clear();
 	link_genes.clear();
 	biggest_innovation_number = 0;
@@ -715,22 +716,10 @@ void brain::NtGenome::clear() {
 
 void brain::NtGenome::duplicate_in(NtGenome &p_genome) const {
 
-	p_genome.clear();
-
-	p_genome.neuron_genes.reserve(neuron_genes.size());
-	p_genome.link_genes.reserve(link_genes.size());
-
-	// TODO try to use std::copy instead
-
-	for (auto it = neuron_genes.begin(); it != neuron_genes.end(); ++it) {
-
-		p_genome.neuron_genes.push_back(*it);
-	}
-
-	for (auto it = link_genes.begin(); it != link_genes.end(); ++it) {
-
-		p_genome.link_genes.push_back(*it);
-	}
+	// The copy assignment copies over the existing genes, so their
+	// memory is reused
+	p_genome.neuron_genes = neuron_genes;
+	p_genome.link_genes = link_genes;
 
 	// Copy all other datas
 	p_genome.biggest_innovation_number = biggest_innovation_number;
@@ -784,6 +773,27 @@ uint32_t brain::NtGenome::get_innovation_number() const {
 	return biggest_innovation_number;
 }
 
+void brain::NtGenome::remap_innovation_numbers(
+		uint32_t p_base_innovation_number,
+		const std::vector<uint32_t> &p_innovation_numbers) {
+
+	if (biggest_innovation_number <= p_base_innovation_number)
+		return; // Nothing to remap
+
+	biggest_innovation_number = 0;
+	for (auto it = link_genes.begin(); it != link_genes.end(); ++it) {
+		if (it->innovation_number > p_base_innovation_number) {
+			const uint32_t i = it->innovation_number - p_base_innovation_number - 1;
+			ERR_CONTINUE(i >= p_innovation_numbers.size());
+			it->innovation_number = p_innovation_numbers[i];
+		}
+		biggest_innovation_number = MAX(biggest_innovation_number, it->innovation_number);
+	}
+
+	// Two innovations may be swapped by the remap
+	sort_genes();
+}
+
 bool brain::NtGenome::is_link_recurrent(
 		NeuronId p_parent_neuron_id,
 		NeuronId p_child_neuron_id) const {
@@ -870,39 +880,6 @@ bool brain::NtGenome::_recursive_is_link_recurrent(
 	return false;
 }
 
-int brain::NtGenome::find_innovation(
-		std::vector<NtInnovation> &p_innovations,
-		NtInnovation::InnovationType p_innovation_type,
-		NeuronId p_parent_neuron_id,
-		NeuronId p_child_neuron_id,
-		bool p_is_recurrent,
-		uint32_t p_neuron_id) {
-
-	for (auto it = p_innovations.begin(); it != p_innovations.end(); ++it) {
-
-		if (it->type != p_innovation_type)
-			continue;
-
-		if (it->parent_neuron_id != p_parent_neuron_id)
-			continue;
-
-		if (it->child_neuron_id != p_child_neuron_id)
-			continue;
-
-		if (p_innovation_type == NtInnovation::INNOVATION_LINK) {
-			if (it->is_recurrent != p_is_recurrent)
-				continue;
-		} else {
-			if (it->neuron_id != p_neuron_id)
-				continue;
-		}
-
-		return it - p_innovations.begin();
-	}
-
-	return -1;
-}
-
 bool gene_innovation_comparator(brain::NtLinkGene &p_1, brain::NtLinkGene &p_2) {
 	return p_1.innovation_number < p_2.innovation_number;
 }
@@ -1,6 +1,8 @@
 #pragma once
 
+#include "brain/NEAT/neat_innovation_registry.h"
 #include "brain/brain_areas/sharp_brain_area.h"
+#include "brain/math/random_pcg.h"
 #include <vector>
 
 typedef real_t (*map_real_1)(real_t p_arg_1);
@@ -136,53 +138,6 @@ struct NtLinkGene : public NtGene {
 	uint32_t innovation_number;
 };
 
-/**
- * @brief The Innovation struct is used to track all innovation that happens
- * during the innovation phase.
- * This is necessary in order to assign the correct innovation number to a
- * mutation.
- */
-struct NtInnovation {
-
-	/**
-	 * @brief The InnovationType enum
-	 */
-	enum InnovationType {
-		INNOVATION_NODE,
-		INNOVATION_LINK
-	};
-
-	/**
-	 * @brief The type of the innovation
-	 */
-	InnovationType type;
-
-	/**
-	 * @brief The id of the parent neuron
-	 */
-	uint32_t parent_neuron_id;
-
-	/**
-	 * @brief The id of the child neuron
-	 */
-	uint32_t child_neuron_id;
-
-	/**
-	 * @brief is recurrent link
-	 */
-	bool is_recurrent;
-
-	/**
-	 * @brief The innovation number of this innovation
-	 */
-	uint32_t innovation_number;
-
-	/**
-	 * @brief neuron_id used only with INNOVATION_NODE
-	 */
-	uint32_t neuron_id;
-};
-
 /**
  * @brief The NEATGenome class is the organism structure description that can
  * be used to generates the phenotype that is neural network
@@ -205,6 +160,12 @@ class NtGenome {
 	 */
 	std::vector<NtLinkGene> link_genes;
 
+	/**
+	 * @brief spare_neuron_genes keeps the neuron genes removed by clear, so
+	 * add_neuron can reuse the memory of their links vectors
+	 */
+	std::vector<NtNeuronGene> spare_neuron_genes;
+
 	/**
 	 * @brief biggest_innovation_number
 	 */
@@ -353,39 +314,41 @@ public:
 	 * @brief Mutates the link of just one random weight
 	 * @param p_map_func
 	 * @param p_data
+	 * @param r_rand
 	 */
-	void mutate_random_link_weight(map_real_2_ptr p_map_func, void *p_data);
+	void mutate_random_link_weight(map_real_2_ptr p_map_func, void *p_data, RandomPCG &r_rand);
 
 	/**
 	 * @brief mutate_random_link_toggle_activation take a random link and toggle its
 	 * activation status
+	 * @param r_rand
 	 */
-	void mutate_random_link_toggle_activation();
+	void mutate_random_link_toggle_activation(RandomPCG &r_rand);
 
 	/**
 	 * @brief add a random link between nodes, depending on the spwn recurrent
 	 * threshold is possible to spawn a recurrent link
 	 * @param p_spawn_recurrent_threshold
-	 * @param r_innovations Shared Innovation list that is updates in case of new innovation
-	 * @param r_current_innovation_number shared innovation number that is updated in acse of new innovation
+	 * @param r_innovations Innovation registry that is updated in case of new innovation
+	 * @param r_rand
 	 * @return returns true if the genome is mutated
 	 */
 	bool mutate_add_random_link(
 			real_t p_spawn_recurrent_threshold,
-			std::vector<NtInnovation> &r_innovations,
-			uint32_t &r_current_innovation_number);
+			NtInnovationRegistry &r_innovations,
+			RandomPCG &r_rand);
 
 	/**
 	 * @brief mutate_add_random_neuron will add a neuron in between two neurons,
 	 * the link that connect them get broken, and another two get born to connect
 	 * this new neuron
 	 * @param r_innovations
-	 * @param r_current_innovation_number
+	 * @param r_rand
 	 * @return
 	 */
 	bool mutate_add_random_neuron(
-			std::vector<NtInnovation> &r_innovations,
-			uint32_t &r_current_innovation_number);
+			NtInnovationRegistry &r_innovations,
+			RandomPCG &r_rand);
 
 	/// Cross over operations ---V
 	/// https://en.wikipedia.org/wiki/Crossover_(genetic_algorithm)
@@ -406,6 +369,7 @@ public:
 	 * @param p_daddy
 	 * @param p_daddy_fitness
 	 * @param p_average
+	 * @param r_rand
 	 * @return
 	 */
 	bool mate_multipoint(
@@ -413,7 +377,8 @@ public:
 			real_t p_mom_fitness,
 			const NtGenome &p_daddy,
 			real_t p_daddy_fitness,
-			bool p_average);
+			bool p_average,
+			RandomPCG &r_rand);
 
 	/**
 	 * @brief mate_singlepoint will choose a random point inside the smaller
@@ -423,11 +388,13 @@ public:
 	 *
 	 * @param p_mom
 	 * @param p_daddy
+	 * @param r_rand
 	 * @return
 	 */
 	bool mate_singlepoint(
 			const NtGenome &p_mom,
-			const NtGenome &p_daddy);
+			const NtGenome &p_daddy,
+			RandomPCG &r_rand);
 
 	/**
 	 * @brief generate_neural_network is used to generate the phenotype using
@@ -438,12 +405,13 @@ public:
 	void generate_neural_network(SharpBrainArea &r_brain_area) const;
 
 	/**
-	 * @brief clear function
+	 * @brief clear function, the memory is kept to build the next genome
 	 */
 	void clear();
 
 	/**
-	 * @brief duplicate_in this genome
+	 * @brief duplicate_in this genome, the memory already allocated by the
+	 * destination genome is reused
 	 * @param p_genome
 	 */
 	void duplicate_in(NtGenome &p_genome) const;
@@ -466,6 +434,17 @@ public:
 	 */
 	uint32_t get_innovation_number() const;
 
+	/**
+	 * @brief remap_innovation_numbers replaces the innovation numbers above
+	 * the base innovation number with the one computed by
+	 * NtInnovationRegistry::merge
+	 * @param p_base_innovation_number
+	 * @param p_innovation_numbers
+	 */
+	void remap_innovation_numbers(
+			uint32_t p_base_innovation_number,
+			const std::vector<uint32_t> &p_innovation_numbers);
+
 	/**
 	 * @brief is_link_recurrent is used to know if a link should be
 	 * recurrent or not, this can be used even before the real existence of the
@@ -499,25 +478,6 @@ private:
 			NeuronId p_middle_neuron_id,
 			NeuronId p_child_neuron_id,
 			std::vector<NeuronId> &r_cache) const;
-
-	/** TODO please handle this properly
-	 * @brief find_innovation is an utility function that search the innovation
-	 * inside the passed array and return the index to the innovation or -1
-	 * @param p_innovations
-	 * @param p_innovation_type
-	 * @param p_parent_neuron_id
-	 * @param p_child_neuron_id
-	 * @param p_is_recurrent
-	 * @param p_neuron_id
-	 * @return
-	 */
-	static int find_innovation(
-			std::vector<NtInnovation> &p_innovations,
-			NtInnovation::InnovationType p_innovation_type,
-			NeuronId p_parent_neuron_id,
-			NeuronId p_child_neuron_id,
-			bool p_is_recurrent,
-			uint32_t p_neuron_id);
 };
 
 } // namespace brain
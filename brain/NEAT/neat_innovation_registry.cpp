@@ -0,0 +1,191 @@
+#include "neat_innovation_registry.h"
+
+#include "brain/error_macros.h"
+
+size_t brain::NtInnovationRegistry::KeyHasher::operator()(const Key &p_key) const {
+	// Combines the fields with the 64 bits FNV-1a
+	uint64_t h = 14695981039346656037ULL;
+	h = (h ^ p_key.type) * 1099511628211ULL;
+	h = (h ^ p_key.parent_neuron_id) * 1099511628211ULL;
+	h = (h ^ p_key.child_neuron_id) * 1099511628211ULL;
+	h = (h ^ p_key.extra) * 1099511628211ULL;
+	return h ^ (h >> 32);
+}
+
+brain::NtInnovationRegistry::NtInnovationRegistry(uint32_t p_innovation_number) :
+		base(nullptr),
+		base_innovation_number(p_innovation_number),
+		epoch(0),
+		window(0),
+		innovation_number(p_innovation_number) {}
+
+void brain::NtInnovationRegistry::extend(const NtInnovationRegistry *p_base) {
+	ERR_FAIL_COND(!p_base);
+	ERR_FAIL_COND(p_base == this);
+
+	base = p_base;
+	base_innovation_number = p_base->get_innovation_number();
+	innovations.clear();
+	index.clear();
+	innovation_number = base_innovation_number;
+}
+
+void brain::NtInnovationRegistry::set_window(uint32_t p_window) {
+	window = p_window;
+}
+
+uint32_t brain::NtInnovationRegistry::get_window() const {
+	return window;
+}
+
+void brain::NtInnovationRegistry::advance_epoch() {
+	++epoch;
+
+	if (!window)
+		return;
+
+	// The innovations are ordered by epoch, so the old ones are at the front
+	while (innovations.size() && epoch - innovations.front().epoch >= window) {
+		const NtInnovation &innovation = innovations.front().innovation;
+		index.erase(make_key(
+				innovation.type,
+				innovation.parent_neuron_id,
+				innovation.child_neuron_id,
+				innovation.is_recurrent,
+				innovation.neuron_id));
+		innovations.pop_front();
+	}
+}
+
+uint32_t brain::NtInnovationRegistry::get_base_innovation_number() const {
+	return base_innovation_number;
+}
+
+uint32_t brain::NtInnovationRegistry::get_innovation_number() const {
+	return innovation_number;
+}
+
+uint32_t brain::NtInnovationRegistry::get_innovation_count() const {
+	return innovations.size();
+}
+
+const brain::NtInnovation &brain::NtInnovationRegistry::get_innovation(uint32_t p_i) const {
+	return innovations[p_i].innovation;
+}
+
+bool brain::NtInnovationRegistry::find_innovation(
+		NtInnovation::InnovationType p_type,
+		uint32_t p_parent_neuron_id,
+		uint32_t p_child_neuron_id,
+		bool p_is_recurrent,
+		uint32_t p_neuron_id,
+		uint32_t &r_innovation_number) const {
+
+	if (base && base->find_innovation(
+						p_type,
+						p_parent_neuron_id,
+						p_child_neuron_id,
+						p_is_recurrent,
+						p_neuron_id,
+						r_innovation_number)) {
+		return true;
+	}
+
+	auto it = index.find(make_key(
+			p_type,
+			p_parent_neuron_id,
+			p_child_neuron_id,
+			p_is_recurrent,
+			p_neuron_id));
+
+	if (it == index.end())
+		return false;
+
+	r_innovation_number = it->second;
+	return true;
+}
+
+uint32_t brain::NtInnovationRegistry::add_innovation(
+		NtInnovation::InnovationType p_type,
+		uint32_t p_parent_neuron_id,
+		uint32_t p_child_neuron_id,
+		bool p_is_recurrent,
+		uint32_t p_neuron_id) {
+
+	const uint32_t number = innovation_number + 1;
+
+	// The neuron innovation adds two links
+	innovation_number += p_type == NtInnovation::INNOVATION_NODE ? 2 : 1;
+
+	const NtInnovation innovation = {
+		p_type,
+		p_parent_neuron_id,
+		p_child_neuron_id,
+		p_type == NtInnovation::INNOVATION_LINK ? p_is_recurrent : false,
+		number,
+		p_type == NtInnovation::INNOVATION_NODE ? p_neuron_id : 0
+	};
+
+	innovations.push_back({ innovation, epoch });
+	index[make_key(
+			p_type,
+			p_parent_neuron_id,
+			p_child_neuron_id,
+			p_is_recurrent,
+			p_neuron_id)] = number;
+
+	return number;
+}
+
+void brain::NtInnovationRegistry::merge(
+		const NtInnovationRegistry &p_extension,
+		std::vector<uint32_t> &r_innovation_numbers) {
+
+	ERR_FAIL_COND(p_extension.base != this);
+
+	const uint32_t extension_base = p_extension.base_innovation_number;
+	r_innovation_numbers.resize(p_extension.innovation_number - extension_base);
+
+	/// The innovations are added in the extension order, so the result
+	/// depends only on the merge order
+	for (auto it = p_extension.innovations.begin(); it != p_extension.innovations.end(); ++it) {
+		const NtInnovation &innovation = it->innovation;
+
+		uint32_t number;
+		if (!find_innovation(
+					innovation.type,
+					innovation.parent_neuron_id,
+					innovation.child_neuron_id,
+					innovation.is_recurrent,
+					innovation.neuron_id,
+					number)) {
+
+			number = add_innovation(
+					innovation.type,
+					innovation.parent_neuron_id,
+					innovation.child_neuron_id,
+					innovation.is_recurrent,
+					innovation.neuron_id);
+		}
+
+		const uint32_t count = innovation.type == NtInnovation::INNOVATION_NODE ? 2 : 1;
+		for (uint32_t i(0); i < count; ++i) {
+			r_innovation_numbers[innovation.innovation_number - extension_base - 1 + i] = number + i;
+		}
+	}
+}
+
+brain::NtInnovationRegistry::Key brain::NtInnovationRegistry::make_key(
+		NtInnovation::InnovationType p_type,
+		uint32_t p_parent_neuron_id,
+		uint32_t p_child_neuron_id,
+		bool p_is_recurrent,
+		uint32_t p_neuron_id) {
+
+	Key key;
+	key.type = p_type;
+	key.parent_neuron_id = p_parent_neuron_id;
+	key.child_neuron_id = p_child_neuron_id;
+	key.extra = p_type == NtInnovation::INNOVATION_LINK ? uint32_t(p_is_recurrent) : p_neuron_id;
+	return key;
+}
@@ -0,0 +1,255 @@
+#pragma once
+
+#include "brain/typedefs.h"
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace brain {
+
+/**
+ * @brief The Innovation struct is used to track all innovation that happens
+ * during the innovation phase.
+ * This is necessary in order to assign the correct innovation number to a
+ * mutation.
+ */
+struct NtInnovation {
+
+	/**
+	 * @brief The InnovationType enum
+	 */
+	enum InnovationType {
+		INNOVATION_NODE,
+		INNOVATION_LINK
+	};
+
+	/**
+	 * @brief The type of the innovation
+	 */
+	InnovationType type;
+
+	/**
+	 * @brief The id of the parent neuron
+	 */
+	uint32_t parent_neuron_id;
+
+	/**
+	 * @brief The id of the child neuron
+	 */
+	uint32_t child_neuron_id;
+
+	/**
+	 * @brief is recurrent link
+	 */
+	bool is_recurrent;
+
+	/**
+	 * @brief The innovation number of this innovation
+	 */
+	uint32_t innovation_number;
+
+	/**
+	 * @brief neuron_id used only with INNOVATION_NODE
+	 */
+	uint32_t neuron_id;
+};
+
+/**
+ * @brief The NtInnovationRegistry class assigns the innovation numbers, so the
+ * same mutation gets the same number no matter the genome where it happens.
+ *
+ * A registry can extend another one: the innovations of the base are only
+ * read and the new innovations are numbered right after the base ones.
+ * In this way many registries can extend the same base from different
+ * threads, then they are merged in the base one after the other, and the
+ * final numbers depends only on the merge order.
+ *
+ * The innovations are indexed by a hash table, and the registry can forget
+ * the innovations older than a window of epochs: a forgotten mutation that
+ * happens again simply gets a new innovation number.
+ */
+class NtInnovationRegistry {
+
+	/**
+	 * @brief The Key struct identifies an innovation: the last field is the
+	 * recurrent flag for the links and the neuron id for the neurons
+	 */
+	struct Key {
+		uint32_t type;
+		uint32_t parent_neuron_id;
+		uint32_t child_neuron_id;
+		uint32_t extra;
+
+		bool operator==(const Key &p_other) const {
+			return type == p_other.type &&
+				   parent_neuron_id == p_other.parent_neuron_id &&
+				   child_neuron_id == p_other.child_neuron_id &&
+				   extra == p_other.extra;
+		}
+	};
+
+	struct KeyHasher {
+		size_t operator()(const Key &p_key) const;
+	};
+
+	/**
+	 * @brief The Entry struct is an innovation with the epoch when it was
+	 * registered
+	 */
+	struct Entry {
+		NtInnovation innovation;
+		uint32_t epoch;
+	};
+
+	/**
+	 * @brief base is the extended registry, or null
+	 */
+	const NtInnovationRegistry *base;
+
+	/**
+	 * @brief base_innovation_number is the last innovation number of the base
+	 * when it was extended, the innovations of this registry come after it
+	 */
+	uint32_t base_innovation_number;
+
+	/**
+	 * @brief innovations ordered by innovation number, so the oldest are
+	 * always at the front
+	 */
+	std::deque<Entry> innovations;
+
+	/**
+	 * @brief index maps each innovation to its number
+	 */
+	std::unordered_map<Key, uint32_t, KeyHasher> index;
+
+	/**
+	 * @brief epoch is incremented by advance_epoch
+	 */
+	uint32_t epoch;
+
+	/**
+	 * @brief window is the number of epochs an innovation is remembered,
+	 * 0 means forever
+	 */
+	uint32_t window;
+
+	/**
+	 * @brief innovation_number is the last innovation number assigned
+	 */
+	uint32_t innovation_number;
+
+public:
+	/**
+	 * @brief NtInnovationRegistry
+	 * @param p_innovation_number the last innovation number already used
+	 */
+	NtInnovationRegistry(uint32_t p_innovation_number = 0);
+
+	/**
+	 * @brief extend clears this registry and makes it extend the passed one,
+	 * that must not change until this registry is used
+	 * @param p_base
+	 */
+	void extend(const NtInnovationRegistry *p_base);
+
+	/**
+	 * @brief set_window sets for how many epochs the innovations are
+	 * remembered, 0 means forever
+	 * @param p_window
+	 */
+	void set_window(uint32_t p_window);
+	uint32_t get_window() const;
+
+	/**
+	 * @brief advance_epoch starts a new epoch and forgets the innovations
+	 * that are out of the window
+	 */
+	void advance_epoch();
+
+	/**
+	 * @brief get_base_innovation_number returns the last innovation number
+	 * of the base, all the innovation numbers above it are of this registry
+	 * @return
+	 */
+	uint32_t get_base_innovation_number() const;
+
+	/**
+	 * @brief get_innovation_number returns the last innovation number
+	 * assigned
+	 * @return
+	 */
+	uint32_t get_innovation_number() const;
+
+	/**
+	 * @brief get_innovation_count returns the innovations remembered by this
+	 * registry, the base innovations are not counted
+	 * @return
+	 */
+	uint32_t get_innovation_count() const;
+
+	const NtInnovation &get_innovation(uint32_t p_i) const;
+
+	/**
+	 * @brief find_innovation searches the innovation in the base then in this
+	 * registry, in constant time.
+	 *
+	 * The neuron innovations are compared using the neuron id, the link
+	 * innovations using the recurrent flag.
+	 *
+	 * @param p_type
+	 * @param p_parent_neuron_id
+	 * @param p_child_neuron_id
+	 * @param p_is_recurrent
+	 * @param p_neuron_id
+	 * @param r_innovation_number
+	 * @return true if found
+	 */
+	bool find_innovation(
+			NtInnovation::InnovationType p_type,
+			uint32_t p_parent_neuron_id,
+			uint32_t p_child_neuron_id,
+			bool p_is_recurrent,
+			uint32_t p_neuron_id,
+			uint32_t &r_innovation_number) const;
+
+	/**
+	 * @brief add_innovation registers a new innovation, a neuron innovation
+	 * takes two numbers one per link.
+	 * @param p_type
+	 * @param p_parent_neuron_id
+	 * @param p_child_neuron_id
+	 * @param p_is_recurrent
+	 * @param p_neuron_id
+	 * @return the innovation number
+	 */
+	uint32_t add_innovation(
+			NtInnovation::InnovationType p_type,
+			uint32_t p_parent_neuron_id,
+			uint32_t p_child_neuron_id,
+			bool p_is_recurrent,
+			uint32_t p_neuron_id);
+
+	/**
+	 * @brief merge adds the innovations of a registry that extended this one,
+	 * the innovations already present keep their number.
+	 *
+	 * @param p_extension
+	 * @param r_innovation_numbers is the final number of each innovation
+	 * number above the extension base innovation number. It's used by
+	 * NtGenome::remap_innovation_numbers
+	 */
+	void merge(
+			const NtInnovationRegistry &p_extension,
+			std::vector<uint32_t> &r_innovation_numbers);
+
+private:
+	static Key make_key(
+			NtInnovation::InnovationType p_type,
+			uint32_t p_parent_neuron_id,
+			uint32_t p_child_neuron_id,
+			bool p_is_recurrent,
+			uint32_t p_neuron_id);
+};
+
+} // namespace brain
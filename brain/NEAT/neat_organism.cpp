@@ -25,6 +25,19 @@ brain::NtOrganism::~NtOrganism() {
 	}
 }
 
+void brain::NtOrganism::reset() {
+	ERR_FAIL_COND(species);
+	marked_for_death = false;
+	is_dirty_brain_area = true;
+	middle_fitness_sum = 0.f;
+	middle_fitness_count = 0;
+	fitness = 0.f;
+	personal_fitness = 0.f;
+	expected_offspring = 0.f;
+	the_best = false;
+	champion_clone = false;
+}
+
 brain::NtGenome &brain::NtOrganism::get_genome_mutable() {
 	is_dirty_brain_area = true;
 	return genome;
@@ -101,6 +101,13 @@ public:
 	 */
 	~NtOrganism();
 
+	/**
+	 * @brief reset brings the organism to the state of a new one, so it can
+	 * be reused by the next generation. The genome and the brain area keep
+	 * their memory, the genome must be rewritten before use.
+	 */
+	void reset();
+
 	/**
 	 * @brief get_genome_mutable give the possibility to mutate the
 	 * genome from outside
@@ -5,20 +5,63 @@
 #include "brain/NEAT/neat_species.h"
 #include "brain/error_macros.h"
 #include "brain/math/math_funcs.h"
+#include "brain/thread_pool.h"
 #include <algorithm>
 
+/**
+ * @brief The EvaluationTask struct is the data of the evaluate_all tasks
+ */
+struct EvaluationTask {
+	const std::vector<brain::NtOrganism *> *organisms;
+	brain::NtPopulation::fitness_func fitness_func;
+	void *data;
+	std::vector<real_t> fitnesses;
+};
+
+/**
+ * @brief The SpeciationTask struct is the data of the speciate tasks
+ */
+struct SpeciationTask {
+	const brain::NtPopulation *population;
+
+	/// The organisms to speciate
+	std::vector<brain::NtOrganism *> organisms;
+
+	/// The species that have a spokesman
+	std::vector<brain::NtSpecies *> species;
+	std::vector<brain::NtInnovationBitset> spokesman_bitsets;
+
+	/// The index of the first compatible species of each organism or -1
+	std::vector<int> matches;
+};
+
+/**
+ * @brief mix_seed scrambles the bits (splitmix64 finalizer), it's used to
+ * derive the species random streams from the seed
+ */
+static uint64_t mix_seed(uint64_t p_x) {
+	p_x += 0x9E3779B97F4A7C15ULL;
+	p_x = (p_x ^ (p_x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	p_x = (p_x ^ (p_x >> 27)) * 0x94D049BB133111EBULL;
+	return p_x ^ (p_x >> 31);
+}
+
 brain::NtPopulation::NtPopulation(
 		const NtGenome &p_ancestor_genome,
 		int p_population_size,
 		NtPopulationSettings &p_settings) :
 		population_size(p_population_size),
 		settings(p_settings),
+		thread_pool(p_settings.thread_count),
 		species_last_index(0),
-		rand_generator(p_settings.seed),
-		gaussian_distribution(0, p_settings.learning_deviation),
 		epoch(1),
 		best_personal_fitness(0.f),
-		epoch_last_improvement(epoch) {
+		epoch_last_improvement(epoch),
+		innovations(p_ancestor_genome.get_innovation_number()) {
+
+	random_stream.rand = RandomPCG(mix_seed(p_settings.seed));
+	random_stream.deviation = p_settings.learning_deviation;
+	innovations.set_window(p_settings.innovations_window);
 
 	organisms.reserve(p_population_size);
 
@@ -31,11 +74,9 @@ brain::NtPopulation::NtPopulation(
 
 		new_organism_genome.mutate_all_link_weights(
 				rand_gaussian,
-				static_cast<void *>(this));
+				static_cast<void *>(&random_stream));
 	}
 
-	innovation_number = p_ancestor_genome.get_innovation_number();
-
 	speciate();
 }
 
@@ -67,6 +108,31 @@ real_t brain::NtPopulation::organism_get_fitness(uint32_t p_organism_i) const {
 	return organisms[p_organism_i]->get_personal_fitness();
 }
 
+void brain::NtPopulation::evaluate_all(
+		fitness_func p_fitness_func,
+		void *p_data) {
+
+	ERR_FAIL_COND(!p_fitness_func);
+
+	EvaluationTask task;
+	task.organisms = &organisms;
+	task.fitness_func = p_fitness_func;
+	task.data = p_data;
+	task.fitnesses.resize(organisms.size(), 0.f);
+
+	/// Step 1. Build the dirty neural networks, so the evaluation only
+	/// reads them
+	thread_pool.parallel_for(organisms.size(), prepare_organism_network, &task);
+
+	/// Step 2. Evaluate, each organism writes its own fitness
+	thread_pool.parallel_for(organisms.size(), evaluate_organism, &task);
+
+	/// Step 3. Set the fitness
+	for (uint32_t i(0); i < organisms.size(); ++i) {
+		organisms[i]->set_evaluation(task.fitnesses[i]);
+	}
+}
+
 bool brain::NtPopulation::epoch_advance() {
 
 	statistics.clear();
@@ -142,7 +208,8 @@ bool brain::NtPopulation::epoch_advance() {
 	statistics.species_best_age = best_species->get_age();
 
 	/// Stage 3. calculates average population fitness
-	real_t total_fitness(0);
+	// The sum is in double, so big populations don't lose offsprings
+	double total_fitness(0);
 	for (auto it = organisms.begin(); it != organisms.end(); ++it) {
 		total_fitness += (*it)->get_fitness();
 	}
@@ -340,7 +407,7 @@ bool brain::NtPopulation::epoch_advance() {
 					bool all_are_stagnant = true;
 					// Bost the best species
 					real_t luck_bost = 3;
-					real_t roulet_ball_pos = Math::randd();
+					real_t roulet_ball_pos = random_stream.rand.randd();
 
 					for (auto it = ordered_species.begin(); it != ordered_species.end(); ++it) {
 
@@ -439,16 +506,15 @@ bool brain::NtPopulation::epoch_advance() {
 	population_champion = nullptr;
 
 	// Make the fittest organism reproduct
-	for (auto it = species.begin(); it != species.end(); ++it) {
-		(*it)->reproduce(innovations);
-	}
+	innovations.advance_epoch();
+	reproduce();
 
 	// Speciate the newest organism
 	speciate();
 
 	// Kill older organisms that still inside the species
 	for (auto it = species.begin(); it != species.end(); ++it) {
-		(*it)->kill_old_organisms();
+		(*it)->kill_old_organisms(free_organisms);
 	}
 
 	// Make rid of void species
@@ -497,33 +563,124 @@ const brain::NtEpochStatistics &brain::NtPopulation::get_epoch_statistics() cons
 	return statistics;
 }
 
+void brain::NtPopulation::reproduce() {
+
+	offsprings.resize(species.size());
+
+	/// Step 1. Prepare the offspring of each species, the random stream
+	/// depends only on the seed, the epoch and the species id. The free
+	/// organisms are given to the species, to be reused for their children
+	const uint64_t epoch_seed = mix_seed(settings.seed ^ mix_seed(epoch));
+	for (uint32_t i(0); i < species.size(); ++i) {
+		NtOffspring &offspring = offsprings[i];
+		const uint32_t species_id = species[i]->get_id();
+
+		offspring.stream.rand = RandomPCG(
+				mix_seed(epoch_seed ^ species_id),
+				(uint64_t(species_id) << 1) | 1);
+		offspring.stream.deviation = settings.learning_deviation;
+		offspring.innovations.extend(&innovations);
+		offspring.children.clear();
+		offspring.statistics.clear();
+
+		const uint32_t offspring_count = MAX(species[i]->get_offspring_count(), 0);
+		while (offspring.spare_organisms.size() < offspring_count && free_organisms.size()) {
+			offspring.spare_organisms.push_back(free_organisms.back());
+			free_organisms.pop_back();
+		}
+	}
+
+	/// Step 2. Reproduce, the species only read the population
+	thread_pool.parallel_for(species.size(), reproduce_species, this);
+
+	/// Step 3. Merge the innovations and collect the children in the species
+	/// order
+	std::vector<uint32_t> innovation_numbers;
+	for (auto it = offsprings.begin(); it != offsprings.end(); ++it) {
+
+		innovations.merge(it->innovations, innovation_numbers);
+		const uint32_t base_innovation_number = it->innovations.get_base_innovation_number();
+
+		for (auto it_c = it->children.begin(); it_c != it->children.end(); ++it_c) {
+			(*it_c)->get_genome_mutable().remap_innovation_numbers(
+					base_innovation_number,
+					innovation_numbers);
+			organisms.push_back(*it_c);
+		}
+
+		statistics.add_reproduction(it->statistics);
+		it->children.clear();
+
+		// Take back the unused organisms
+		free_organisms.insert(
+				free_organisms.end(),
+				it->spare_organisms.begin(),
+				it->spare_organisms.end());
+		it->spare_organisms.clear();
+	}
+}
+
 void brain::NtPopulation::speciate() {
 
+	const bool use_bitsets = settings.genetic_compatibility_bitset;
+
+	/// Step 1. Collect the organisms to speciate and the species with a
+	/// spokesman. The spokesman is the first organism and the new organisms
+	/// are appended, so it doesn't change during the speciation
+	SpeciationTask task;
+	task.population = this;
+
 	for (auto it_o = organisms.begin(); it_o != organisms.end(); ++it_o) {
-		NtOrganism *o = *it_o;
+		if (!(*it_o)->get_species())
+			task.organisms.push_back(*it_o);
+	}
 
-		if (o->get_species())
-			continue; // This organism is already speciated
+	if (!task.organisms.size())
+		return; // All organisms are already speciated
 
-		NtSpecies *compatible_species(nullptr);
+	for (auto it_s = species.begin(); it_s != species.end(); ++it_s) {
+		if ((*it_s)->size())
+			task.species.push_back(*it_s);
+	}
+
+	if (use_bitsets) {
+		task.spokesman_bitsets.resize(task.species.size());
+		thread_pool.parallel_for(task.species.size(), make_spokesman_bitset, &task);
+	}
+
+	/// Step 2. Search the first compatible species of each organism
+	task.matches.resize(task.organisms.size(), -1);
+	if (task.species.size())
+		thread_pool.parallel_for(task.organisms.size(), find_organism_species, &task);
+
+	/// Step 3. Add the organisms in sequence, the ones without a species are
+	/// compared against the species created by the previous organisms
+	std::vector<NtSpecies *> new_species;
+	std::vector<NtInnovationBitset> new_spokesman_bitsets;
+	NtInnovationBitset organism_bitset;
 
-		// Search compatible specie
-		for (auto it_s = species.begin(); it_s != species.end(); ++it_s) {
+	for (uint32_t i(0); i < task.organisms.size(); ++i) {
+		NtOrganism *o = task.organisms[i];
 
-			NtSpecies *s = *it_s;
-			if (!s->size())
-				continue;
+		if (0 <= task.matches[i]) {
+			add_organism_to_species(o, task.species[task.matches[i]]);
+			continue;
+		}
+
+		NtSpecies *compatible_species(nullptr);
 
-			NtOrganism *spokesman = s->get_organism(0);
-			const real_t compatibility = NtGenetic::compatibility(
+		if (use_bitsets)
+			NtGenetic::make_innovation_bitset(o->get_genome(), organism_bitset);
+
+		for (uint32_t s(0); s < new_species.size(); ++s) {
+			const real_t c = compatibility(
 					o->get_genome(),
-					spokesman->get_genome(),
-					settings.genetic_disjoints_significance,
-					settings.genetic_excesses_significance,
-					settings.genetic_weights_significance);
+					organism_bitset,
+					new_species[s]->get_organism(0)->get_genome(),
+					use_bitsets ? new_spokesman_bitsets[s] : organism_bitset);
 
-			if (compatibility <= settings.genetic_compatibility_threshold) {
-				compatible_species = s;
+			if (c <= settings.genetic_compatibility_threshold) {
+				compatible_species = new_species[s];
 				break;
 			}
 		}
@@ -532,24 +689,54 @@ void brain::NtPopulation::speciate() {
 		if (!compatible_species) {
 			compatible_species = create_species();
 			ERR_FAIL_COND(!compatible_species);
+
+			// This organism is the spokesman of the new species
+			new_species.push_back(compatible_species);
+			if (use_bitsets)
+				new_spokesman_bitsets.push_back(organism_bitset);
 		}
 
 		add_organism_to_species(o, compatible_species);
 	}
 }
 
+real_t brain::NtPopulation::compatibility(
+		const NtGenome &p_genome,
+		const NtInnovationBitset &p_bitset,
+		const NtGenome &p_spokesman_genome,
+		const NtInnovationBitset &p_spokesman_bitset) const {
+
+	if (settings.genetic_compatibility_bitset) {
+		return NtGenetic::compatibility(
+				p_bitset,
+				p_spokesman_bitset,
+				settings.genetic_disjoints_significance,
+				settings.genetic_excesses_significance,
+				settings.genetic_weights_significance);
+	} else {
+		return NtGenetic::compatibility(
+				p_genome,
+				p_spokesman_genome,
+				settings.genetic_disjoints_significance,
+				settings.genetic_excesses_significance,
+				settings.genetic_weights_significance);
+	}
+}
+
 void brain::NtPopulation::kill_void_species() {
 
-	/// Removes all species with 0 organisms
-	auto it = species.begin();
-	while (it != species.end()) {
+	/// Removes all species with 0 organisms, compacting the others in one
+	/// pass
+	uint32_t alive_count(0);
+	for (uint32_t i(0); i < species.size(); ++i) {
 
-		if (!(*it)->size()) {
-			it = destroy_species(it);
+		if (species[i]->size()) {
+			species[alive_count++] = species[i];
 		} else {
-			++it;
+			delete species[i];
 		}
 	}
+	species.resize(alive_count);
 }
 
 brain::NtSpecies *brain::NtPopulation::create_species() {
@@ -558,20 +745,6 @@ brain::NtSpecies *brain::NtPopulation::create_species() {
 	return new_species;
 }
 
-void brain::NtPopulation::destroy_species(NtSpecies *p_species) {
-	auto it_s = std::find(species.begin(), species.end(), p_species);
-	ERR_FAIL_COND(it_s == species.end());
-	destroy_species(it_s);
-}
-
-std::vector<brain::NtSpecies *>::iterator brain::NtPopulation::destroy_species(
-		std::vector<NtSpecies *>::iterator p_species_iterator) {
-	NtSpecies *s(*p_species_iterator);
-	auto ret = species.erase(p_species_iterator);
-	delete s;
-	return ret;
-}
-
 void brain::NtPopulation::destroy_all_species() {
 	for (
 			auto it = species.begin();
@@ -586,46 +759,52 @@ void brain::NtPopulation::destroy_all_species() {
 
 brain::NtOrganism *brain::NtPopulation::create_organism() {
 	ERR_FAIL_COND_V(organisms.size() >= population_size, nullptr);
-	NtOrganism *o = new NtOrganism(this);
+	NtOrganism *o;
+	if (free_organisms.size()) {
+		o = free_organisms.back();
+		free_organisms.pop_back();
+		o->reset();
+	} else {
+		o = new NtOrganism(this);
+	}
 	organisms.push_back(o);
 	return o;
 }
 
-void brain::NtPopulation::destroy_organism(NtOrganism *p_organism) {
-	auto iterator = std::find(organisms.begin(), organisms.end(), p_organism);
-	ERR_FAIL_COND(iterator == organisms.end());
-	destroy_organism(iterator);
-}
-
-std::vector<brain::NtOrganism *>::iterator brain::NtPopulation::destroy_organism(
-		std::vector<NtOrganism *>::iterator p_organism_iterator) {
-
-	remove_organism_from_species(*p_organism_iterator);
-	NtOrganism *o = *p_organism_iterator;
-	auto ret = organisms.erase(p_organism_iterator);
-	delete o;
-	return ret;
-}
-
 void brain::NtPopulation::destroy_all_organisms() {
 	for (
 			auto it = organisms.begin();
 			it != organisms.end();
 			++it) {
 
-		remove_organism_from_species(*it);
+		(*it)->set_mark_for_death(true);
+	}
+	kill_organisms_marked_for_death();
+
+	for (auto it = free_organisms.begin(); it != free_organisms.end(); ++it) {
 		delete (*it);
 	}
-	organisms.clear();
+	free_organisms.clear();
 }
 
 void brain::NtPopulation::kill_organisms_marked_for_death() {
-	auto it = organisms.begin();
-	while (it != organisms.end()) {
-		if ((*it)->is_marked_for_death())
-			it = destroy_organism(it);
-		else
-			++it;
+
+	/// Step 1. Compact the alive organisms in one pass
+	uint32_t alive_count(0);
+	for (uint32_t i(0); i < organisms.size(); ++i) {
+		NtOrganism *o = organisms[i];
+		if (!o->is_marked_for_death()) {
+			organisms[alive_count++] = o;
+		} else if (!o->get_species()) {
+			// The species takes care of its own organisms
+			free_organisms.push_back(o);
+		}
+	}
+	organisms.resize(alive_count);
+
+	/// Step 2. Each species removes its dead organisms in one pass
+	for (auto it = species.begin(); it != species.end(); ++it) {
+		(*it)->kill_old_organisms(free_organisms);
 	}
 }
 
@@ -638,15 +817,9 @@ void brain::NtPopulation::add_organism_to_species(
 	p_organism->set_species(p_species);
 }
 
-void brain::NtPopulation::remove_organism_from_species(NtOrganism *p_organism) {
-	if (!p_organism->get_species())
-		return;
-	p_organism->get_species()->remove_organism(p_organism);
-	p_organism->set_species(nullptr);
-}
-
 brain::NtOrganism *brain::NtPopulation::get_rand_champion(
-		const NtSpecies *p_except_species) const {
+		const NtSpecies *p_except_species,
+		RandomPCG &r_rand) const {
 
 	if (!species.size())
 		return nullptr;
@@ -655,7 +828,7 @@ brain::NtOrganism *brain::NtPopulation::get_rand_champion(
 		return nullptr;
 
 	const int rand_index =
-			static_cast<int>(Math::random(0, species.size() - 1) + 0.5);
+			static_cast<int>(r_rand.random(0, species.size() - 1) + 0.5);
 
 	NtSpecies *rand_species(nullptr);
 	if (species[rand_index] != p_except_species) {
@@ -679,11 +852,65 @@ brain::NtOrganism *brain::NtPopulation::get_rand_champion(
 }
 
 real_t brain::NtPopulation::rand_gaussian(real_t p_x, void *p_data) {
-	NtPopulation *pop = static_cast<NtPopulation *>(p_data);
-	return p_x + pop->gaussian_distribution(pop->rand_generator);
+	NtRandomStream *stream = static_cast<NtRandomStream *>(p_data);
+	return p_x + stream->rand.randfn(0, stream->deviation);
 }
 
 real_t brain::NtPopulation::rand_cold_gaussian(real_t p_x, void *p_data) {
-	NtPopulation *pop = static_cast<NtPopulation *>(p_data);
-	return pop->gaussian_distribution(pop->rand_generator);
+	NtRandomStream *stream = static_cast<NtRandomStream *>(p_data);
+	return stream->rand.randfn(0, stream->deviation);
+}
+
+void brain::NtPopulation::prepare_organism_network(uint32_t p_organism_i, void *p_data) {
+	EvaluationTask *task = static_cast<EvaluationTask *>(p_data);
+
+	// The network is generated by the organism only when dirty
+	const SharpBrainArea &brain_area = (*task->organisms)[p_organism_i]->get_brain_area();
+	brain_area.is_ready();
+}
+
+void brain::NtPopulation::reproduce_species(uint32_t p_species_i, void *p_data) {
+	NtPopulation *population = static_cast<NtPopulation *>(p_data);
+	population->species[p_species_i]->reproduce(population->offsprings[p_species_i]);
+}
+
+void brain::NtPopulation::make_spokesman_bitset(uint32_t p_species_i, void *p_data) {
+	SpeciationTask *task = static_cast<SpeciationTask *>(p_data);
+
+	NtGenetic::make_innovation_bitset(
+			task->species[p_species_i]->get_organism(0)->get_genome(),
+			task->spokesman_bitsets[p_species_i]);
+}
+
+void brain::NtPopulation::find_organism_species(uint32_t p_organism_i, void *p_data) {
+	SpeciationTask *task = static_cast<SpeciationTask *>(p_data);
+	const NtPopulation *population = task->population;
+	const NtGenome &genome = task->organisms[p_organism_i]->get_genome();
+
+	// Each thread reuses its bitset
+	thread_local static NtInnovationBitset bitset;
+	if (population->settings.genetic_compatibility_bitset)
+		NtGenetic::make_innovation_bitset(genome, bitset);
+
+	for (uint32_t s(0); s < task->species.size(); ++s) {
+		const real_t c = population->compatibility(
+				genome,
+				bitset,
+				task->species[s]->get_organism(0)->get_genome(),
+				population->settings.genetic_compatibility_bitset ? task->spokesman_bitsets[s] : bitset);
+
+		if (c <= population->settings.genetic_compatibility_threshold) {
+			task->matches[p_organism_i] = s;
+			return;
+		}
+	}
+}
+
+void brain::NtPopulation::evaluate_organism(uint32_t p_organism_i, void *p_data) {
+	EvaluationTask *task = static_cast<EvaluationTask *>(p_data);
+
+	task->fitnesses[p_organism_i] = task->fitness_func(
+			p_organism_i,
+			(*task->organisms)[p_organism_i]->get_brain_area(),
+			task->data);
 }
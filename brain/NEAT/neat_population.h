@@ -1,7 +1,8 @@
 #pragma once
 
+#include "brain/NEAT/neat_genetic.h"
 #include "brain/NEAT/neat_genome.h"
-#include <random>
+#include "brain/thread_pool.h"
 
 namespace brain {
 
@@ -75,6 +76,22 @@ struct NtEpochStatistics {
 		reproduction_mutate_toggle_link_activation = 0;
 	}
 
+	/**
+	 * @brief add_reproduction sums the reproduction statistics of a species
+	 * @param p_statistics
+	 */
+	void add_reproduction(const NtEpochStatistics &p_statistics) {
+		reproduction_champion_mutate_weights += p_statistics.reproduction_champion_mutate_weights;
+		reproduction_champion_add_random_link += p_statistics.reproduction_champion_add_random_link;
+		reproduction_mate_multipoint += p_statistics.reproduction_mate_multipoint;
+		reproduction_mate_multipoint_avg += p_statistics.reproduction_mate_multipoint_avg;
+		reproduction_mate_singlepoint += p_statistics.reproduction_mate_singlepoint;
+		reproduction_mutate_add_random_link += p_statistics.reproduction_mutate_add_random_link;
+		reproduction_mutate_add_random_neuron += p_statistics.reproduction_mutate_add_random_neuron;
+		reproduction_mutate_weights += p_statistics.reproduction_mutate_weights;
+		reproduction_mutate_toggle_link_activation += p_statistics.reproduction_mutate_toggle_link_activation;
+	}
+
 	/**
 	 * @brief The epoch when this statistic was recordered
 	 */
@@ -211,6 +228,50 @@ struct NtEpochStatistics {
 	int reproduction_mutate_toggle_link_activation;
 };
 
+/**
+ * @brief The NtRandomStream struct is an independent sequence of random
+ * numbers. Each species gets its own stream derived from the seed, the epoch
+ * and the species id, so the result doesn't depend on the order the species
+ * are processed.
+ */
+struct NtRandomStream {
+	RandomPCG rand;
+
+	/**
+	 * @brief deviation of the gaussian used to mutate the weights
+	 */
+	real_t deviation;
+};
+
+/**
+ * @brief The NtOffspring struct collects what a species produces during the
+ * reproduction. Each species writes only its own, so all the species can
+ * reproduce at the same time; then the population merges them in the species
+ * order.
+ */
+struct NtOffspring {
+	NtRandomStream stream;
+
+	/**
+	 * @brief innovations happened in this species, it extends the population
+	 * registry so its innovation numbers are temporary
+	 */
+	NtInnovationRegistry innovations;
+
+	std::vector<NtOrganism *> children;
+
+	/**
+	 * @brief spare_organisms are dead organisms given by the population, the
+	 * species reuses them for its children before allocating new ones
+	 */
+	std::vector<NtOrganism *> spare_organisms;
+
+	/**
+	 * @brief statistics only the reproduction statistics are used
+	 */
+	NtEpochStatistics statistics;
+};
+
 /**
  * @brief The NtPopulationSettings struct is a utility structure used to initialize
  * easily the population settings.
@@ -299,6 +360,15 @@ struct NtPopulationSettings {
 	 */
 	real_t genetic_weights_significance = 0.4f;
 
+	/**
+	 * @brief genetic_compatibility_bitset makes the speciation compare the
+	 * genomes using their innovation bitsets (Check NtInnovationBitset).
+	 *
+	 * The result is the same, but it's faster only when the genomes are
+	 * dense: many genes with innovation numbers close to each other.
+	 */
+	bool genetic_compatibility_bitset = false;
+
 	/**
 	 * @brief genetic_mate_prob is used to define the probability for
 	 * a genome to mate with another one, instead to mutate.
@@ -418,6 +488,24 @@ struct NtPopulationSettings {
 	 * become stagnant and is not able to improve more.
 	 */
 	int population_stagnant_age_thresold = 15;
+
+	/**
+	 * @brief innovations_window is the number of epochs the innovations are
+	 * remembered. When the same mutation happens within this window it gets
+	 * the same innovation number, after it's a new innovation.
+	 *
+	 * By default (0) the innovations are remembered forever. A window
+	 * keeps the memory used by the innovations constant, but it changes the
+	 * evolution: a mutation seen again after the window is a new innovation.
+	 */
+	uint32_t innovations_window = 0;
+
+	/**
+	 * @brief thread_count is the number of threads used to evaluate,
+	 * reproduce and speciate the organisms, 0 means one thread per core.
+	 * The result doesn't depend on it.
+	 */
+	uint32_t thread_count = 0;
 };
 
 /**
@@ -430,6 +518,23 @@ class NtPopulation {
 
 	friend class NtSpecies;
 
+public:
+	/**
+	 * @brief fitness_func evaluates an organism and returns its fitness.
+	 * It's called from many threads at the same time, each organism is
+	 * evaluated by one thread only.
+	 *
+	 * @param p_organism_i
+	 * @param p_brain_area the organism neural network
+	 * @param p_data the user data passed to evaluate_all
+	 */
+	typedef real_t (*fitness_func)(
+			uint32_t p_organism_i,
+			const SharpBrainArea &p_brain_area,
+			void *p_data);
+
+private:
+
 	/**
 	 * @brief The population size
 	 */
@@ -441,12 +546,9 @@ class NtPopulation {
 	NtPopulationSettings settings;
 
 	/**
-	 * @brief innovation_number is an incremental number that is used to
-	 * mark and so track all changes to the organism genome.
-	 *
-	 * This is the last innovation number assigned
+	 * @brief thread_pool is used by epoch_advance
 	 */
-	uint32_t innovation_number;
+	ThreadPool thread_pool;
 
 	/**
 	 * @brief species_last_index used to give a unique ID to the species
@@ -454,15 +556,10 @@ class NtPopulation {
 	uint32_t species_last_index;
 
 	/**
-	 * @brief rand_generator is used to generate a random number
+	 * @brief random_stream is used by the population, the species use their
+	 * own streams during the reproduction
 	 */
-	std::default_random_engine rand_generator;
-
-	/**
-	 * @brief gaussian_distribution is used to generate a random number within
-	 * the gaussina distribution
-	 */
-	std::normal_distribution<real_t> gaussian_distribution;
+	NtRandomStream random_stream;
 
 	/**
 	 * @brief species is the array of species of this population
@@ -475,6 +572,13 @@ class NtPopulation {
 	 */
 	std::vector<NtOrganism *> organisms;
 
+	/**
+	 * @brief free_organisms are the dead organisms kept to be reused by the
+	 * next generations, so their genome and brain area memory is not
+	 * allocated again each epoch
+	 */
+	std::vector<NtOrganism *> free_organisms;
+
 	/**
 	 * @brief epoch counter
 	 */
@@ -494,9 +598,17 @@ class NtPopulation {
 	int epoch_last_improvement;
 
 	/**
-	 * @brief innovations list of innovations
+	 * @brief innovations is the registry of all innovations, it assigns the
+	 * innovation numbers used to mark and so track all changes to the
+	 * organism genome.
+	 */
+	NtInnovationRegistry innovations;
+
+	/**
+	 * @brief offsprings has one element per species, it's used during the
+	 * reproduction
 	 */
-	std::vector<NtInnovation> innovations;
+	std::vector<NtOffspring> offsprings;
 
 	/**
 	 * @brief champion_genome This is the champion genome of the past epoch.
@@ -568,6 +680,24 @@ public:
 	 */
 	real_t organism_get_fitness(uint32_t p_organism_i) const;
 
+	/**
+	 * @brief evaluate_all sets the fitness of all organisms, computed by the
+	 * passed function from many threads.
+	 *
+	 * The neural networks of all organisms are built before the
+	 * evaluation, so the organisms can be safely accessed from the threads;
+	 * then the fitness are set once all the evaluations are done.
+	 *
+	 * The evaluation uses the threads of the population, see
+	 * NtPopulationSettings::thread_count.
+	 *
+	 * @param p_fitness_func
+	 * @param p_data user data passed to the fitness function
+	 */
+	void evaluate_all(
+			fitness_func p_fitness_func,
+			void *p_data);
+
 	/**
 	 * @brief epoch_advance is who make possible the turnover of the population.
 	 * In this function every organism die and get replaced with a new one of
@@ -602,33 +732,41 @@ private:
 	 * @brief speciate splits all organisms in species depending on its
 	 * genome compatibility.
 	 * The splitting criteria can be controlled by changing the splitting_threshold
+	 *
+	 * Each organism joins the first compatible species, otherwise creates a
+	 * new one. The organisms are compared against the existing species in
+	 * parallel, then the organisms that didn't find a species are compared
+	 * one by one against the species created during this speciation; the
+	 * result is the same of comparing all organisms in sequence.
 	 */
 	void speciate();
 
 	/**
-	 * @brief kill all species with no organisms
-	 */
-	void kill_void_species();
-
-	/**
-	 * @brief create_species creates a new void species and returns its pointer
+	 * @brief compatibility compares the genomes using the bitsets when
+	 * NtPopulationSettings::genetic_compatibility_bitset is set
+	 * @param p_genome
+	 * @param p_bitset
+	 * @param p_spokesman_genome
+	 * @param p_spokesman_bitset
 	 * @return
 	 */
-	NtSpecies *create_species();
+	real_t compatibility(
+			const NtGenome &p_genome,
+			const NtInnovationBitset &p_bitset,
+			const NtGenome &p_spokesman_genome,
+			const NtInnovationBitset &p_spokesman_bitset) const;
 
 	/**
-	 * @brief destroy_species destroy a species
-	 * @param p_species
+	 * @brief kill all species with no organisms, in linear time and keeping
+	 * the order of the others
 	 */
-	void destroy_species(NtSpecies *p_species);
+	void kill_void_species();
 
 	/**
-	 * @brief destroy_species destroy a species and remove it from the pool
-	 * @param p_species
-	 * @return the next iterator
+	 * @brief create_species creates a new void species and returns its pointer
+	 * @return
 	 */
-	std::vector<NtSpecies *>::iterator destroy_species(
-			std::vector<NtSpecies *>::iterator p_species_iterator);
+	NtSpecies *create_species();
 
 	/**
 	 * @brief destroy_all_species is used to destroy all species
@@ -637,35 +775,22 @@ private:
 
 	/**
 	 * @brief create a new organism and add it to the pool, return nullptr
-	 * if the pool is already full
+	 * if the pool is already full. A free organism is reused if available
 	 * @return
 	 */
 	NtOrganism *create_organism();
 
 	/**
-	 * @brief destroy the organism and remove it from the organism pool
-	 * This version is slower
-	 * @param p_organism
-	 */
-	void destroy_organism(NtOrganism *p_organism);
-
-	/**
-	 * @brief destroy the organism and remove it from the organism pool
-	 * This version is faster
-	 * @param p_organism
-	 * @return the next iterator
-	 */
-	std::vector<NtOrganism *>::iterator destroy_organism(
-			std::vector<NtOrganism *>::iterator p_organism_iterator);
-
-	/**
-	 * @brief destroy_all_organisms is used to destroy all organisms
+	 * @brief destroy_all_organisms is used to destroy all organisms, the
+	 * free organisms included
 	 */
 	void destroy_all_organisms();
 
 	/**
 	 * @brief This function will kill all organisms marked for death inside the
-	 * population organisms
+	 * population organisms. They are removed from the population and the
+	 * species in linear time, keeping the order of the others, and kept in
+	 * the free organisms.
 	 */
 	void kill_organisms_marked_for_death();
 
@@ -676,25 +801,34 @@ private:
 	 */
 	void add_organism_to_species(NtOrganism *p_organism, NtSpecies *p_species);
 
-	/**
-	 * @brief remove_organism_from_species remove the organism from the assigned specie
-	 */
-	void remove_organism_from_species(NtOrganism *p_organism);
-
 	/**
 	 * @brief get_rand_champion returns the organism champion from a random species
 	 * except the one passed through parameter.
 	 *
 	 * @param p_except_species if null no exception
+	 * @param r_rand
 	 * @return
 	 */
-	NtOrganism *get_rand_champion(const NtSpecies *p_except_species) const;
+	NtOrganism *get_rand_champion(
+			const NtSpecies *p_except_species,
+			RandomPCG &r_rand) const;
+
+	/**
+	 * @brief reproduce makes all species reproduce at the same time, then
+	 * adds their children to the population in the species order.
+	 *
+	 * Each species uses its own random stream and innovation registry, and the
+	 * innovations are merged in the species order, so the result doesn't
+	 * depend on the threads count.
+	 */
+	void reproduce();
 
 private:
 	/**
 	 * @brief map_rand_gaussian returns the p_x plus a random number
 	 * The random number is choosen within a gaussian distribution
 	 * @param p_x
+	 * @param p_data the NtRandomStream
 	 * @return
 	 */
 	static real_t rand_gaussian(real_t p_x, void *p_data);
@@ -703,9 +837,50 @@ private:
 	 * @brief rand_cold_gaussian does the same thing of the rand_gaussian with
 	 * the exception that instead of add this one replace the value
 	 * @param p_x
+	 * @param p_data the NtRandomStream
 	 * @return
 	 */
 	static real_t rand_cold_gaussian(real_t p_x, void *p_data);
+
+	/**
+	 * @brief prepare_organism_network is the ThreadPool task that builds the
+	 * organism neural network
+	 * @param p_organism_i
+	 * @param p_data
+	 */
+	static void prepare_organism_network(uint32_t p_organism_i, void *p_data);
+
+	/**
+	 * @brief evaluate_organism is the ThreadPool task that calls the fitness
+	 * function
+	 * @param p_organism_i
+	 * @param p_data
+	 */
+	static void evaluate_organism(uint32_t p_organism_i, void *p_data);
+
+	/**
+	 * @brief reproduce_species is the ThreadPool task that makes a species
+	 * reproduce
+	 * @param p_species_i
+	 * @param p_data
+	 */
+	static void reproduce_species(uint32_t p_species_i, void *p_data);
+
+	/**
+	 * @brief make_spokesman_bitset is the ThreadPool task that builds the
+	 * bitset of a species spokesman
+	 * @param p_species_i
+	 * @param p_data
+	 */
+	static void make_spokesman_bitset(uint32_t p_species_i, void *p_data);
+
+	/**
+	 * @brief find_organism_species is the ThreadPool task that searches the
+	 * first compatible species of an organism
+	 * @param p_organism_i
+	 * @param p_data
+	 */
+	static void find_organism_species(uint32_t p_organism_i, void *p_data);
 };
 
 } // namespace brain
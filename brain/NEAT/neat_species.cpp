@@ -37,15 +37,6 @@ void brain::NtSpecies::add_organism(NtOrganism *p_organism) {
 	organisms.push_back(p_organism);
 }
 
-void brain::NtSpecies::remove_organism(const NtOrganism *p_organism) {
-	ERR_FAIL_COND(p_organism->get_species() != this);
-	auto it = std::find(organisms.begin(), organisms.end(), p_organism);
-	if (it != organisms.end())
-		organisms.erase(it);
-	if (champion == p_organism)
-		champion = nullptr;
-}
-
 uint32_t brain::NtSpecies::get_born_epoch() const {
 	return born_epoch;
 }
@@ -191,13 +182,15 @@ int brain::NtSpecies::compute_offspring(double &r_remaining) {
 	return offspring_count;
 }
 
-void brain::NtSpecies::reproduce(
-		std::vector<NtInnovation> &r_innovations) {
+void brain::NtSpecies::reproduce(NtOffspring &r_offspring) {
 
 	ERR_FAIL_COND(organisms.size() == 0);
 	ERR_FAIL_COND(champion_offspring_count > offspring_count);
 	ERR_FAIL_COND(!champion);
 
+	// The random numbers are taken only from the species stream
+	RandomPCG &rand = r_offspring.stream.rand;
+
 	// Mark all organisms as dead since they are from the previous generation
 	// But don't kill them now since they still need
 	for (auto it = organisms.begin(); it != organisms.end(); ++it) {
@@ -213,7 +206,7 @@ void brain::NtSpecies::reproduce(
 
 		is_champion_cloned = true;
 
-		NtOrganism *child = owner->create_organism();
+		NtOrganism *child = create_child(r_offspring);
 		champion->get_genome().duplicate_in(child->get_genome_mutable());
 
 		child->set_champion_clone(true);
@@ -233,20 +226,20 @@ void brain::NtSpecies::reproduce(
 
 		while (champion_offspring_count > 0) {
 
-			NtOrganism *child = owner->create_organism();
+			NtOrganism *child = create_child(r_offspring);
 
 			champion->get_genome().duplicate_in(child->get_genome_mutable());
 
 			if (is_champion_cloned || champion_offspring_count > 1) {
-				if (Math::randd() < 0.8) {
+				if (rand.randd() < 0.8) {
 
-					owner->statistics.reproduction_champion_mutate_weights++;
+					r_offspring.statistics.reproduction_champion_mutate_weights++;
 
 					// Happens more often
 					// Mutate link weights
 					child->get_genome_mutable().mutate_all_link_weights(
 							NtPopulation::rand_gaussian,
-							owner);
+							&r_offspring.stream);
 				} else {
 
 					// Happens sometimes
@@ -254,22 +247,22 @@ void brain::NtSpecies::reproduce(
 					const bool add_link_status =
 							child->get_genome_mutable().mutate_add_random_link(
 									owner->settings.genetic_mutate_add_link_recurrent_prob,
-									r_innovations,
-									owner->innovation_number);
+									r_offspring.innovations,
+									rand);
 
 					if (!add_link_status) {
 
-						owner->statistics.reproduction_champion_mutate_weights++;
+						r_offspring.statistics.reproduction_champion_mutate_weights++;
 
 						// Almost never happens
 						// Was not possible to add a link, so mutates
 						// the weights with completelly new weights
 						child->get_genome_mutable().mutate_all_link_weights(
 								NtPopulation::rand_cold_gaussian,
-								owner);
+								&r_offspring.stream);
 					} else {
 
-						owner->statistics.reproduction_champion_add_random_link++;
+						r_offspring.statistics.reproduction_champion_add_random_link++;
 					}
 				}
 
@@ -319,23 +312,22 @@ void brain::NtSpecies::reproduce(
 
 	while (offspring_count > 0) {
 
-		NtOrganism *child = owner->create_organism();
-		ERR_FAIL_COND(!child);
+		NtOrganism *child = create_child(r_offspring);
 
-		const int mom_index = static_cast<int>(Math::random(0, organisms_last_index) + 0.5);
+		const int mom_index = static_cast<int>(rand.random(0, organisms_last_index) + 0.5);
 		NtOrganism *mom = organisms[mom_index];
 
 		bool state = false;
 
-		if (Math::randd() < mating_prob && organisms_last_index > 0) {
+		if (rand.randd() < mating_prob && organisms_last_index > 0) {
 
 			// Mate
 
 			NtOrganism *dad = nullptr;
 
-			if (Math::randd() >= owner->settings.genetic_mate_inside_species_threshold) {
+			if (rand.randd() >= owner->settings.genetic_mate_inside_species_threshold) {
 				// Select the champion of a random species to be the dad
-				dad = owner->get_rand_champion(this);
+				dad = owner->get_rand_champion(this, rand);
 			}
 
 			if (!dad) {
@@ -344,11 +336,11 @@ void brain::NtSpecies::reproduce(
 				/// null
 
 				// Select the dad from the same species
-				const int dad_index = static_cast<int>(Math::random(0, organisms_last_index) + 0.5);
+				const int dad_index = static_cast<int>(rand.random(0, organisms_last_index) + 0.5);
 				dad = organisms[dad_index];
 			}
 
-			const real_t r(Math::randd());
+			const real_t r(rand.randd());
 			if (r < m_m_range) {
 
 				// Multipoint mating
@@ -357,10 +349,11 @@ void brain::NtSpecies::reproduce(
 						mom->get_personal_fitness(),
 						dad->get_genome(),
 						dad->get_personal_fitness(),
-						false);
+						false,
+						rand);
 
 				if (state)
-					owner->statistics.reproduction_mate_multipoint++;
+					r_offspring.statistics.reproduction_mate_multipoint++;
 
 			} else if (r < m_m_a_range) {
 
@@ -370,20 +363,22 @@ void brain::NtSpecies::reproduce(
 						mom->get_personal_fitness(),
 						dad->get_genome(),
 						dad->get_personal_fitness(),
-						true);
+						true,
+						rand);
 
 				if (state)
-					owner->statistics.reproduction_mate_multipoint_avg++;
+					r_offspring.statistics.reproduction_mate_multipoint_avg++;
 
 			} else {
 
 				// Singlepoint mating
 				state = child->get_genome_mutable().mate_singlepoint(
 						mom->get_genome(),
-						dad->get_genome());
+						dad->get_genome(),
+						rand);
 
 				if (state)
-					owner->statistics.reproduction_mate_singlepoint++;
+					r_offspring.statistics.reproduction_mate_singlepoint++;
 			}
 
 		} else {
@@ -392,51 +387,51 @@ void brain::NtSpecies::reproduce(
 
 			mom->get_genome().duplicate_in(child->get_genome_mutable());
 
-			const real_t r(Math::randd());
+			const real_t r(rand.randd());
 			if (r < m_a_l_range) {
 
 				// Mutate add link
 				state = child->get_genome_mutable().mutate_add_random_link(
 						owner->settings.genetic_mutate_add_link_recurrent_prob,
-						r_innovations,
-						owner->innovation_number);
+						r_offspring.innovations,
+						rand);
 
 				if (state)
-					owner->statistics.reproduction_mutate_add_random_link++;
+					r_offspring.statistics.reproduction_mutate_add_random_link++;
 
 			} else if (r < m_a_n_range) {
 
 				// Mutate add neuron
 				state = child->get_genome_mutable().mutate_add_random_neuron(
-						r_innovations,
-						owner->innovation_number);
+						r_offspring.innovations,
+						rand);
 
 				if (state)
-					owner->statistics.reproduction_mutate_add_random_neuron++;
+					r_offspring.statistics.reproduction_mutate_add_random_neuron++;
 
 			} else if (r < m_l_w_range) {
 
-				owner->statistics.reproduction_mutate_weights++;
+				r_offspring.statistics.reproduction_mutate_weights++;
 
 				// Mutate link weight
-				if (Math::randd() < owner->settings.genetic_mutate_link_weight_uniform_prob) {
+				if (rand.randd() < owner->settings.genetic_mutate_link_weight_uniform_prob) {
 
 					child->get_genome_mutable().mutate_all_link_weights(
 							NtPopulation::rand_gaussian,
-							owner);
+							&r_offspring.stream);
 				} else {
 
 					child->get_genome_mutable().mutate_all_link_weights(
 							NtPopulation::rand_cold_gaussian,
-							owner);
+							&r_offspring.stream);
 				}
 				state = true;
 			} else {
 
-				owner->statistics.reproduction_mutate_toggle_link_activation++;
+				r_offspring.statistics.reproduction_mutate_toggle_link_activation++;
 
 				// Mutate toggle link enabled
-				child->get_genome_mutable().mutate_random_link_toggle_activation();
+				child->get_genome_mutable().mutate_random_link_toggle_activation(rand);
 				state = true;
 			}
 		}
@@ -446,7 +441,7 @@ void brain::NtSpecies::reproduce(
 			// organism
 			child->get_genome_mutable().mutate_all_link_weights(
 					NtPopulation::rand_cold_gaussian,
-					owner);
+					&r_offspring.stream);
 		}
 
 		if (!child->get_genome().check_innovation_numbers())
@@ -460,18 +455,37 @@ void brain::NtSpecies::reproduce(
 	ERR_FAIL_COND(offspring_count != 0);
 }
 
-void brain::NtSpecies::kill_old_organisms() {
-	auto it = organisms.begin();
-	while (it != organisms.end()) {
-		if ((*it)->is_marked_for_death()) {
-			NtOrganism *o = *it;
-			it = organisms.erase(it);
+void brain::NtSpecies::kill_old_organisms(std::vector<NtOrganism *> &r_free_organisms) {
+
+	// Compacts the alive organisms in one pass
+	uint32_t alive_count(0);
+	for (uint32_t i(0); i < organisms.size(); ++i) {
+		NtOrganism *o = organisms[i];
+		if (o->is_marked_for_death()) {
 			o->set_species(nullptr);
-			delete o;
+			if (champion == o)
+				champion = nullptr;
+			r_free_organisms.push_back(o);
 		} else {
-			++it;
+			organisms[alive_count++] = o;
 		}
 	}
+	organisms.resize(alive_count);
+}
+
+brain::NtOrganism *brain::NtSpecies::create_child(NtOffspring &r_offspring) {
+
+	NtOrganism *child;
+	if (r_offspring.spare_organisms.size()) {
+		child = r_offspring.spare_organisms.back();
+		r_offspring.spare_organisms.pop_back();
+		child->reset();
+	} else {
+		child = new NtOrganism(owner);
+	}
+
+	r_offspring.children.push_back(child);
+	return child;
 }
 
 bool species_comparator(brain::NtSpecies *p_1, brain::NtSpecies *p_2) {
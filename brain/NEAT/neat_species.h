@@ -9,6 +9,7 @@ namespace brain {
 
 class NtPopulation;
 class NtOrganism;
+struct NtOffspring;
 
 /**
  * @brief The NtSpecie class represent a group of organisms that have the genomes
@@ -118,12 +119,6 @@ public:
 	 */
 	void add_organism(NtOrganism *p_organism);
 
-	/**
-	 * @brief remove_organism from this specie
-	 * @param p_organism
-	 */
-	void remove_organism(const NtOrganism *p_organism);
-
 	/**
 	 * @brief get_born_epoch returns the born epoch
 	 * @return
@@ -256,16 +251,30 @@ public:
 	 * This function will mark all its old organisms for death,
 	 * that can be deleted using kill_old_organisms.
 	 *
-	 * @param r_innovations Is the shared list of innovations that happens
-	 * in the other species during this epoch transition
+	 * It only reads the other species and the population, so all the
+	 * species can reproduce at the same time.
+	 *
+	 * @param r_offspring receives the new organisms, it provides the random
+	 * stream and the innovation registry of this species
 	 */
-	void reproduce(
-			std::vector<NtInnovation> &r_innovations);
+	void reproduce(NtOffspring &r_offspring);
 
 	/**
-	 * @brief kill all its old organisms
+	 * @brief kill all its organisms marked for death, in linear time and
+	 * keeping the order of the others
+	 * @param r_free_organisms receives the killed organisms, so they can be
+	 * reused
+	 */
+	void kill_old_organisms(std::vector<NtOrganism *> &r_free_organisms);
+
+private:
+	/**
+	 * @brief create_child takes a spare organism of the offspring, or
+	 * allocates a new one when they are finished, and adds it to the children
+	 * @param r_offspring
+	 * @return
 	 */
-	void kill_old_organisms();
+	NtOrganism *create_child(NtOffspring &r_offspring);
 };
 
 } // namespace brain
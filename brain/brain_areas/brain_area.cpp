@@ -21,6 +21,26 @@ activation_func brain::BrainArea::activation_derivatives[] = {
 	brain::Math::soft_max_derivative
 };
 
+brain::kernels::activation_kernel brain::BrainArea::activation_kernels[] = {
+	brain::kernels::sigmoid,
+	brain::kernels::relu,
+	brain::kernels::leaky_relu,
+	brain::kernels::tanh,
+	brain::kernels::linear,
+	brain::kernels::binary_step,
+	brain::kernels::softmax
+};
+
+brain::kernels::activation_kernel brain::BrainArea::derivative_kernels[] = {
+	brain::kernels::sigmoid_derivative,
+	brain::kernels::relu_derivative,
+	brain::kernels::leaky_relu_derivative,
+	brain::kernels::tanh_derivative,
+	brain::kernels::linear_derivative,
+	brain::kernels::binary_step_derivative,
+	brain::kernels::softmax_derivative
+};
+
 brain::BrainArea::BrainArea(BrainAreaType p_type) :
 		type(p_type) {
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "brain/math/activation_kernels.h"
 #include "brain/math/matrix.h"
 #include <vector>
 
@@ -55,6 +56,19 @@ public:
 	 */
 	static activation_func activation_derivatives[];
 
+	/**
+	 * @brief activation_kernels is a vector that holds the kernels that
+	 * activate an entire buffer at once, ordered by Activation ID
+	 */
+	static kernels::activation_kernel activation_kernels[];
+
+	/**
+	 * @brief derivative_kernels is a vector that holds the kernels that
+	 * compute the derivatives of an entire buffer at once, ordered by
+	 * Activation ID
+	 */
+	static kernels::activation_kernel derivative_kernels[];
+
 private:
 	/**
 	 * @brief type
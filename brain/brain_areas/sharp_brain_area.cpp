@@ -1,148 +1,72 @@
 #include "sharp_brain_area.h"
 
 #include "brain/NEAT/neat_organism.h"
+#include "brain/brain_areas/sharp_model.h"
 #include "brain/error_macros.h"
 #include "brain/math/math_funcs.h"
+#include "brain/math/matrix_kernels.h"
+#include "brain/thread_pool.h"
 #include <algorithm>
-
-void brain::Neuron::force_set_value(real_t p_val, uint32_t p_execution_id) const {
-	execution_id = p_execution_id;
-	cached_value = p_val;
+#include <utility>
+
+/**
+ * @brief The BufferLink struct is the layout of a link inside the buffer.
+ * The first field is not used, it's kept so the saved buffers remain
+ * compatible.
+ */
+struct BufferLink {
+	void *unused;
+	brain::NeuronId neuron_id;
+	real_t weight;
+	bool is_recurrent;
+};
+
+void brain::SharpState::reset() {
+	std::fill(values.begin(), values.end(), 0.f);
 }
 
-real_t brain::Neuron::get_value(uint32_t p_execution_id) const {
-	if (execution_id != p_execution_id) {
-		real_t value = 0.f;
-		for (auto it = parents.begin(); it != parents.end(); ++it) {
-			if (it->is_recurrent)
-				value += it->neuron->get_recurrent(p_execution_id) * it->weight;
-			else
-				value += it->neuron->get_value(p_execution_id) * it->weight;
-		}
-
-		recurrent = cached_value;
-
-		if (activation == brain::BrainArea::ACTIVATION_SOFTMAX)
-			// Softmax activation is performed out of this function and works only
-			// for the output neurons
-			cached_value = value;
-		else
-			cached_value = brain::BrainArea::activation_functions[activation](value);
-
-		execution_id = p_execution_id;
-	}
-	return cached_value;
-}
-
-real_t brain::Neuron::get_recurrent(uint32_t p_execution_id) const {
-	return execution_id == p_execution_id ? recurrent : cached_value;
-}
-
-size_t brain::Neuron::get_byte_size() const {
-
-	return sizeof(brain::BrainArea::Activation) + // Activation
-		   sizeof(NeuronId) + // Neuron id
-		   sizeof(uint32_t) + // Parent count
-		   sizeof(Link) * parents.size(); // The space required to store a link
+void brain::SharpState::snapshot(std::vector<real_t> &r_snapshot) const {
+	r_snapshot = values;
 }
 
-void brain::Neuron::from_byte(const uint8_t *p_buffer, int p_size_of_real) {
-
-	// Not yet supported for this class load the Link with a different real size (precision)
-	ERR_FAIL_COND(sizeof(real_t) != p_size_of_real);
-
-	cached_value = 0;
-	execution_id = 0;
-	recurrent = 0;
-
-	activation = *(brain::BrainArea::Activation *)p_buffer;
-
-	p_buffer += sizeof(brain::BrainArea::Activation);
-	id = *(NeuronId *)p_buffer;
-
-	p_buffer += sizeof(NeuronId);
-	parents.resize(*(uint32_t *)p_buffer);
-
-	p_buffer += sizeof(uint32_t);
-	std::copy(
-			(Link *)p_buffer,
-			((Link *)p_buffer) + parents.size(),
-			parents.data());
+void brain::SharpState::restore(const std::vector<real_t> &p_snapshot) {
+	values = p_snapshot;
 }
 
-void brain::Neuron::to_byte(uint8_t *p_buffer) const {
-
-	*(brain::BrainArea::Activation *)p_buffer = activation;
-
-	p_buffer += sizeof(brain::BrainArea::Activation);
-	*(NeuronId *)p_buffer = id;
-
-	p_buffer += sizeof(NeuronId);
-	*(uint32_t *)p_buffer = parents.size();
-
-	p_buffer += sizeof(uint32_t);
-	std::copy(
-			parents.begin(),
-			parents.end(),
-			(Link *)p_buffer);
-}
-
-brain::Neuron::Neuron(NeuronId p_id) :
-		id(p_id),
-		cached_value(0),
-		recurrent(0),
-		execution_id(0),
-		activation(BrainArea::ACTIVATION_SIGMOID) {
-}
-
-void brain::Neuron::prepare_internal_memory(SharpBrainArea *p_owner) {
-	for (auto it = parents.begin(); it != parents.end(); ++it) {
-		it->neuron = &*(p_owner->neurons.begin() + it->neuron_id);
-	}
-}
-
-bool brain::Neuron::has_parent(NeuronId p_neuron_id) const {
-	for (auto it = parents.begin(); it != parents.end(); ++it) {
-		if (it->neuron_id == p_neuron_id)
-			return true;
-	}
-	return false;
-}
+brain::SharpBrainArea::SharpBrainArea() :
+		brain::BrainArea(brain::BRAIN_AREA_TYPE_SHARP),
+		bulk_construction(false),
+		ready(false),
+		plan_simplification(true) {
 
-uint32_t brain::Neuron::get_parent_count() const {
-	return parents.size();
+	parent_offsets.push_back(0);
 }
 
-void brain::Neuron::add_parent(NeuronId p_neuron_id, real_t p_weight, bool p_recurrent) {
-
-	parents.push_back(Link(nullptr, p_neuron_id, p_weight, p_recurrent));
+brain::SharpBrainArea::SharpBrainArea(const SharpBrainArea &p_brain_area) :
+		brain::BrainArea(brain::BRAIN_AREA_TYPE_SHARP),
+		bulk_construction(false),
+		ready(false),
+		plan_simplification(true) {
+	*this = p_brain_area;
 }
 
-void brain::Neuron::set_weight(uint32_t p_parent_index, real_t p_weight) {
-	ERR_FAIL_INDEX(p_parent_index, parents.size());
-
-	parents[p_parent_index].weight = p_weight;
-}
+void brain::SharpBrainArea::operator=(const SharpBrainArea &p_brain_area) {
 
-brain::SharpBrainArea::SharpBrainArea() :
-		brain::BrainArea(brain::BRAIN_AREA_TYPE_SHARP),
-		execution_id(0),
-		ready(false) {}
+	ready = p_brain_area.ready.load();
 
-void brain::SharpBrainArea::operator=(const SharpBrainArea &p_brain_area) {
+	neuron_activations = p_brain_area.neuron_activations;
+	neuron_roles = p_brain_area.neuron_roles;
+	parent_offsets = p_brain_area.parent_offsets;
+	link_parents = p_brain_area.link_parents;
+	link_weights = p_brain_area.link_weights;
+	link_recurrents = p_brain_area.link_recurrents;
 
-	execution_id = p_brain_area.execution_id;
-	ready = p_brain_area.ready;
+	bulk_construction = p_brain_area.bulk_construction;
+	pending_links = p_brain_area.pending_links;
 
-	neurons.resize(p_brain_area.neurons.size());
 	inputs.resize(p_brain_area.inputs.size());
 	outputs.resize(p_brain_area.outputs.size());
 
-	std::copy(
-			p_brain_area.neurons.begin(),
-			p_brain_area.neurons.end(),
-			neurons.begin());
-
 	std::copy(
 			p_brain_area.inputs.begin(),
 			p_brain_area.inputs.end(),
@@ -152,70 +76,83 @@ void brain::SharpBrainArea::operator=(const SharpBrainArea &p_brain_area) {
 			p_brain_area.outputs.begin(),
 			p_brain_area.outputs.end(),
 			outputs.begin());
+
+	plan_neurons = p_brain_area.plan_neurons;
+	plan_level_offsets = p_brain_area.plan_level_offsets;
+	plan_activations = p_brain_area.plan_activations;
+	plan_link_offsets = p_brain_area.plan_link_offsets;
+	plan_link_sources = p_brain_area.plan_link_sources;
+	plan_link_weights = p_brain_area.plan_link_weights;
+	plan_recurrent_neurons = p_brain_area.plan_recurrent_neurons;
+	plan_constant_neurons = p_brain_area.plan_constant_neurons;
+	plan_constant_values = p_brain_area.plan_constant_values;
+	plan_all_neurons = p_brain_area.plan_all_neurons;
+	plan_simplification = p_brain_area.plan_simplification;
+	state = p_brain_area.state;
 }
 
 brain::NeuronId brain::SharpBrainArea::add_neuron() {
-	const NeuronId id(neurons.size());
-	neurons.push_back(Neuron(id));
+	const NeuronId id(neuron_activations.size());
+	neuron_activations.push_back(ACTIVATION_SIGMOID);
+	neuron_roles.push_back(NEURON_ROLE_HIDDEN);
+	parent_offsets.push_back(parent_offsets.back());
 	ready = false;
 	return id;
 }
 
 int brain::SharpBrainArea::get_neuron_count() const {
-	return neurons.size();
+	return neuron_activations.size();
 }
 
 bool brain::SharpBrainArea::is_neuron_input(NeuronId p_neuron_id) const {
-	ERR_FAIL_INDEX_V(p_neuron_id, neurons.size(), false);
-	for (auto it = inputs.begin(); it != inputs.end(); ++it) {
-		if (*it == p_neuron_id)
-			return true;
-	}
-	return false;
+	ERR_FAIL_INDEX_V(p_neuron_id, neuron_activations.size(), false);
+	return NEURON_ROLE_INPUT == neuron_roles[p_neuron_id];
 }
 
 void brain::SharpBrainArea::set_neuron_as_input(NeuronId p_neuron_id) {
-	ERR_FAIL_INDEX(p_neuron_id, neurons.size());
+	ERR_FAIL_INDEX(p_neuron_id, neuron_activations.size());
 	ERR_FAIL_COND(is_neuron_input(p_neuron_id));
 	ERR_FAIL_COND(is_neuron_output(p_neuron_id));
 	inputs.push_back(p_neuron_id);
+	neuron_roles[p_neuron_id] = NEURON_ROLE_INPUT;
 	ready = false;
 }
 
 bool brain::SharpBrainArea::is_neuron_output(NeuronId p_neuron_id) const {
-	ERR_FAIL_INDEX_V(p_neuron_id, neurons.size(), false);
-	for (auto it = outputs.begin(); it != outputs.end(); ++it) {
-		if (*it == p_neuron_id)
-			return true;
-	}
-	return false;
+	ERR_FAIL_INDEX_V(p_neuron_id, neuron_activations.size(), false);
+	return NEURON_ROLE_OUTPUT == neuron_roles[p_neuron_id];
 }
 
 uint32_t brain::SharpBrainArea::get_neuron_parent_count(NeuronId p_neuron_id) const {
-	ERR_FAIL_INDEX_V(p_neuron_id, neurons.size(), 0);
-	return neurons[p_neuron_id].parents.size();
+	ERR_FAIL_INDEX_V(p_neuron_id, neuron_activations.size(), 0);
+	sync_links();
+	return parent_offsets[p_neuron_id + 1] - parent_offsets[p_neuron_id];
 }
 
 brain::NeuronId brain::SharpBrainArea::get_neuron_parent_id(NeuronId p_neuron_id, uint32_t p_link_id) const {
-	ERR_FAIL_INDEX_V(p_neuron_id, neurons.size(), -1);
-	return neurons[p_neuron_id].parents[p_link_id].neuron_id;
+	ERR_FAIL_INDEX_V(p_neuron_id, neuron_activations.size(), -1);
+	ERR_FAIL_INDEX_V(p_link_id, get_neuron_parent_count(p_neuron_id), -1);
+	return link_parents[parent_offsets[p_neuron_id] + p_link_id];
 }
 
 bool brain::SharpBrainArea::get_neuron_parent_is_recurrent(NeuronId p_neuron_id, uint32_t p_link_id) const {
-	ERR_FAIL_INDEX_V(p_neuron_id, neurons.size(), false);
-	return neurons[p_neuron_id].parents[p_link_id].is_recurrent;
+	ERR_FAIL_INDEX_V(p_neuron_id, neuron_activations.size(), false);
+	ERR_FAIL_INDEX_V(p_link_id, get_neuron_parent_count(p_neuron_id), false);
+	return link_recurrents[parent_offsets[p_neuron_id] + p_link_id];
 }
 
 real_t brain::SharpBrainArea::get_neuron_parent_weight(NeuronId p_neuron_id, uint32_t p_link_id) const {
-	ERR_FAIL_INDEX_V(p_neuron_id, neurons.size(), 0);
-	return neurons[p_neuron_id].parents[p_link_id].weight;
+	ERR_FAIL_INDEX_V(p_neuron_id, neuron_activations.size(), 0);
+	ERR_FAIL_INDEX_V(p_link_id, get_neuron_parent_count(p_neuron_id), 0);
+	return link_weights[parent_offsets[p_neuron_id] + p_link_id];
 }
 
 void brain::SharpBrainArea::set_neuron_as_output(NeuronId p_neuron_id) {
-	ERR_FAIL_INDEX(p_neuron_id, neurons.size());
+	ERR_FAIL_INDEX(p_neuron_id, neuron_activations.size());
 	ERR_FAIL_COND(is_neuron_input(p_neuron_id));
 	ERR_FAIL_COND(is_neuron_output(p_neuron_id));
 	outputs.push_back(p_neuron_id);
+	neuron_roles[p_neuron_id] = NEURON_ROLE_OUTPUT;
 	ready = false;
 }
 
@@ -223,15 +160,16 @@ void brain::SharpBrainArea::set_neuron_activation(
 		NeuronId p_neuron_id,
 		Activation p_activation) {
 
-	ERR_FAIL_INDEX(p_neuron_id, neurons.size());
-	neurons[p_neuron_id].activation = p_activation;
+	ERR_FAIL_INDEX(p_neuron_id, neuron_activations.size());
+	neuron_activations[p_neuron_id] = p_activation;
+	ready = false;
 }
 
 brain::BrainArea::Activation brain::SharpBrainArea::get_neuron_activation(
 		NeuronId p_neuron_id) const {
 
-	ERR_FAIL_INDEX_V(p_neuron_id, neurons.size(), ACTIVATION_MAX);
-	return neurons[p_neuron_id].activation;
+	ERR_FAIL_INDEX_V(p_neuron_id, neuron_activations.size(), ACTIVATION_MAX);
+	return neuron_activations[p_neuron_id];
 }
 
 void brain::SharpBrainArea::add_link(
@@ -240,56 +178,146 @@ void brain::SharpBrainArea::add_link(
 		real_t p_weight,
 		bool p_recurrent) {
 
-	ERR_FAIL_INDEX(p_neuron_parent_id, neurons.size());
-	ERR_FAIL_INDEX(p_neuron_child_id, neurons.size());
-
-	Neuron *child = &*(neurons.begin() + p_neuron_child_id);
+	ERR_FAIL_INDEX(p_neuron_parent_id, neuron_activations.size());
+	ERR_FAIL_INDEX(p_neuron_child_id, neuron_activations.size());
 
-	ERR_FAIL_COND(child->has_parent(p_neuron_parent_id));
+	// The duplicated links are discarded by place_pending_links
 	ERR_FAIL_COND(!p_recurrent && p_neuron_parent_id == p_neuron_child_id);
 
-	child->add_parent(
-			p_neuron_parent_id,
+	pending_links.push_back({ p_neuron_parent_id,
+			p_neuron_child_id,
 			p_weight,
-			p_recurrent);
+			p_recurrent });
+	ready = false;
+}
+
+void brain::SharpBrainArea::begin_bulk_construction() {
+	ERR_FAIL_COND(bulk_construction);
+	bulk_construction = true;
+}
+
+bool brain::SharpBrainArea::end_bulk_construction() {
+	ERR_FAIL_COND_V(!bulk_construction, false);
+	bulk_construction = false;
+
+	place_pending_links();
 
+	// Validate the network once
 	ready = false;
+	return is_ready();
+}
+
+void brain::SharpBrainArea::place_pending_links() const {
+	if (bulk_construction || pending_links.empty())
+		return;
+
+	const uint32_t neuron_count = neuron_activations.size();
+
+	/// Step 1. Count the links of each child, the pending links go after
+	/// the ones already added
+	std::vector<uint32_t> offsets(neuron_count + 1, 0);
+	for (uint32_t n(0); n < neuron_count; ++n) {
+		offsets[n + 1] = parent_offsets[n + 1] - parent_offsets[n];
+	}
+	for (auto it = pending_links.begin(); it != pending_links.end(); ++it) {
+		++offsets[it->child_id + 1];
+	}
+	for (uint32_t n(0); n < neuron_count; ++n) {
+		offsets[n + 1] += offsets[n];
+	}
+
+	/// Step 2. Place the links, keeping the order they were added
+	std::vector<PendingLink> links(offsets.back());
+	std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+
+	for (uint32_t n(0); n < neuron_count; ++n) {
+		for (uint32_t l(parent_offsets[n]); l < parent_offsets[n + 1]; ++l) {
+			links[cursors[n]++] = { link_parents[l], n, link_weights[l], bool(link_recurrents[l]) };
+		}
+	}
+	for (auto it = pending_links.begin(); it != pending_links.end(); ++it) {
+		links[cursors[it->child_id]++] = *it;
+	}
+
+	pending_links.clear();
+
+	/// Step 3. Rebuild the flat arrays, skipping the duplicated links.
+	/// `last_child` tells the last child of each parent.
+	std::vector<uint32_t> last_child(neuron_count, UINT32_MAX);
+
+	link_parents.clear();
+	link_weights.clear();
+	link_recurrents.clear();
+	link_parents.reserve(links.size());
+	link_weights.reserve(links.size());
+	link_recurrents.reserve(links.size());
+
+	for (uint32_t n(0); n < neuron_count; ++n) {
+		parent_offsets[n] = link_parents.size();
+
+		for (uint32_t l(offsets[n]); l < offsets[n + 1]; ++l) {
+			ERR_CONTINUE(last_child[links[l].parent_id] == n);
+			last_child[links[l].parent_id] = n;
+
+			link_parents.push_back(links[l].parent_id);
+			link_weights.push_back(links[l].weight);
+			link_recurrents.push_back(links[l].recurrent);
+		}
+	}
+	parent_offsets[neuron_count] = link_parents.size();
+}
+
+void brain::SharpBrainArea::sync_links() const {
+	// A ready network has no pending links
+	if (ready)
+		return;
+
+	std::lock_guard<std::mutex> lock(ready_mutex);
+	place_pending_links();
 }
 
 void brain::SharpBrainArea::clear() {
 	inputs.clear();
 	outputs.clear();
-	neurons.clear();
+	neuron_activations.clear();
+	neuron_roles.clear();
+	pending_links.clear();
+	bulk_construction = false;
+	parent_offsets.clear();
+	parent_offsets.push_back(0);
+	link_parents.clear();
+	link_weights.clear();
+	link_recurrents.clear();
 	ready = false;
 }
 
 void brain::SharpBrainArea::randomize_weights(real_t p_range) {
 	// If not ready check it
 	if (!ready) {
-		SharpBrainArea *mutable_this = const_cast<SharpBrainArea *>(this);
-		mutable_this->check_ready();
+		check_ready();
 		ERR_FAIL_COND(!ready);
 	}
 
-	for (int i(outputs.size() - 1); 0 <= i; ++i) {
-
-		randomize_parents_weight(&neurons[outputs[i]], p_range);
+	for (auto it = link_weights.begin(); it != link_weights.end(); ++it) {
+		*it = brain::Math::random(-p_range, p_range);
 	}
+
+	// The plan holds a copy of the weights
+	compile_plan();
 }
 
 void brain::SharpBrainArea::fill_weights(real_t p_weight) {
 
 	// If not ready check it
 	if (!ready) {
-		SharpBrainArea *mutable_this = const_cast<SharpBrainArea *>(this);
-		mutable_this->check_ready();
+		check_ready();
 		ERR_FAIL_COND(!ready);
 	}
 
-	for (int i(outputs.size() - 1); 0 <= i; ++i) {
+	std::fill(link_weights.begin(), link_weights.end(), p_weight);
 
-		set_parents_weight(&neurons[outputs[i]], p_weight);
-	}
+	// The plan holds a copy of the weights
+	compile_plan();
 }
 
 uint32_t brain::SharpBrainArea::get_input_layer_size() const {
@@ -304,51 +332,478 @@ bool brain::SharpBrainArea::guess(
 		const Matrix &p_input,
 		Matrix &r_guess) const {
 
+	return guess(p_input, r_guess, state);
+}
+
+bool brain::SharpBrainArea::guess(
+		const Matrix &p_input,
+		Matrix &r_guess,
+		SharpState &r_state,
+		ThreadPool *p_pool) const {
+
 	const int output_size = outputs.size();
 	ERR_FAIL_COND_V(!output_size, false);
 
 	r_guess.resize(output_size, 1);
 
-	// If not ready check it
-	if (!ready) {
-		SharpBrainArea *mutable_this = const_cast<SharpBrainArea *>(this);
-		mutable_this->check_ready();
-		ERR_FAIL_COND_V(!ready, false);
-	}
+	ERR_FAIL_COND_V(!is_ready(), false);
 
 	ERR_FAIL_COND_V(p_input.get_row_count() != inputs.size(), false);
 	ERR_FAIL_COND_V(p_input.get_column_count() != 1, false);
 
-	++execution_id;
+	const uint32_t neuron_count = neuron_activations.size();
+
+	// The state is new or it belongs to an old structure
+	if (r_state.values.size() != neuron_count + plan_recurrent_neurons.size())
+		r_state.values.assign(neuron_count + plan_recurrent_neurons.size(), 0.f);
+
+	real_t *v = r_state.values.data();
+
+	/// Step 1. Save the values read by the recurrent links, before they
+	/// get overwritten by this guess
+	for (uint32_t i(0); i < plan_recurrent_neurons.size(); ++i) {
+		v[neuron_count + i] = v[plan_recurrent_neurons[i]];
+	}
+
+	/// Step 2. Set inputs and constants
+	for (uint32_t i(0); i < inputs.size(); ++i) {
+		v[inputs[i]] = p_input.get(i, 0);
+	}
 
-	// set inputs
-	for (int i(inputs.size() - 1); 0 <= i; --i) {
-		neurons[inputs[i]].force_set_value(p_input.get(i, 0), execution_id);
+	for (uint32_t i(0); i < plan_constant_neurons.size(); ++i) {
+		v[plan_constant_neurons[i]] = plan_constant_values[i];
 	}
 
-	// Get outputs
+	/// Step 3. Compute the neurons level by level
+	compute_levels(v, 1, p_pool);
+
+	/// Step 4. Get outputs
 	for (int i(0); i < output_size; ++i) {
-		const real_t val = neurons[outputs[i]].get_value(execution_id);
-		r_guess.set(i, 0, val);
+		r_guess.set(i, 0, v[outputs[i]]);
 	}
 
 	// Special case for softmax activation function
-	if (ACTIVATION_SOFTMAX == neurons[outputs[0]].activation) {
+	if (ACTIVATION_SOFTMAX == neuron_activations[outputs[0]]) {
 
 		const real_t sum_exp(r_guess.exp_summation());
 		for (int i(0); i < output_size; ++i) {
 
-			const real_t v = brain::Math::soft_max_fast(
-					neurons[outputs[i]].get_value(execution_id),
+			const real_t val = brain::Math::soft_max_fast(
+					v[outputs[i]],
 					sum_exp);
-			neurons[outputs[i]].force_set_value(v, execution_id);
-			r_guess.set(i, 0, v);
+			v[outputs[i]] = val;
+			r_guess.set(i, 0, val);
 		}
 	}
 
 	return true;
 }
 
+bool brain::SharpBrainArea::guess_batch(
+		const Matrix &p_inputs,
+		Matrix &r_outputs,
+		SharpState *r_state,
+		ThreadPool *p_pool) const {
+
+	const uint32_t output_size = outputs.size();
+	ERR_FAIL_COND_V(!output_size, false);
+
+	ERR_FAIL_COND_V(!is_ready(), false);
+
+	ERR_FAIL_COND_V(p_inputs.get_row_count() != inputs.size(), false);
+
+	const uint32_t lanes = p_inputs.get_column_count();
+	ERR_FAIL_COND_V(!lanes, false);
+
+	r_outputs.resize(output_size, lanes);
+
+	const uint32_t neuron_count = neuron_activations.size();
+	const uint32_t state_size = (neuron_count + plan_recurrent_neurons.size()) * lanes;
+
+	if (!r_state) {
+		// Without a state the samples start from an empty recurrent memory
+		thread_local SharpState batch_state;
+		batch_state.values.assign(state_size, 0.f);
+		r_state = &batch_state;
+
+	} else if (r_state->values.size() != state_size) {
+		// The state is new or it belongs to an old structure
+		r_state->values.assign(state_size, 0.f);
+	}
+
+	real_t *v = r_state->values.data();
+
+	/// Step 1. Save the values read by the recurrent links
+	for (uint32_t i(0); i < plan_recurrent_neurons.size(); ++i) {
+		const real_t *src = v + plan_recurrent_neurons[i] * lanes;
+		std::copy(src, src + lanes, v + (neuron_count + i) * lanes);
+	}
+
+	/// Step 2. Set inputs and constants, the matrix is row major so each
+	/// input row is already the values of a neuron
+	for (uint32_t i(0); i < inputs.size(); ++i) {
+		const real_t *src = p_inputs.get_matrix() + i * lanes;
+		std::copy(src, src + lanes, v + inputs[i] * lanes);
+	}
+
+	for (uint32_t i(0); i < plan_constant_neurons.size(); ++i) {
+		real_t *dst = v + plan_constant_neurons[i] * lanes;
+		std::fill(dst, dst + lanes, plan_constant_values[i]);
+	}
+
+	/// Step 3. Compute the neurons level by level, all the samples at once
+	compute_levels(v, lanes, p_pool);
+
+	/// Step 4. Special case for softmax activation function, it's computed
+	/// per sample
+	if (ACTIVATION_SOFTMAX == neuron_activations[outputs[0]]) {
+
+		for (uint32_t j(0); j < lanes; ++j) {
+
+			real_t sum_exp(0);
+			for (uint32_t i(0); i < output_size; ++i) {
+				sum_exp += brain::Math::exp(v[outputs[i] * lanes + j]);
+			}
+
+			for (uint32_t i(0); i < output_size; ++i) {
+				real_t &val = v[outputs[i] * lanes + j];
+				val = brain::Math::soft_max_fast(val, sum_exp);
+			}
+		}
+	}
+
+	/// Step 5. Get outputs
+	for (uint32_t i(0); i < output_size; ++i) {
+		r_outputs.unsafe_set_row(i, v + outputs[i] * lanes);
+	}
+
+	return true;
+}
+
+/// The levels with less work (links x lanes) than this are not split
+/// between threads, the synchronization would cost more
+static const uint32_t PARALLEL_LEVEL_MIN_WORK = 16384;
+
+/**
+ * @brief The LevelTask struct is the data of a level computed by the
+ * ThreadPool
+ */
+struct LevelTask {
+	const brain::SharpBrainArea *area;
+	real_t *values;
+	uint32_t lanes;
+	uint32_t begin;
+	uint32_t end;
+	uint32_t chunk_count;
+};
+
+void brain::SharpBrainArea::compute_neurons(
+		real_t *r_values,
+		uint32_t p_lanes,
+		uint32_t p_begin,
+		uint32_t p_end) const {
+
+	const uint32_t *offsets = plan_link_offsets.data();
+	const uint32_t *sources = plan_link_sources.data();
+	const real_t *weights = plan_link_weights.data();
+
+	if (p_lanes == 1) {
+
+		for (uint32_t n(p_begin); n < p_end; ++n) {
+			real_t value(0.f);
+			for (uint32_t l(offsets[n]); l < offsets[n + 1]; ++l) {
+				value += r_values[sources[l]] * weights[l];
+			}
+			r_values[plan_neurons[n]] = plan_activations[n](value);
+		}
+
+	} else {
+
+		for (uint32_t n(p_begin); n < p_end; ++n) {
+			real_t *neuron_values = r_values + plan_neurons[n] * p_lanes;
+
+			kernels::weighted_sum(
+					r_values,
+					sources + offsets[n],
+					weights + offsets[n],
+					offsets[n + 1] - offsets[n],
+					neuron_values,
+					p_lanes);
+
+			// Softmax activation is performed by the guess functions
+			const Activation activation = neuron_activations[plan_neurons[n]];
+			if (ACTIVATION_SOFTMAX != activation)
+				activation_kernels[activation](neuron_values, neuron_values, p_lanes);
+		}
+	}
+}
+
+void brain::SharpBrainArea::compute_levels(
+		real_t *r_values,
+		uint32_t p_lanes,
+		ThreadPool *p_pool) const {
+
+	const uint32_t level_count = plan_level_offsets.size() - 1;
+
+	for (uint32_t l(0); l < level_count; ++l) {
+		const uint32_t begin = plan_level_offsets[l];
+		const uint32_t end = plan_level_offsets[l + 1];
+
+		const uint64_t work = uint64_t(plan_link_offsets[end] - plan_link_offsets[begin]) * p_lanes;
+
+		if (!p_pool || p_pool->get_thread_count() == 1 || work < PARALLEL_LEVEL_MIN_WORK) {
+			compute_neurons(r_values, p_lanes, begin, end);
+			continue;
+		}
+
+		LevelTask task;
+		task.area = this;
+		task.values = r_values;
+		task.lanes = p_lanes;
+		task.begin = begin;
+		task.end = end;
+		task.chunk_count = MIN(p_pool->get_thread_count(), end - begin);
+
+		p_pool->parallel_for(task.chunk_count, compute_level_chunk, &task);
+	}
+}
+
+void brain::SharpBrainArea::compute_level_chunk(uint32_t p_chunk, void *p_data) {
+	const LevelTask *task = static_cast<const LevelTask *>(p_data);
+
+	uint32_t begin, end;
+	ThreadPool::get_chunk(
+			p_chunk,
+			task->chunk_count,
+			task->end - task->begin,
+			begin,
+			end);
+
+	task->area->compute_neurons(
+			task->values,
+			task->lanes,
+			task->begin + begin,
+			task->begin + end);
+}
+
+/**
+ * @brief The LearningTrace struct holds the buffers of a learning window,
+ * each row has a value per neuron.
+ */
+struct LearningTrace {
+	/// The values of each step, the row 0 holds the values before the window
+	std::vector<real_t> values;
+	/// The neurons input signals of each step
+	std::vector<real_t> sums;
+	/// The error of each step outputs
+	std::vector<real_t> errors;
+	/// The derivative of the error by the neuron values, the row 0 is the
+	/// error that goes before the window, so it's truncated
+	std::vector<real_t> deltas;
+	std::vector<uint8_t> computed;
+	std::vector<real_t> gradients;
+};
+
+real_t brain::SharpBrainArea::learn(
+		const Matrix &p_inputs,
+		const Matrix &p_expected,
+		real_t p_learn_rate,
+		uint32_t p_truncation,
+		bool p_update_weights,
+		std::vector<real_t> *r_gradients) {
+
+	ERR_FAIL_COND_V(!is_ready(), 10000);
+	ERR_FAIL_COND_V(p_inputs.get_row_count() != inputs.size(), 10000);
+	ERR_FAIL_COND_V(p_expected.get_row_count() != outputs.size(), 10000);
+	ERR_FAIL_COND_V(p_inputs.get_column_count() != p_expected.get_column_count(), 10000);
+	ERR_FAIL_COND_V(!p_inputs.get_column_count(), 10000);
+
+	const uint32_t neuron_count = neuron_activations.size();
+	const uint32_t output_size = outputs.size();
+	const uint32_t step_count = p_inputs.get_column_count();
+	const uint32_t window = p_truncation ? MIN(p_truncation, step_count) : step_count;
+	const bool softmax = ACTIVATION_SOFTMAX == neuron_activations[outputs[0]];
+
+	// Reused between the calls, so the learning doesn't allocate
+	static thread_local LearningTrace trace;
+
+	// The recurrent links of the neurons never computed always read zero
+	trace.computed.assign(neuron_count, false);
+	for (auto it = plan_all_neurons.begin(); it != plan_all_neurons.end(); ++it) {
+		trace.computed[*it] = true;
+	}
+
+	if (r_gradients)
+		r_gradients->assign(link_parents.size(), 0.f);
+
+	if (state.values.size() != neuron_count + plan_recurrent_neurons.size())
+		state.values.assign(neuron_count + plan_recurrent_neurons.size(), 0.f);
+
+	real_t total_error(0);
+
+	for (uint32_t window_begin(0); window_begin < step_count; window_begin += window) {
+		const uint32_t steps = MIN(window, step_count - window_begin);
+
+		trace.values.resize((steps + 1) * neuron_count);
+		trace.sums.resize(steps * neuron_count);
+		trace.errors.resize(steps * output_size);
+
+		std::copy(
+				state.values.begin(),
+				state.values.begin() + neuron_count,
+				trace.values.begin());
+
+		/// Step 1. Forward, as the guess does but over all the links
+		for (uint32_t t(0); t < steps; ++t) {
+			const real_t *prev = trace.values.data() + t * neuron_count;
+			real_t *cur = trace.values.data() + (t + 1) * neuron_count;
+			real_t *sums = trace.sums.data() + t * neuron_count;
+
+			// The neurons not computed keep their value
+			std::copy(prev, prev + neuron_count, cur);
+
+			for (uint32_t i(0); i < inputs.size(); ++i) {
+				cur[inputs[i]] = p_inputs.get(i, window_begin + t);
+			}
+
+			for (auto it = plan_all_neurons.begin(); it != plan_all_neurons.end(); ++it) {
+				real_t sum(0.f);
+				for (uint32_t l(parent_offsets[*it]); l < parent_offsets[*it + 1]; ++l) {
+					const NeuronId parent_id = link_parents[l];
+					if (!link_recurrents[l]) {
+						sum += cur[parent_id] * link_weights[l];
+					} else if (trace.computed[parent_id]) {
+						sum += prev[parent_id] * link_weights[l];
+					}
+				}
+
+				const Activation activation = neuron_activations[*it];
+				sums[*it] = sum;
+				cur[*it] = ACTIVATION_SOFTMAX == activation ? sum : activation_functions[activation](sum);
+			}
+
+			if (softmax) {
+				real_t sum_exp(0);
+				for (uint32_t i(0); i < output_size; ++i) {
+					sum_exp += brain::Math::exp(cur[outputs[i]]);
+				}
+				for (uint32_t i(0); i < output_size; ++i) {
+					cur[outputs[i]] = brain::Math::soft_max_fast(cur[outputs[i]], sum_exp);
+				}
+			}
+
+			// Total error = Σ((expected - guess)^2)
+			real_t *errors = trace.errors.data() + t * output_size;
+			for (uint32_t i(0); i < output_size; ++i) {
+				errors[i] = p_expected.get(i, window_begin + t) - cur[outputs[i]];
+				total_error += errors[i] * errors[i];
+			}
+		}
+
+		/// Step 2. Backward, from the last step to the first one and from
+		/// the outputs to the inputs. The neurons without error are skipped
+		trace.deltas.assign((steps + 1) * neuron_count, 0.f);
+		trace.gradients.assign(link_parents.size(), 0.f);
+
+		for (uint32_t t(steps); 0 < t; --t) {
+			const real_t *prev = trace.values.data() + (t - 1) * neuron_count;
+			const real_t *cur = trace.values.data() + t * neuron_count;
+			const real_t *sums = trace.sums.data() + (t - 1) * neuron_count;
+			const real_t *errors = trace.errors.data() + (t - 1) * output_size;
+			real_t *prev_deltas = trace.deltas.data() + (t - 1) * neuron_count;
+			real_t *deltas = trace.deltas.data() + t * neuron_count;
+
+			for (uint32_t i(0); i < output_size; ++i) {
+				deltas[outputs[i]] -= errors[i];
+			}
+
+			for (auto it = plan_all_neurons.rbegin(); it != plan_all_neurons.rend(); ++it) {
+				if (deltas[*it] == 0.f)
+					continue;
+
+				// With the softmax the error is already the gradient of the
+				// input signal
+				const Activation activation = neuron_activations[*it];
+				const real_t delta =
+						ACTIVATION_SOFTMAX == activation ?
+								deltas[*it] :
+								deltas[*it] * activation_derivatives[activation](sums[*it]);
+
+				for (uint32_t l(parent_offsets[*it]); l < parent_offsets[*it + 1]; ++l) {
+					const NeuronId parent_id = link_parents[l];
+					if (!link_recurrents[l]) {
+						trace.gradients[l] += delta * cur[parent_id];
+						deltas[parent_id] += delta * link_weights[l];
+					} else if (trace.computed[parent_id]) {
+						trace.gradients[l] += delta * prev[parent_id];
+						prev_deltas[parent_id] += delta * link_weights[l];
+					}
+				}
+			}
+		}
+
+		/// Step 3. Update phase, subtract the gradient since we want to
+		/// descent the slope
+		for (uint32_t l(0); l < link_weights.size(); ++l) {
+			const real_t delta = trace.gradients[l] * p_learn_rate;
+
+			if (r_gradients)
+				(*r_gradients)[l] += delta;
+
+			if (p_update_weights)
+				link_weights[l] -= delta;
+		}
+
+		/// Step 4. The next window continues from the last values
+		std::copy(
+				trace.values.begin() + steps * neuron_count,
+				trace.values.begin() + (steps + 1) * neuron_count,
+				state.values.begin());
+	}
+
+	if (p_update_weights)
+		update_plan_weights();
+
+	return total_error;
+}
+
+void brain::SharpBrainArea::update_weights(const std::vector<real_t> &p_gradients) {
+	ERR_FAIL_COND(!is_ready());
+	ERR_FAIL_COND(p_gradients.size() != link_weights.size());
+
+	for (uint32_t l(0); l < link_weights.size(); ++l) {
+		link_weights[l] -= p_gradients[l];
+	}
+
+	update_plan_weights();
+}
+
+void brain::SharpBrainArea::set_plan_simplification(bool p_enabled) {
+	plan_simplification = p_enabled;
+	ready = false;
+}
+
+bool brain::SharpBrainArea::is_plan_simplification_enabled() const {
+	return plan_simplification;
+}
+
+brain::SharpState &brain::SharpBrainArea::get_state() const {
+	return state;
+}
+
+bool brain::SharpBrainArea::is_ready() const {
+	if (ready)
+		return true;
+
+	std::lock_guard<std::mutex> lock(ready_mutex);
+
+	// Another thread may have prepared it in the meantime
+	if (!ready)
+		check_ready();
+
+	return ready;
+}
+
 int brain::SharpBrainArea::get_buffer_metadata_size() const {
 	return sizeof(uint32_t) * METADATA_MAX; // Metadata size
 }
@@ -384,7 +839,7 @@ bool brain::SharpBrainArea::is_buffer_compatible(const std::vector<uint8_t> &p_b
 	const uint32_t output_count = ((uint32_t *)p_buffer.data())[METADATA_OUTPUT_COUNT];
 
 	if (
-			neurons.size() == neuron_count ||
+			neuron_activations.size() == neuron_count ||
 			inputs.size() == input_count ||
 			outputs.size() == output_count)
 		return false;
@@ -404,16 +859,38 @@ bool brain::SharpBrainArea::set_buffer(const std::vector<uint8_t> &p_buffer) {
 	const uint32_t input_count = ((uint32_t *)p_buffer.data())[METADATA_INPUT_COUNT];
 	const uint32_t output_count = ((uint32_t *)p_buffer.data())[METADATA_OUTPUT_COUNT];
 
-	neurons.resize(neuron_count);
+	// Not yet supported for this class load the links with a different real size (precision)
+	ERR_FAIL_COND_V(sizeof(real_t) != real_size, false);
+
+	clear();
+
 	inputs.resize(input_count);
 	outputs.resize(output_count);
 
 	const uint8_t *b_support = p_buffer.data() + get_buffer_metadata_size();
 
-	for (auto it = neurons.begin(); it != neurons.end(); ++it) {
-		it->from_byte(b_support, real_size);
-		const size_t neuron_size = it->get_byte_size();
-		b_support += neuron_size;
+	for (uint32_t n(0); n < neuron_count; ++n) {
+
+		const Activation activation = *(Activation *)b_support;
+		b_support += sizeof(Activation);
+
+		ERR_FAIL_COND_V(*(NeuronId *)b_support != n, false);
+		b_support += sizeof(NeuronId);
+
+		const uint32_t parent_count = *(uint32_t *)b_support;
+		b_support += sizeof(uint32_t);
+
+		neuron_activations.push_back(activation);
+
+		const BufferLink *links = (const BufferLink *)b_support;
+		for (uint32_t l(0); l < parent_count; ++l) {
+			link_parents.push_back(links[l].neuron_id);
+			link_weights.push_back(links[l].weight);
+			link_recurrents.push_back(links[l].is_recurrent);
+		}
+		parent_offsets.push_back(link_parents.size());
+
+		b_support += sizeof(BufferLink) * parent_count;
 	}
 
 	std::copy(
@@ -428,19 +905,33 @@ bool brain::SharpBrainArea::set_buffer(const std::vector<uint8_t> &p_buffer) {
 			((NeuronId *)b_support) + output_count,
 			outputs.data());
 
+	neuron_roles.assign(neuron_count, NEURON_ROLE_HIDDEN);
+	for (auto it = inputs.begin(); it != inputs.end(); ++it) {
+		ERR_FAIL_INDEX_V(*it, neuron_count, false);
+		neuron_roles[*it] = NEURON_ROLE_INPUT;
+	}
+	for (auto it = outputs.begin(); it != outputs.end(); ++it) {
+		ERR_FAIL_INDEX_V(*it, neuron_count, false);
+		neuron_roles[*it] = NEURON_ROLE_OUTPUT;
+	}
+
 	return true;
 }
 
 bool brain::SharpBrainArea::get_buffer(std::vector<uint8_t> &r_buffer) const {
 
+	sync_links();
+
 	const int real_size = sizeof(real_t);
 
 	uint32_t buffer_size = get_buffer_metadata_size();
 
-	for (auto it = neurons.begin(); it != neurons.end(); ++it) {
+	buffer_size += (sizeof(Activation) + // Activation
+						   sizeof(NeuronId) + // Neuron id
+						   sizeof(uint32_t)) * // Parent count
+				   neuron_activations.size();
 
-		buffer_size += it->get_byte_size();
-	}
+	buffer_size += sizeof(BufferLink) * link_parents.size();
 
 	buffer_size += sizeof(NeuronId) * (inputs.size() + outputs.size());
 
@@ -448,16 +939,34 @@ bool brain::SharpBrainArea::get_buffer(std::vector<uint8_t> &r_buffer) const {
 
 	((uint32_t *)r_buffer.data())[METADATA_BUFFER_SIZE] = buffer_size;
 	((uint32_t *)r_buffer.data())[METADATA_REAL_SIZE] = real_size;
-	((uint32_t *)r_buffer.data())[METADATA_NEURON_COUNT] = neurons.size();
+	((uint32_t *)r_buffer.data())[METADATA_NEURON_COUNT] = neuron_activations.size();
 	((uint32_t *)r_buffer.data())[METADATA_INPUT_COUNT] = inputs.size();
 	((uint32_t *)r_buffer.data())[METADATA_OUTPUT_COUNT] = outputs.size();
 
 	uint8_t *b_support = r_buffer.data() + get_buffer_metadata_size();
 
-	for (auto it = neurons.begin(); it != neurons.end(); ++it) {
-		it->to_byte(b_support);
-		const size_t neuron_size = it->get_byte_size();
-		b_support += neuron_size;
+	for (uint32_t n(0); n < neuron_activations.size(); ++n) {
+
+		*(Activation *)b_support = neuron_activations[n];
+		b_support += sizeof(Activation);
+
+		*(NeuronId *)b_support = n;
+		b_support += sizeof(NeuronId);
+
+		const uint32_t begin = parent_offsets[n];
+		const uint32_t parent_count = parent_offsets[n + 1] - begin;
+		*(uint32_t *)b_support = parent_count;
+		b_support += sizeof(uint32_t);
+
+		BufferLink *links = (BufferLink *)b_support;
+		for (uint32_t l(0); l < parent_count; ++l) {
+			links[l].unused = nullptr;
+			links[l].neuron_id = link_parents[begin + l];
+			links[l].weight = link_weights[begin + l];
+			links[l].is_recurrent = link_recurrents[begin + l];
+		}
+
+		b_support += sizeof(BufferLink) * parent_count;
 	}
 
 	std::copy(
@@ -475,122 +984,467 @@ bool brain::SharpBrainArea::get_buffer(std::vector<uint8_t> &r_buffer) const {
 	return true;
 }
 
+bool brain::SharpBrainArea::set_model(const SharpModel &p_model) {
+
+	ERR_FAIL_COND_V(!p_model.is_valid(), false);
+
+	// Not yet supported for this class load the links with a different real size (precision)
+	ERR_FAIL_COND_V(sizeof(real_t) != p_model.get_real_size(), false);
+
+	clear();
+
+	const uint32_t neuron_count = p_model.get_neuron_count();
+	const uint32_t link_count = p_model.get_link_count();
+
+	/// Step 1. Copy the arrays, the model already checked them
+	const uint32_t *activations = p_model.get_activations();
+	neuron_activations.resize(neuron_count);
+	for (uint32_t n(0); n < neuron_count; ++n) {
+		neuron_activations[n] = static_cast<Activation>(activations[n]);
+	}
+
+	parent_offsets.assign(
+			p_model.get_parent_offsets(),
+			p_model.get_parent_offsets() + neuron_count + 1);
+
+	link_parents.assign(
+			p_model.get_link_parents(),
+			p_model.get_link_parents() + link_count);
+
+	link_weights.assign(
+			p_model.get_link_weights(),
+			p_model.get_link_weights() + link_count);
+
+	link_recurrents.assign(
+			p_model.get_link_recurrents(),
+			p_model.get_link_recurrents() + link_count);
+
+	inputs.assign(
+			p_model.get_inputs(),
+			p_model.get_inputs() + p_model.get_input_count());
+
+	outputs.assign(
+			p_model.get_outputs(),
+			p_model.get_outputs() + p_model.get_output_count());
+
+	/// Step 2. Set the roles, a neuron can have only one role
+	neuron_roles.assign(neuron_count, NEURON_ROLE_HIDDEN);
+	for (auto it = inputs.begin(); it != inputs.end(); ++it) {
+		if (neuron_roles[*it] != NEURON_ROLE_HIDDEN) {
+			clear();
+			ERR_EXPLAIN("The neuron has more than one role. Neuron ID: " + itos(*it));
+			ERR_FAIL_V(false);
+		}
+		neuron_roles[*it] = NEURON_ROLE_INPUT;
+	}
+	for (auto it = outputs.begin(); it != outputs.end(); ++it) {
+		if (neuron_roles[*it] != NEURON_ROLE_HIDDEN) {
+			clear();
+			ERR_EXPLAIN("The neuron has more than one role. Neuron ID: " + itos(*it));
+			ERR_FAIL_V(false);
+		}
+		neuron_roles[*it] = NEURON_ROLE_OUTPUT;
+	}
+
+	return true;
+}
+
 bool brain::SharpBrainArea::are_links_walkable(
-		Neuron *p_neuron,
 		bool p_error_on_broken_link,
-		bool p_error_on_dead_branches,
-		std::vector<NeuronId> &r_cache) const {
+		bool p_error_on_dead_branches) const {
 
-	// This happens only to the input layer
-	if (is_neuron_input(p_neuron->id))
-		return true;
-
-	// Check dead branches
-	if (p_error_on_dead_branches) {
-		ERR_FAIL_COND_V(!p_neuron->parents.size(), false);
-	} else if (!p_neuron->parents.size())
-		return true;
+	const uint32_t neuron_count = neuron_activations.size();
 
-	r_cache.push_back(p_neuron->id);
+	// `visiting` marks the neurons in the stack, so a parent still in
+	// the stack is a loop
+	std::vector<bool> visiting(neuron_count, false);
+	std::vector<bool> visited(neuron_count, false);
+	std::vector<bool> reaches_input(neuron_count, false);
 
-	bool failed = false;
-	std::string explain;
+	for (auto it = inputs.begin(); it != inputs.end(); ++it) {
+		visited[*it] = true;
+		reaches_input[*it] = true;
+	}
 
-	// This check if this neuron in the hidden layer is fully connected to input
-	for (auto p_it = p_neuron->parents.begin();
-			p_it != p_neuron->parents.end();
-			++p_it) {
+	/// Walk the non recurrent links from the outputs, each neuron and link
+	/// is visited once. The pair holds the neuron and its next parent.
+	std::vector<std::pair<NeuronId, uint32_t> > stack;
+	for (auto o_it = outputs.begin(); o_it != outputs.end(); ++o_it) {
 
-		if (p_it->is_recurrent)
+		if (visited[*o_it])
 			continue;
 
-		if (r_cache.end() != std::find(r_cache.begin(), r_cache.end(), p_it->neuron_id)) {
-			explain = "Just detected a loop in the network. between these " + itos(reinterpret_cast<uint64_t>(this)) + " neurons:";
-			for (auto it = r_cache.begin(); it != r_cache.end(); ++it) {
-				explain += "\n" + itos(*it);
-			}
+		visiting[*o_it] = true;
+		stack.push_back(std::make_pair(*o_it, 0u));
 
-			failed = true;
-			break;
-		}
+		while (stack.size()) {
+			const NeuronId id = stack.back().first;
+			const uint32_t begin = parent_offsets[id];
+			const uint32_t end = parent_offsets[id + 1];
+			const uint32_t link = begin + stack.back().second;
+
+			if (link < end) {
+				++stack.back().second;
+
+				if (link_recurrents[link])
+					continue;
+
+				const NeuronId parent_id = link_parents[link];
 
-		if (!are_links_walkable(
-					p_it->neuron,
-					p_error_on_broken_link,
-					p_error_on_dead_branches,
-					r_cache)) {
+				if (visiting[parent_id]) {
+					std::string explain = "Just detected a loop in the network, between these neurons:";
+					for (auto it = stack.rbegin(); it != stack.rend(); ++it) {
+						explain += "\n" + itos(it->first);
+						if (it->first == parent_id)
+							break;
+					}
+					ERR_EXPLAIN(explain);
+					ERR_FAIL_V(false);
+				}
+
+				if (visited[parent_id]) {
+					reaches_input[id] = reaches_input[id] || reaches_input[parent_id];
+					continue;
+				}
+
+				visiting[parent_id] = true;
+				stack.push_back(std::make_pair(parent_id, 0u));
 
-			if (p_error_on_broken_link) {
-				explain = "The neuron is not fully connected to the input. Neuron ID: " + brain::itos(p_it->neuron->id);
-				failed = true;
-				break;
 			} else {
-				// Already loggeed, just report it up
-				failed = true;
-				break;
-			}
-		}
-	}
 
-	auto it = std::find(r_cache.begin(), r_cache.end(), p_neuron->id);
-	ERR_FAIL_COND_V(it == r_cache.end(), false);
-	r_cache.erase(it);
+				if (p_error_on_dead_branches && begin == end) {
+					ERR_EXPLAIN("The neuron doesn't have any parent. Neuron ID: " + itos(id));
+					ERR_FAIL_V(false);
+				}
 
-	if (failed) {
-		if (explain == "") {
-			// Alreayd logged
-			return false;
+				if (p_error_on_broken_link && !reaches_input[id]) {
+					ERR_EXPLAIN("The neuron is not fully connected to the input. Neuron ID: " + itos(id));
+					ERR_FAIL_V(false);
+				}
+
+				visiting[id] = false;
+				visited[id] = true;
+				stack.pop_back();
+
+				if (stack.size()) {
+					const NeuronId child_id = stack.back().first;
+					reaches_input[child_id] = reaches_input[child_id] || reaches_input[id];
+				}
+			}
 		}
-		ERR_EXPLAIN(explain);
-		ERR_FAIL_V(false);
 	}
 
 	return true;
 }
 
-void brain::SharpBrainArea::check_ready() {
+void brain::SharpBrainArea::check_ready() const {
 	ready = false;
 
+	ERR_FAIL_COND(bulk_construction);
 	ERR_FAIL_COND(!get_input_layer_size());
+	place_pending_links();
 	ERR_FAIL_COND(!get_output_layer_size());
 
-	for (auto it = neurons.begin(); it != neurons.end(); ++it) {
-		it->prepare_internal_memory(this);
-	}
+	if (!are_links_walkable(false, false))
+		return;
 
-	std::vector<NeuronId> cache;
+	compile_plan();
 
-	// Check if the output neurons are fully connected to the inputs
+	ready = true;
+}
+
+void brain::SharpBrainArea::compile_plan() const {
+
+	enum NeuronStatus {
+		NEURON_STATUS_UNVISITED,
+		NEURON_STATUS_INPUT,
+		NEURON_STATUS_VISITING,
+		NEURON_STATUS_PLANNED
+	};
+
+	const uint32_t neuron_count = neuron_activations.size();
+
+	plan_neurons.clear();
+	plan_level_offsets.clear();
+	plan_activations.clear();
+	plan_link_offsets.clear();
+	plan_link_sources.clear();
+	plan_link_weights.clear();
+	plan_recurrent_neurons.clear();
+	plan_constant_neurons.clear();
+	plan_constant_values.clear();
+	plan_all_neurons.clear();
+
+	std::vector<uint8_t> status(neuron_count, NEURON_STATUS_UNVISITED);
+	for (auto it = inputs.begin(); it != inputs.end(); ++it) {
+		status[*it] = NEURON_STATUS_INPUT;
+	}
+
+	/// Step 1. Walk the non recurrent links from the outputs, the neurons
+	/// are visited in post order so the parents always come first.
+	/// The neurons not visited can't reach any output, so they are never
+	/// computed.
+	/// The pair holds the neuron and its next parent to visit.
+	std::vector<NeuronId> order;
+	std::vector<std::pair<NeuronId, uint32_t> > stack;
 	for (auto o_it = outputs.begin(); o_it != outputs.end(); ++o_it) {
-		if (!are_links_walkable(&neurons[*o_it], false, false, cache))
-			return;
+
+		if (status[*o_it] != NEURON_STATUS_UNVISITED)
+			continue;
+
+		status[*o_it] = NEURON_STATUS_VISITING;
+		stack.push_back(std::make_pair(*o_it, 0u));
+
+		while (stack.size()) {
+			const NeuronId id = stack.back().first;
+			const uint32_t link = parent_offsets[id] + stack.back().second;
+
+			if (link < parent_offsets[id + 1]) {
+				++stack.back().second;
+
+				const NeuronId parent_id = link_parents[link];
+				if (link_recurrents[link] || status[parent_id] != NEURON_STATUS_UNVISITED)
+					continue;
+
+				status[parent_id] = NEURON_STATUS_VISITING;
+				stack.push_back(std::make_pair(parent_id, 0u));
+			} else {
+
+				status[id] = NEURON_STATUS_PLANNED;
+				order.push_back(id);
+				stack.pop_back();
+			}
+		}
 	}
 
-	ready = true;
-}
+	/// Step 2. Simplify the links, in post order so the parents are already
+	/// simplified. A source below neuron_count is the current value of a
+	/// neuron, `neuron_count + id` is the previous value of the neuron `id`.
+	///
+	/// All the simplifications give the same result of the full network,
+	/// when the values are finite:
+	/// - The links with zero weight are dropped, `0 * Inf` and `0 * NaN`
+	///	  would be NaN instead.
+	/// - The neurons without inputs and recurrent parents are constant, they
+	///	  are computed here and their value is set by the guess.
+	/// - A linear neuron with a single link just forwards its parent, so its
+	///	  children read the parent directly when one of the two weights is 1
+	///	  and the product is exact. This is what the NEAT node mutation
+	///	  creates when the activation is linear.
+	///
+	/// When plan_simplification is false the links are only copied.
+	std::vector<uint32_t> work_begins(neuron_count, 0);
+	std::vector<uint32_t> work_ends(neuron_count, 0);
+	std::vector<uint32_t> work_sources;
+	std::vector<real_t> work_weights;
+	work_sources.reserve(link_parents.size());
+	work_weights.reserve(link_parents.size());
+
+	std::vector<uint8_t> constants(neuron_count, false);
+	std::vector<real_t> constant_values(neuron_count, 0.f);
+
+	for (auto it = order.begin(); it != order.end(); ++it) {
+		const NeuronId id = *it;
+		const uint32_t begin = work_sources.size();
+		bool constant = true;
+
+		for (uint32_t l(parent_offsets[id]); l < parent_offsets[id + 1]; ++l) {
+
+			if (plan_simplification && link_weights[l] == 0.f)
+				continue;
+
+			const NeuronId parent_id = link_parents[l];
+			uint32_t source = parent_id;
+			real_t weight = link_weights[l];
+
+			if (link_recurrents[l]) {
+
+				// The neurons never computed, inputs included, have no
+				// previous value so they always contribute with zero
+				if (status[parent_id] != NEURON_STATUS_PLANNED)
+					continue;
+
+				source = neuron_count + parent_id;
+				constant = false;
+
+			} else if (!constants[parent_id]) {
+
+				if (plan_simplification &&
+						status[parent_id] == NEURON_STATUS_PLANNED &&
+						ACTIVATION_LINEAR == neuron_activations[parent_id] &&
+						work_ends[parent_id] - work_begins[parent_id] == 1) {
+
+					const uint32_t forward = work_begins[parent_id];
+					if (work_weights[forward] == 1.f || weight == 1.f) {
+						source = work_sources[forward];
+						weight *= work_weights[forward];
+					}
+				}
+
+				constant = false;
+			}
+
+			work_sources.push_back(source);
+			work_weights.push_back(weight);
+		}
+
+		if (plan_simplification && constant) {
 
-void brain::SharpBrainArea::randomize_parents_weight(
-		Neuron *p_neuron,
-		real_t p_range) {
+			// Computed as compute_neurons does
+			real_t value(0.f);
+			for (uint32_t l(begin); l < work_sources.size(); ++l) {
+				value += constant_values[work_sources[l]] * work_weights[l];
+			}
+
+			const Activation activation = neuron_activations[id];
+			constants[id] = true;
+			constant_values[id] =
+					ACTIVATION_SOFTMAX == activation ?
+							value :
+							activation_functions[activation](value);
 
-	for (auto p_it = p_neuron->parents.begin();
-			p_it != p_neuron->parents.end();
-			++p_it) {
+			work_sources.resize(begin);
+			work_weights.resize(begin);
+		}
 
-		p_it->weight = brain::Math::random(-p_range, p_range);
-		randomize_parents_weight(p_it->neuron, p_range);
+		work_begins[id] = begin;
+		work_ends[id] = work_sources.size();
 	}
-}
 
-void brain::SharpBrainArea::set_parents_weight(
-		Neuron *p_neuron,
-		real_t p_weight) {
+	/// Step 3. Find the neurons still used, starting from the outputs.
+	/// The neurons read by a recurrent link remain computed as before the
+	/// simplification
+	std::vector<uint8_t> used(neuron_count, false);
+	std::vector<NeuronId> used_stack(outputs);
 
-	for (auto p_it = p_neuron->parents.begin();
-			p_it != p_neuron->parents.end();
-			++p_it) {
+	for (auto it = outputs.begin(); it != outputs.end(); ++it) {
+		used[*it] = true;
+	}
+
+	while (used_stack.size()) {
+		const NeuronId id = used_stack.back();
+		used_stack.pop_back();
+
+		if (status[id] != NEURON_STATUS_PLANNED)
+			continue;
+
+		for (uint32_t l(work_begins[id]); l < work_ends[id]; ++l) {
+			const NeuronId parent_id =
+					work_sources[l] < neuron_count ?
+							work_sources[l] :
+							work_sources[l] - neuron_count;
+
+			if (!used[parent_id]) {
+				used[parent_id] = true;
+				used_stack.push_back(parent_id);
+			}
+		}
+	}
+
+	for (auto it = order.begin(); it != order.end(); ++it) {
+		if (!used[*it])
+			continue;
+
+		if (constants[*it]) {
+			plan_constant_neurons.push_back(*it);
+			plan_constant_values.push_back(constant_values[*it]);
+		} else {
+			plan_neurons.push_back(*it);
+		}
+	}
+
+	/// Step 4. Group the neurons by depth level, the level of a neuron is
+	/// one more than the deepest non recurrent parent; the inputs and the
+	/// constants are at level 0 so the planned levels start from 1.
+	/// In post order the parents are always leveled before their children.
+	std::vector<uint32_t> levels(neuron_count, 0);
+	uint32_t depth(0);
+
+	for (auto it = plan_neurons.begin(); it != plan_neurons.end(); ++it) {
+		uint32_t level(1);
+		for (uint32_t l(work_begins[*it]); l < work_ends[*it]; ++l) {
+			if (work_sources[l] < neuron_count)
+				level = MAX(level, levels[work_sources[l]] + 1);
+		}
+		levels[*it] = level;
+		depth = MAX(depth, level);
+	}
+
+	// Counting sort, stable so the neurons keep the post order inside the
+	// level. The level `l` is stored at plan_level_offsets[l - 1]
+	plan_level_offsets.assign(depth + 1, 0);
+	for (auto it = plan_neurons.begin(); it != plan_neurons.end(); ++it) {
+		++plan_level_offsets[levels[*it]];
+	}
+	for (uint32_t l(1); l <= depth; ++l) {
+		plan_level_offsets[l] += plan_level_offsets[l - 1];
+	}
+
+	{
+		std::vector<uint32_t> cursors(plan_level_offsets);
+		std::vector<NeuronId> sorted(plan_neurons.size());
+		for (auto it = plan_neurons.begin(); it != plan_neurons.end(); ++it) {
+			sorted[cursors[levels[*it] - 1]++] = *it;
+		}
+		plan_neurons.swap(sorted);
+	}
+
+	/// Step 5. Flatten the links
+	std::vector<uint32_t> recurrent_slots(neuron_count, UINT32_MAX);
+
+	plan_activations.reserve(plan_neurons.size());
+	plan_link_offsets.reserve(plan_neurons.size() + 1);
+	plan_link_offsets.push_back(0);
+
+	for (auto it = plan_neurons.begin(); it != plan_neurons.end(); ++it) {
+		const Activation activation = neuron_activations[*it];
+
+		// Softmax activation is performed by the guess function and works
+		// only for the output neurons
+		plan_activations.push_back(
+				ACTIVATION_SOFTMAX == activation ?
+						activation_functions[ACTIVATION_LINEAR] :
+						activation_functions[activation]);
+
+		for (uint32_t l(work_begins[*it]); l < work_ends[*it]; ++l) {
+
+			uint32_t source = work_sources[l];
+
+			if (source >= neuron_count) {
+				const NeuronId parent_id = source - neuron_count;
+
+				if (recurrent_slots[parent_id] == UINT32_MAX) {
+					recurrent_slots[parent_id] = plan_recurrent_neurons.size();
+					plan_recurrent_neurons.push_back(parent_id);
+				}
+				source = neuron_count + recurrent_slots[parent_id];
+			}
 
-		p_it->weight = p_weight;
-		set_parents_weight(p_it->neuron, p_weight);
+			plan_link_sources.push_back(source);
+			plan_link_weights.push_back(work_weights[l]);
+		}
+
+		plan_link_offsets.push_back(plan_link_sources.size());
 	}
+
+	plan_all_neurons.swap(order);
+
+	/// Step 6. Reset the internal state, so the first guess reads zero from
+	/// the recurrent links
+	state.values.clear();
+}
+
+void brain::SharpBrainArea::update_plan_weights() {
+
+	const uint32_t neuron_count = neuron_activations.size();
+
+	// The recurrent slots are filled by the next guess, so only the neuron
+	// values are kept
+	std::vector<real_t> values(state.values);
+	values.resize(neuron_count, 0.f);
+
+	compile_plan();
+
+	state.values.assign(neuron_count + plan_recurrent_neurons.size(), 0.f);
+	std::copy(values.begin(), values.end(), state.values.begin());
 }
@@ -1,239 +1,220 @@
 #pragma once
 
 #include "brain/brain_areas/brain_area.h"
+#include <atomic>
+#include <mutex>
 #include <vector>
 
 namespace brain {
 
 typedef uint32_t NeuronId;
 
-class Neuron;
 class SharpBrainArea;
+class SharpModel;
+class ThreadPool;
 
 /**
- * @brief The weighted Link between a Neuron and its parents
+ * @brief The SharpState class holds the values of a SharpBrainArea
+ * execution, so the recurrent memory.
+ *
+ * The network itself is never modified by the guess, so many SharpState
+ * can share the same SharpBrainArea, also from different threads.
+ *
+ * A new state is empty and it's initialized to zero by the first guess,
+ * the same happens when it's used with a network of a different size or
+ * with a batch of a different size.
  */
-struct Link {
-	/**
-	 * @brief neuron is a support variable to speedup the guess processing
-	 */
-	Neuron *neuron = nullptr;
+class SharpState {
 
-	/**
-	 * @brief The neuron id in the BrainArea
-	 */
-	NeuronId neuron_id;
+	friend class SharpBrainArea;
+	friend class SharpModel;
+	friend class SharpNativeArea;
 
 	/**
-	 * @brief This connection weight
+	 * @brief values the neuron values of the last guess, followed by the
+	 * recurrent slots. When used by guess_batch each of them has one value
+	 * per sample.
 	 */
-	real_t weight;
+	std::vector<real_t> values;
 
+public:
 	/**
-	 * @brief If this link is a recurrent link
+	 * @brief reset clears the recurrent memory
 	 */
-	bool is_recurrent;
+	void reset();
 
 	/**
-	 * @brief Constructor
-	 * @param p_neuron
-	 * @param p_neuron_id
-	 * @param p_weight
-	 * @param p_is_recurrent
+	 * @brief snapshot copies the state inside the passed buffer
+	 * @param r_snapshot
 	 */
-	Link(
-			Neuron *p_neuron,
-			NeuronId p_neuron_id,
-			real_t p_weight,
-			bool p_is_recurrent) :
-			neuron(p_neuron),
-			neuron_id(p_neuron_id),
-			weight(p_weight),
-			is_recurrent(p_is_recurrent) {}
+	void snapshot(std::vector<real_t> &r_snapshot) const;
 
 	/**
-	 * @brief Link This is here only to allow array manipulation
-	 * So please not use this directly
+	 * @brief restore sets the state taken with snapshot, it must be taken
+	 * from a state of the same network
+	 * @param p_snapshot
 	 */
-	Link() {}
+	void restore(const std::vector<real_t> &p_snapshot);
 };
 
 /**
- * @brief The Neuron struct represent the unit computation of the brain area
- * It could be an input neuron, hidden neuron or an output neuron and
- * never more than one at same time
+ * @brief The SharpBrainArea class is the type of brain area that give
+ * the possibility to create partially connected neural network.
+ *
+ * The guess function execution of this neural network is generally 2 times
+ * faster than the uniform brain area, on the other hand its creation is slower
+ *
+ * IMPORTANT: in this brain area the bias is not added automatically, so it
+ * must be explicitly created and treated as input neuron.
  */
-struct Neuron {
-
-	/**
-	 * @brief parents neurons and its connection weight
-	 */
-	std::vector<Link> parents;
-
-	/**
-	 * @brief activation function of this neuron
-	 */
-	brain::BrainArea::Activation activation;
-
-	/**
-	 * @brief The id of neuron, it indicate the index in the neurons vector
-	 * of the SharpBrainArea class
-	 */
-	NeuronId id;
+class SharpBrainArea : public brain::BrainArea {
 
-	/**
-	 * @brief When the execution_id is the same this value is returned
-	 */
-	mutable real_t cached_value;
+	friend class SharpNativeArea;
+	friend class SharpModel;
 
-	/**
-	 * @brief recurrent is the previous value that the neuron returned.
-	 *
-	 * NOTE: This parameter is necessary due to the way how the data travel
-	 * inside network.
-	 * Changing how the data travel inside the network could avoid the use of this
-	 * extra variable.
-	 */
-	mutable real_t recurrent;
-
-	/**
-	 * @brief execution_id Used to know if the cached_value is still valid
-	 */
-	mutable uint32_t execution_id;
+	enum NeuronRole {
+		NEURON_ROLE_HIDDEN,
+		NEURON_ROLE_INPUT,
+		NEURON_ROLE_OUTPUT
+	};
 
 	/**
-	 * @brief No initialization constructor
+	 * @brief PendingLink is a link added by add_link and not yet placed in
+	 * the flat arrays
 	 */
-	Neuron() {}
+	struct PendingLink {
+		NeuronId parent_id;
+		NeuronId child_id;
+		real_t weight;
+		bool recurrent;
+	};
 
 	/**
-	 * @brief Neuron constructor
-	 * @param p_id
+	 * @brief neuron_activations the activation function of each neuron,
+	 * the index is the NeuronId
 	 */
-	Neuron(NeuronId p_id);
+	std::vector<Activation> neuron_activations;
 
 	/**
-	 * @brief prepare_internal_memory is used to initialize the internal memory
-	 * and put it in the correct state ready to be used
-	 * @param p_owner
+	 * @brief neuron_roles the NeuronRole of each neuron, the index is the
+	 * NeuronId
 	 */
-	void prepare_internal_memory(SharpBrainArea *p_owner);
+	std::vector<uint8_t> neuron_roles;
 
 	/**
-	 * @brief has_parent
-	 * @param p_neuron_id
-	 * @return
+	 * @brief The links are stored by child neuron in flat arrays:
+	 * the parents of the neuron `n` are stored from parent_offsets[n]
+	 * to parent_offsets[n + 1], in the order they were added.
 	 *
-	 * Return true if this p_neuron is already a parent of this neuron
+	 * add_link doesn't touch them: the links are stored in pending_links and
+	 * placed all together, in linear time, by place_pending_links when the
+	 * links are read. So, as the plan, they are mutable.
 	 */
-	bool has_parent(NeuronId p_neuron_id) const;
+	mutable std::vector<uint32_t> parent_offsets;
+	mutable std::vector<NeuronId> link_parents;
+	mutable std::vector<real_t> link_weights;
+	mutable std::vector<uint8_t> link_recurrents;
+	mutable std::vector<PendingLink> pending_links;
 
 	/**
-	 * @brief get_parent_count
-	 * @return
-	 */
-	uint32_t get_parent_count() const;
-
-	/**
-	 * @brief add_parent Put the p_neuron as parent and create a weighted link
-	 * @param p_neuron
-	 * @param p_weight
-	 * @param p_recurrent
+	 * @brief bulk_construction is true between begin_bulk_construction and
+	 * end_bulk_construction, in the meantime the pending links are not placed
 	 */
-	void add_parent(NeuronId p_neuron_id, real_t p_weight, bool p_recurrent);
+	bool bulk_construction;
 
 	/**
-	 * @brief set_weight between this neuron and its parent
-	 * @param p_parent_index
-	 * @param p_weight
+	 * @brief inputs neuron ids of this brain area
 	 */
-	void set_weight(uint32_t p_parent_index, real_t p_weight);
+	std::vector<NeuronId> inputs;
 
 	/**
-	 * @brief force_set_value
-	 * @param p_val
-	 * @param p_execution_id
-	 *
-	 * Used to set the values of the inputs
+	 * @brief outputs neuron ids of this brain area
 	 */
-	void force_set_value(real_t p_val, uint32_t p_execution_id) const;
+	std::vector<NeuronId> outputs;
 
 	/**
-	 * @brief get_value Get the value of this neuron, if the passed execution_id is the
-	 * same of the stored one the cached value is returned.
-	 * @param p_execution_id
-	 * @return
+	 * @brief ready tells if the network is fully connected
+	 * and ready to be used
 	 */
-	real_t get_value(uint32_t p_execution_id) const;
+	mutable std::atomic<bool> ready;
 
 	/**
-	 * @brief get_recurrent returns the previous computed value
-	 * @param p_execution_id
-	 * @return
+	 * @brief ready_mutex is used to prepare the network from the const
+	 * functions, when it's shared between many threads
 	 */
-	real_t get_recurrent(uint32_t p_execution_id) const;
+	mutable std::mutex ready_mutex;
 
 	/**
-	 * @brief get_byte_size returns the bytes to allocate to store this neuron
-	 * in a buffer
-	 * @return
+	 * @brief The compiled execution plan, built by check_ready.
+	 *
+	 * The plan is a cache derived from the links, so it's mutable: the const
+	 * functions build it on first use through is_ready. That happens once,
+	 * under ready_mutex, and then it's only read until the network is
+	 * modified by a non const function.
+	 *
+	 * The neurons that can't reach an output are never computed. The plan is
+	 * also simplified, unless set_plan_simplification disables it: the zero
+	 * weight links and the linear neurons that just forward a value are
+	 * skipped, and the constant neurons are computed once. The result doesn't
+	 * change as long as the inputs and the neuron values are finite: a
+	 * dropped zero weight link would give NaN with an infinite or NaN value.
+	 *
+	 * plan_neurons contains the neurons to compute in topological order,
+	 * so each neuron comes after all its non recurrent parents.
+	 * The links of the neuron plan_neurons[i] are stored from
+	 * plan_link_offsets[i] to plan_link_offsets[i + 1] in the flat arrays
+	 * plan_link_sources and plan_link_weights.
+	 *
+	 * A link source is an index of the SharpState values: the first
+	 * get_neuron_count() elements are the values of the current guess, then there
+	 * is one slot per neuron read by a recurrent link that holds its value of
+	 * the previous guess.
+	 *
+	 * The neurons are grouped by depth level: all the parents of a level come
+	 * from the previous levels or from the recurrent slots, so the neurons
+	 * of the same level can be computed in any order, also in parallel.
+	 * The level `l` goes from plan_level_offsets[l] to
+	 * plan_level_offsets[l + 1].
 	 */
-	size_t get_byte_size() const;
+	mutable std::vector<NeuronId> plan_neurons;
+	mutable std::vector<uint32_t> plan_level_offsets;
+	mutable std::vector<activation_func> plan_activations;
+	mutable std::vector<uint32_t> plan_link_offsets;
+	mutable std::vector<uint32_t> plan_link_sources;
+	mutable std::vector<real_t> plan_link_weights;
 
 	/**
-	 * @brief from_byte is used to set the data from a buffere to this neuron
-	 * @param p_buffer
-	 * @param p_size_of_real
+	 * @brief plan_recurrent_neurons the neurons read by a recurrent link,
+	 * the value of plan_recurrent_neurons[i] is stored in the slot
+	 * get_neuron_count() + i of the SharpState values.
 	 */
-	void from_byte(const uint8_t *p_buffer, int p_size_of_real);
+	mutable std::vector<NeuronId> plan_recurrent_neurons;
 
 	/**
-	 * @brief to_byte write the current neuron data inside the buffer,
-	 * that must have a lenght >= get_byte_size()
-	 * @param r_buffer
+	 * @brief plan_constant_neurons the neurons that don't depend on the
+	 * inputs, their value plan_constant_values[i] is computed by compile_plan
+	 * and it's set by the guess as the inputs are.
 	 */
-	void to_byte(uint8_t *p_buffer) const;
-};
-
-/**
- * @brief The SharpBrainArea class is the type of brain area that give
- * the possibility to create partially connected neural network.
- *
- * The guess function execution of this neural network is generally 2 times
- * faster than the uniform brain area, on the other hand its creation is slower
- *
- * IMPORTANT: in this brain area the bias is not added automatically, so it
- * must be explicitly created and treated as input neuron.
- */
-class SharpBrainArea : public brain::BrainArea {
-
-	friend class Neuron;
+	mutable std::vector<NeuronId> plan_constant_neurons;
+	mutable std::vector<real_t> plan_constant_values;
 
 	/**
-	 * @brief execution_id Used to know if the cached_value is still valid
+	 * @brief plan_all_neurons all the neurons computed by the network
+	 * before the simplification, in topological order. The learning uses
+	 * them, so all the links get their gradient.
 	 */
-	mutable uint32_t execution_id;
+	mutable std::vector<NeuronId> plan_all_neurons;
 
 	/**
-	 * @brief neurons of this brain area
+	 * @brief plan_simplification tells if compile_plan simplifies the plan,
+	 * it's true by default
 	 */
-	std::vector<Neuron> neurons;
+	bool plan_simplification;
 
 	/**
-	 * @brief inputs neuron ids of this brain area
+	 * @brief state used by the guess function that doesn't take a state
 	 */
-	std::vector<NeuronId> inputs;
-
-	/**
-	 * @brief outputs neuron ids of this brain area
-	 */
-	std::vector<NeuronId> outputs;
-
-	/**
-	 * @brief ready tells if the network is fully connected
-	 * and ready to be used
-	 */
-	bool ready;
+	mutable SharpState state;
 
 public:
 	/**
@@ -241,6 +222,12 @@ public:
 	 */
 	SharpBrainArea();
 
+	/**
+	 * @brief copy constructor
+	 * @param p_brain_area
+	 */
+	SharpBrainArea(const brain::SharpBrainArea &p_brain_area);
+
 	/**
 	 * @brief copy
 	 * @param p_brain_area
@@ -348,6 +335,10 @@ public:
 	 *
 	 * If the link is recurrent can be also added to itseft
 	 *
+	 * The link is stored and placed with the others when the links are read,
+	 * so adding many links one by one takes linear time. A duplicated link is
+	 * discarded at that time.
+	 *
 	 * @param p_neuron_parent_id
 	 * @param p_neuron_child_id
 	 * @param p_weight
@@ -359,6 +350,23 @@ public:
 			real_t p_weight = 0.f,
 			bool p_recurrent = false);
 
+	/**
+	 * @brief begin_bulk_construction starts the bulk construction mode, used
+	 * to build a big network at once.
+	 *
+	 * In this mode the links are placed all together by
+	 * end_bulk_construction, even if they are read in the meantime. Until then
+	 * the links are not visible by the getters.
+	 */
+	void begin_bulk_construction();
+
+	/**
+	 * @brief end_bulk_construction places all the added links, in linear
+	 * time, and validates the network once
+	 * @return Returns false if the network is not correctly connected
+	 */
+	bool end_bulk_construction();
+
 	/**
 	 * @brief clear can be used to delete all neurons
 	 */
@@ -407,6 +415,110 @@ public:
 			const Matrix &p_input,
 			Matrix &r_guess) const;
 
+	/**
+	 * @brief guess is the same of the above guess, but the values and the
+	 * recurrent memory are stored in the passed state.
+	 *
+	 * It doesn't modify the brain area, so it's safe to call it from many
+	 * threads at the same time as long as each thread uses its own state.
+	 *
+	 * @param p_input Input data
+	 * @param r_guess result
+	 * @param r_state
+	 * @param p_pool when set, the widest depth levels are split between its
+	 *			threads. The pool can't be used by two guesses at the same
+	 *			time; the result doesn't change.
+	 */
+	bool guess(
+			const Matrix &p_input,
+			Matrix &r_guess,
+			SharpState &r_state,
+			ThreadPool *p_pool = nullptr) const;
+
+	/**
+	 * @brief guess_batch computes the guess of many independent samples at
+	 * once, all the samples go through the network in lockstep.
+	 *
+	 * Each column of the inputs is a sample, the outputs have one column
+	 * per sample too. Each neuron holds one value per sample, so each link
+	 * is applied to all the samples using the vector instructions.
+	 *
+	 * @param p_inputs input layer size x samples count
+	 * @param r_outputs output layer size x samples count
+	 * @param r_state holds the recurrent memory of each sample, so it can be
+	 *			used to step many agents at once. When null each sample
+	 *			starts from an empty recurrent memory
+	 * @param p_pool when set, the widest depth levels are split between its
+	 *			threads, as the guess does
+	 */
+	bool guess_batch(
+			const Matrix &p_inputs,
+			Matrix &r_outputs,
+			SharpState *r_state = nullptr,
+			ThreadPool *p_pool = nullptr) const;
+
+	/**
+	 * @brief learn performs the stochastic gradient descent on a sequence,
+	 * the error is back propagated only through the links used by the
+	 * outputs.
+	 *
+	 * Each column of the inputs and of the expected is a time step, the
+	 * sequence continues from the recurrent memory of the internal state,
+	 * as the guess does. The recurrent links are trained with the truncated
+	 * back propagation through time: the sequence is split in windows of
+	 * `p_truncation` steps, the error flows back inside the window and the
+	 * weights are updated at the end of each window.
+	 *
+	 * The returned error is Σ((expected - guess)^2) and its gradient is back
+	 * propagated. When the outputs use the softmax the cross entropy gradient
+	 * is back propagated instead, so the delta of each output is
+	 * guess - expected.
+	 *
+	 * @param p_inputs input layer size x steps
+	 * @param p_expected output layer size x steps
+	 * @param p_learn_rate
+	 * @param p_truncation the steps of each window, 0 means all the sequence
+	 * @param p_update_weights if false the weights will not updated.
+	 * @param r_gradients if not null, it's filled with the delta gradient of
+	 *			each link, in the same order of get_neuron_parent_weight
+	 * @return Returns the sum of the errors of all the steps
+	 */
+	real_t learn(
+			const Matrix &p_inputs,
+			const Matrix &p_expected,
+			real_t p_learn_rate,
+			uint32_t p_truncation = 0,
+			bool p_update_weights = true,
+			std::vector<real_t> *r_gradients = nullptr);
+
+	/**
+	 * @brief update_weights subtracts the delta gradients computed by learn
+	 * @param p_gradients
+	 */
+	void update_weights(const std::vector<real_t> &p_gradients);
+
+	/**
+	 * @brief set_plan_simplification enables or disables the simplification
+	 * of the execution plan. Without it all the neurons used by the outputs
+	 * and all their links are computed, as the learn does.
+	 * @param p_enabled
+	 */
+	void set_plan_simplification(bool p_enabled);
+	bool is_plan_simplification_enabled() const;
+
+	/**
+	 * @brief get_state returns the state used by the guess without state
+	 * @return
+	 */
+	SharpState &get_state() const;
+
+	/**
+	 * @brief is_ready prepares the network if it's not yet ready.
+	 * It's thread safe, but the network must not be modified in the meantime
+	 * @return Returns false if the network is not correctly connected
+	 */
+	bool is_ready() const;
+
 	/**
 	 * @brief The MetadataIndices enum
 	 * First is an uint32_t with the size of the entire buffer
@@ -482,50 +594,104 @@ public:
 	 */
 	virtual bool get_buffer(std::vector<uint8_t> &r_buffer) const;
 
+	/**
+	 * @brief set_model restores the network stored in the model, the arrays
+	 * are copied at once without parsing them and then the plan is compiled
+	 * again, so the network can be modified or trained.
+	 *
+	 * To only evaluate a mapped model, SharpModel::guess runs its stored plan
+	 * in place without any copy.
+	 *
+	 * Use SharpModel::write or SharpModel::save to store the network.
+	 *
+	 * @param p_model
+	 * @return
+	 */
+	bool set_model(const SharpModel &p_model);
+
 private:
 	/**
-	 * @brief is_fully_linked_to_input tell to you if the neuron parents are
-	 * connected to the input
+	 * @brief are_links_walkable tell to you if the network used by the
+	 * outputs doesn't contain loops of non recurrent links.
+	 * It visits each neuron and link once.
 	 *
-	 * @param p_neuron
 	 * @param p_error_on_broken_link if true this function returns false when
 	 * the inputs are not fully connected to the output
 	 * @param p_error_on_dead_branches when this is set to true all the neurons
-	 * must be fully connected to the output
-	 * @param r_cache is usedinternally to detect if there are loops
+	 * must have at least one parent
 	 * @return
 	 */
 	bool are_links_walkable(
-			Neuron *p_neuron,
 			bool p_error_on_broken_link,
-			bool p_error_on_dead_branches,
-			std::vector<NeuronId> &r_cache) const;
+			bool p_error_on_dead_branches) const;
+
+	/**
+	 * @brief place_pending_links moves the pending links in the flat arrays,
+	 * in linear time. It does nothing during the bulk construction.
+	 * It writes the flat arrays, so the caller must be the only user of
+	 * the network.
+	 */
+	void place_pending_links() const;
+
+	/**
+	 * @brief sync_links places the pending links for the const getters,
+	 * under ready_mutex as is_ready does
+	 */
+	void sync_links() const;
 
 	/**
 	 * @brief check_ready
 	 *
 	 * Prepare the network and set the ready variable to true if the network is
 	 * correctly connected and ready to be used.
+	 * It only writes the plan, see is_ready.
 	 */
-	void check_ready();
+	void check_ready() const;
 
 	/**
-	 * @brief randomize_parents_weight is used to randomize the weight between
-	 * the parents and this neuron between a range of -p_range and p_range
-	 *
-	 * @param p_neuron
-	 * @param p_range
+	 * @brief compile_plan builds and simplifies the execution plan, the
+	 * network must be already validated.
 	 */
-	void randomize_parents_weight(Neuron *p_neuron, real_t p_range);
+	void compile_plan() const;
 
 	/**
-	 * @brief set_parents_weight is used to set the weights to all parents of
-	 * this neuron
-	 *
-	 * @param p_neuron
-	 * @param p_weight
+	 * @brief update_plan_weights rebuilds the plan after the weights are
+	 * changed, keeping the recurrent memory of the internal state
+	 */
+	void update_plan_weights();
+
+	/**
+	 * @brief compute_neurons computes the planned neurons in the range
+	 * [p_begin, p_end), with one or many lanes per neuron
+	 * @param r_values the SharpState values
+	 * @param p_lanes
+	 * @param p_begin
+	 * @param p_end
+	 */
+	void compute_neurons(
+			real_t *r_values,
+			uint32_t p_lanes,
+			uint32_t p_begin,
+			uint32_t p_end) const;
+
+	/**
+	 * @brief compute_levels computes all the planned neurons level by level,
+	 * the wide levels are split between the pool threads
+	 * @param r_values the SharpState values
+	 * @param p_lanes
+	 * @param p_pool can be null
+	 */
+	void compute_levels(
+			real_t *r_values,
+			uint32_t p_lanes,
+			ThreadPool *p_pool) const;
+
+	/**
+	 * @brief compute_level_chunk is the ThreadPool task of compute_levels
+	 * @param p_chunk
+	 * @param p_data
 	 */
-	void set_parents_weight(Neuron *p_neuron, real_t p_weight);
+	static void compute_level_chunk(uint32_t p_chunk, void *p_data);
 };
 
 } // namespace brain
@@ -0,0 +1,607 @@
+#include "sharp_model.h"
+
+#include "brain/error_macros.h"
+#include "brain/math/math_funcs.h"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief The ModelHeader struct is the layout of the model header, all its
+ * fields are naturally aligned so it doesn't have padding.
+ * The offsets are in bytes from the start of the model.
+ */
+struct ModelHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t real_size;
+	uint32_t neuron_count;
+	uint32_t link_count;
+	uint32_t input_count;
+	uint32_t output_count;
+	uint32_t plan_neuron_count;
+	uint32_t plan_level_count;
+	uint32_t plan_link_count;
+	uint32_t plan_recurrent_count;
+	uint32_t plan_constant_count;
+	uint32_t padding;
+	uint64_t activations_offset;
+	uint64_t parent_offsets_offset;
+	uint64_t link_parents_offset;
+	uint64_t link_weights_offset;
+	uint64_t link_recurrents_offset;
+	uint64_t inputs_offset;
+	uint64_t outputs_offset;
+	uint64_t plan_neurons_offset;
+	uint64_t plan_level_offsets_offset;
+	uint64_t plan_link_offsets_offset;
+	uint64_t plan_link_sources_offset;
+	uint64_t plan_link_weights_offset;
+	uint64_t plan_recurrent_neurons_offset;
+	uint64_t plan_constant_neurons_offset;
+	uint64_t plan_constant_values_offset;
+	uint64_t model_size;
+};
+
+/// All the sections start at a multiple of this
+static const uint64_t SECTION_ALIGNMENT = 8;
+
+static uint64_t align_section(uint64_t p_offset) {
+	return (p_offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+}
+
+/// The model is little endian and it's used in place, so it's not supported
+/// by big endian machines
+static bool is_host_little_endian() {
+	const uint16_t value(1);
+	return *reinterpret_cast<const uint8_t *>(&value) == 1;
+}
+
+static const ModelHeader *get_header(const uint8_t *p_data) {
+	return reinterpret_cast<const ModelHeader *>(p_data);
+}
+
+/// The arrays can be empty, their data is not used in that case
+template <class T>
+static void copy_section(uint8_t *r_data, uint64_t p_offset, const std::vector<T> &p_array) {
+	if (!p_array.empty())
+		memcpy(r_data + p_offset, p_array.data(), sizeof(T) * p_array.size());
+}
+
+template <class T>
+static const T *get_section(const uint8_t *p_data, uint64_t p_offset) {
+	return reinterpret_cast<const T *>(p_data + p_offset);
+}
+
+brain::SharpModel::SharpModel() :
+		data(nullptr),
+		size(0),
+		mapped(false) {
+}
+
+brain::SharpModel::~SharpModel() {
+	unmap();
+}
+
+bool brain::SharpModel::write(const SharpBrainArea &p_brain_area, std::vector<uint8_t> &r_data) {
+	ERR_FAIL_COND_V(!is_host_little_endian(), false);
+	ERR_FAIL_COND_V(p_brain_area.bulk_construction, false);
+
+	// The plan is stored too, so it must be compiled
+	ERR_FAIL_COND_V(!p_brain_area.is_ready(), false);
+
+	const uint32_t neuron_count = p_brain_area.neuron_activations.size();
+	const uint32_t link_count = p_brain_area.link_parents.size();
+	const uint32_t input_count = p_brain_area.inputs.size();
+	const uint32_t output_count = p_brain_area.outputs.size();
+
+	const uint32_t plan_neuron_count = p_brain_area.plan_neurons.size();
+	const uint32_t plan_level_count = p_brain_area.plan_level_offsets.size() - 1;
+	const uint32_t plan_link_count = p_brain_area.plan_link_sources.size();
+	const uint32_t plan_recurrent_count = p_brain_area.plan_recurrent_neurons.size();
+	const uint32_t plan_constant_count = p_brain_area.plan_constant_neurons.size();
+
+	/// Step 1. Place the sections
+	ModelHeader header;
+	memset(&header, 0, sizeof(ModelHeader));
+
+	header.magic = MAGIC;
+	header.version = VERSION;
+	header.header_size = sizeof(ModelHeader);
+	header.real_size = sizeof(real_t);
+	header.neuron_count = neuron_count;
+	header.link_count = link_count;
+	header.input_count = input_count;
+	header.output_count = output_count;
+	header.plan_neuron_count = plan_neuron_count;
+	header.plan_level_count = plan_level_count;
+	header.plan_link_count = plan_link_count;
+	header.plan_recurrent_count = plan_recurrent_count;
+	header.plan_constant_count = plan_constant_count;
+
+	header.activations_offset = align_section(sizeof(ModelHeader));
+	header.parent_offsets_offset = align_section(header.activations_offset + sizeof(uint32_t) * neuron_count);
+	header.link_parents_offset = align_section(header.parent_offsets_offset + sizeof(uint32_t) * (neuron_count + 1));
+	header.link_weights_offset = align_section(header.link_parents_offset + sizeof(uint32_t) * link_count);
+	header.link_recurrents_offset = align_section(header.link_weights_offset + sizeof(real_t) * link_count);
+	header.inputs_offset = align_section(header.link_recurrents_offset + sizeof(uint8_t) * link_count);
+	header.outputs_offset = align_section(header.inputs_offset + sizeof(uint32_t) * input_count);
+	header.plan_neurons_offset = align_section(header.outputs_offset + sizeof(uint32_t) * output_count);
+	header.plan_level_offsets_offset = align_section(header.plan_neurons_offset + sizeof(uint32_t) * plan_neuron_count);
+	header.plan_link_offsets_offset = align_section(header.plan_level_offsets_offset + sizeof(uint32_t) * (plan_level_count + 1));
+	header.plan_link_sources_offset = align_section(header.plan_link_offsets_offset + sizeof(uint32_t) * (plan_neuron_count + 1));
+	header.plan_link_weights_offset = align_section(header.plan_link_sources_offset + sizeof(uint32_t) * plan_link_count);
+	header.plan_recurrent_neurons_offset = align_section(header.plan_link_weights_offset + sizeof(real_t) * plan_link_count);
+	header.plan_constant_neurons_offset = align_section(header.plan_recurrent_neurons_offset + sizeof(uint32_t) * plan_recurrent_count);
+	header.plan_constant_values_offset = align_section(header.plan_constant_neurons_offset + sizeof(uint32_t) * plan_constant_count);
+	header.model_size = align_section(header.plan_constant_values_offset + sizeof(real_t) * plan_constant_count);
+
+	/// Step 2. Copy the arrays, they have the same layout of the
+	/// SharpBrainArea ones
+	r_data.assign(header.model_size, 0);
+	uint8_t *d = r_data.data();
+
+	memcpy(d, &header, sizeof(ModelHeader));
+
+	uint32_t *activations = reinterpret_cast<uint32_t *>(d + header.activations_offset);
+	for (uint32_t n(0); n < neuron_count; ++n) {
+		activations[n] = p_brain_area.neuron_activations[n];
+	}
+
+	copy_section(d, header.parent_offsets_offset, p_brain_area.parent_offsets);
+	copy_section(d, header.link_parents_offset, p_brain_area.link_parents);
+	copy_section(d, header.link_weights_offset, p_brain_area.link_weights);
+	copy_section(d, header.link_recurrents_offset, p_brain_area.link_recurrents);
+	copy_section(d, header.inputs_offset, p_brain_area.inputs);
+	copy_section(d, header.outputs_offset, p_brain_area.outputs);
+
+	/// Step 3. Copy the plan, the activations of the planned neurons are
+	/// taken from the activations section
+	copy_section(d, header.plan_neurons_offset, p_brain_area.plan_neurons);
+	copy_section(d, header.plan_level_offsets_offset, p_brain_area.plan_level_offsets);
+	copy_section(d, header.plan_link_offsets_offset, p_brain_area.plan_link_offsets);
+	copy_section(d, header.plan_link_sources_offset, p_brain_area.plan_link_sources);
+	copy_section(d, header.plan_link_weights_offset, p_brain_area.plan_link_weights);
+	copy_section(d, header.plan_recurrent_neurons_offset, p_brain_area.plan_recurrent_neurons);
+	copy_section(d, header.plan_constant_neurons_offset, p_brain_area.plan_constant_neurons);
+	copy_section(d, header.plan_constant_values_offset, p_brain_area.plan_constant_values);
+
+	return true;
+}
+
+bool brain::SharpModel::save(const SharpBrainArea &p_brain_area, const std::string &p_path) {
+
+	std::vector<uint8_t> model;
+	ERR_FAIL_COND_V(!write(p_brain_area, model), false);
+
+	std::ofstream file(p_path.c_str(), std::ios::binary);
+	if (!file) {
+		ERR_EXPLAIN("Can't write the model: " + p_path);
+		ERR_FAIL_V(false);
+	}
+
+	file.write(reinterpret_cast<const char *>(model.data()), model.size());
+	ERR_FAIL_COND_V(!file, false);
+
+	return true;
+}
+
+bool brain::SharpModel::map(const std::string &p_path) {
+
+	unmap();
+
+	const int fd = open(p_path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		ERR_EXPLAIN("Can't open the model: " + p_path);
+		ERR_FAIL_V(false);
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size < (off_t)sizeof(ModelHeader)) {
+		close(fd);
+		ERR_EXPLAIN("The model is too small: " + p_path);
+		ERR_FAIL_V(false);
+	}
+
+	void *mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	// The mapping remains valid after closing the file
+	close(fd);
+
+	if (mapping == MAP_FAILED) {
+		ERR_EXPLAIN("Can't map the model: " + p_path);
+		ERR_FAIL_V(false);
+	}
+
+	if (!check_data(static_cast<const uint8_t *>(mapping), file_stat.st_size)) {
+		munmap(mapping, file_stat.st_size);
+		ERR_EXPLAIN("The model is corrupted: " + p_path);
+		ERR_FAIL_V(false);
+	}
+
+	data = static_cast<const uint8_t *>(mapping);
+	size = file_stat.st_size;
+	mapped = true;
+
+	return true;
+}
+
+bool brain::SharpModel::set_data(const uint8_t *p_data, uint64_t p_size) {
+
+	unmap();
+
+	ERR_FAIL_COND_V(reinterpret_cast<uintptr_t>(p_data) % SECTION_ALIGNMENT, false);
+	ERR_FAIL_COND_V(!check_data(p_data, p_size), false);
+
+	data = p_data;
+	size = p_size;
+
+	return true;
+}
+
+void brain::SharpModel::unmap() {
+	if (mapped)
+		munmap(const_cast<uint8_t *>(data), size);
+
+	data = nullptr;
+	size = 0;
+	mapped = false;
+}
+
+bool brain::SharpModel::is_valid() const {
+	return data;
+}
+
+uint32_t brain::SharpModel::get_real_size() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->real_size;
+}
+
+uint32_t brain::SharpModel::get_neuron_count() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->neuron_count;
+}
+
+uint32_t brain::SharpModel::get_link_count() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->link_count;
+}
+
+uint32_t brain::SharpModel::get_input_count() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->input_count;
+}
+
+uint32_t brain::SharpModel::get_output_count() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->output_count;
+}
+
+const uint32_t *brain::SharpModel::get_activations() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return reinterpret_cast<const uint32_t *>(data + get_header(data)->activations_offset);
+}
+
+const uint32_t *brain::SharpModel::get_parent_offsets() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return reinterpret_cast<const uint32_t *>(data + get_header(data)->parent_offsets_offset);
+}
+
+const uint32_t *brain::SharpModel::get_link_parents() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return reinterpret_cast<const uint32_t *>(data + get_header(data)->link_parents_offset);
+}
+
+const real_t *brain::SharpModel::get_link_weights() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	if (get_header(data)->real_size != sizeof(real_t))
+		return nullptr;
+	return reinterpret_cast<const real_t *>(data + get_header(data)->link_weights_offset);
+}
+
+const uint8_t *brain::SharpModel::get_link_recurrents() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return data + get_header(data)->link_recurrents_offset;
+}
+
+const uint32_t *brain::SharpModel::get_inputs() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return reinterpret_cast<const uint32_t *>(data + get_header(data)->inputs_offset);
+}
+
+const uint32_t *brain::SharpModel::get_outputs() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return reinterpret_cast<const uint32_t *>(data + get_header(data)->outputs_offset);
+}
+
+uint32_t brain::SharpModel::get_plan_neuron_count() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->plan_neuron_count;
+}
+
+uint32_t brain::SharpModel::get_plan_level_count() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->plan_level_count;
+}
+
+uint32_t brain::SharpModel::get_plan_link_count() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->plan_link_count;
+}
+
+uint32_t brain::SharpModel::get_plan_recurrent_count() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->plan_recurrent_count;
+}
+
+uint32_t brain::SharpModel::get_plan_constant_count() const {
+	ERR_FAIL_COND_V(!data, 0);
+	return get_header(data)->plan_constant_count;
+}
+
+const uint32_t *brain::SharpModel::get_plan_neurons() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return get_section<uint32_t>(data, get_header(data)->plan_neurons_offset);
+}
+
+const uint32_t *brain::SharpModel::get_plan_level_offsets() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return get_section<uint32_t>(data, get_header(data)->plan_level_offsets_offset);
+}
+
+const uint32_t *brain::SharpModel::get_plan_link_offsets() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return get_section<uint32_t>(data, get_header(data)->plan_link_offsets_offset);
+}
+
+const uint32_t *brain::SharpModel::get_plan_link_sources() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return get_section<uint32_t>(data, get_header(data)->plan_link_sources_offset);
+}
+
+const real_t *brain::SharpModel::get_plan_link_weights() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	if (get_header(data)->real_size != sizeof(real_t))
+		return nullptr;
+	return get_section<real_t>(data, get_header(data)->plan_link_weights_offset);
+}
+
+const uint32_t *brain::SharpModel::get_plan_recurrent_neurons() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return get_section<uint32_t>(data, get_header(data)->plan_recurrent_neurons_offset);
+}
+
+const uint32_t *brain::SharpModel::get_plan_constant_neurons() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	return get_section<uint32_t>(data, get_header(data)->plan_constant_neurons_offset);
+}
+
+const real_t *brain::SharpModel::get_plan_constant_values() const {
+	ERR_FAIL_COND_V(!data, nullptr);
+	if (get_header(data)->real_size != sizeof(real_t))
+		return nullptr;
+	return get_section<real_t>(data, get_header(data)->plan_constant_values_offset);
+}
+
+bool brain::SharpModel::guess(
+		const Matrix &p_input,
+		Matrix &r_guess,
+		SharpState &r_state) const {
+
+	ERR_FAIL_COND_V(!data, false);
+
+	const ModelHeader *header = get_header(data);
+
+	// The weights are used in place, so they must have the size of real_t
+	ERR_FAIL_COND_V(header->real_size != sizeof(real_t), false);
+
+	const uint32_t output_count = header->output_count;
+	ERR_FAIL_COND_V(!output_count, false);
+
+	ERR_FAIL_COND_V(p_input.get_row_count() != int(header->input_count), false);
+	ERR_FAIL_COND_V(p_input.get_column_count() != 1, false);
+
+	r_guess.resize(output_count, 1);
+
+	const uint32_t neuron_count = header->neuron_count;
+	const uint32_t *activations = get_section<uint32_t>(data, header->activations_offset);
+	const uint32_t *inputs = get_section<uint32_t>(data, header->inputs_offset);
+	const uint32_t *outputs = get_section<uint32_t>(data, header->outputs_offset);
+	const uint32_t *plan_neurons = get_section<uint32_t>(data, header->plan_neurons_offset);
+	const uint32_t *link_offsets = get_section<uint32_t>(data, header->plan_link_offsets_offset);
+	const uint32_t *sources = get_section<uint32_t>(data, header->plan_link_sources_offset);
+	const real_t *weights = get_section<real_t>(data, header->plan_link_weights_offset);
+	const uint32_t *recurrent_neurons = get_section<uint32_t>(data, header->plan_recurrent_neurons_offset);
+	const uint32_t *constant_neurons = get_section<uint32_t>(data, header->plan_constant_neurons_offset);
+	const real_t *constant_values = get_section<real_t>(data, header->plan_constant_values_offset);
+
+	// The state is new or it belongs to an old structure
+	if (r_state.values.size() != neuron_count + header->plan_recurrent_count)
+		r_state.values.assign(neuron_count + header->plan_recurrent_count, 0.f);
+
+	real_t *v = r_state.values.data();
+
+	/// Step 1. Save the values read by the recurrent links, before they
+	/// get overwritten by this guess
+	for (uint32_t i(0); i < header->plan_recurrent_count; ++i) {
+		v[neuron_count + i] = v[recurrent_neurons[i]];
+	}
+
+	/// Step 2. Set inputs and constants
+	for (uint32_t i(0); i < header->input_count; ++i) {
+		v[inputs[i]] = p_input.get(i, 0);
+	}
+
+	for (uint32_t i(0); i < header->plan_constant_count; ++i) {
+		v[constant_neurons[i]] = constant_values[i];
+	}
+
+	/// Step 3. Compute the neurons in the plan order, the levels are only
+	/// needed to split the work between threads
+	for (uint32_t n(0); n < header->plan_neuron_count; ++n) {
+		real_t value(0.f);
+		for (uint32_t l(link_offsets[n]); l < link_offsets[n + 1]; ++l) {
+			value += v[sources[l]] * weights[l];
+		}
+
+		// Softmax activation is performed below
+		const uint32_t activation = activations[plan_neurons[n]];
+		v[plan_neurons[n]] = BrainArea::ACTIVATION_SOFTMAX == activation ?
+									 value :
+									 BrainArea::activation_functions[activation](value);
+	}
+
+	/// Step 4. Get outputs
+	for (uint32_t i(0); i < output_count; ++i) {
+		r_guess.set(i, 0, v[outputs[i]]);
+	}
+
+	// Special case for softmax activation function
+	if (BrainArea::ACTIVATION_SOFTMAX == activations[outputs[0]]) {
+
+		const real_t sum_exp(r_guess.exp_summation());
+		for (uint32_t i(0); i < output_count; ++i) {
+
+			const real_t val = brain::Math::soft_max_fast(
+					v[outputs[i]],
+					sum_exp);
+			v[outputs[i]] = val;
+			r_guess.set(i, 0, val);
+		}
+	}
+
+	return true;
+}
+
+bool brain::SharpModel::check_data(const uint8_t *p_data, uint64_t p_size) {
+	ERR_FAIL_COND_V(!is_host_little_endian(), false);
+	ERR_FAIL_COND_V(!p_data, false);
+	ERR_FAIL_COND_V(p_size < sizeof(ModelHeader), false);
+
+	const ModelHeader *header = get_header(p_data);
+
+	ERR_FAIL_COND_V(header->magic != MAGIC, false);
+	ERR_FAIL_COND_V(header->version != VERSION, false);
+	ERR_FAIL_COND_V(header->header_size != sizeof(ModelHeader), false);
+	ERR_FAIL_COND_V(header->real_size != sizeof(float) && header->real_size != sizeof(double), false);
+	ERR_FAIL_COND_V(header->model_size > p_size, false);
+
+	/// Step 1. Each section must be aligned and inside the model
+	const uint64_t neuron_count = header->neuron_count;
+	const uint64_t link_count = header->link_count;
+	const uint64_t plan_neuron_count = header->plan_neuron_count;
+	const uint64_t plan_level_count = header->plan_level_count;
+	const uint64_t plan_link_count = header->plan_link_count;
+	const uint64_t plan_recurrent_count = header->plan_recurrent_count;
+	const uint64_t plan_constant_count = header->plan_constant_count;
+
+	const uint64_t sections[][2] = {
+		{ header->activations_offset, sizeof(uint32_t) * neuron_count },
+		{ header->parent_offsets_offset, sizeof(uint32_t) * (neuron_count + 1) },
+		{ header->link_parents_offset, sizeof(uint32_t) * link_count },
+		{ header->link_weights_offset, header->real_size * link_count },
+		{ header->link_recurrents_offset, sizeof(uint8_t) * link_count },
+		{ header->inputs_offset, sizeof(uint32_t) * uint64_t(header->input_count) },
+		{ header->outputs_offset, sizeof(uint32_t) * uint64_t(header->output_count) },
+		{ header->plan_neurons_offset, sizeof(uint32_t) * plan_neuron_count },
+		{ header->plan_level_offsets_offset, sizeof(uint32_t) * (plan_level_count + 1) },
+		{ header->plan_link_offsets_offset, sizeof(uint32_t) * (plan_neuron_count + 1) },
+		{ header->plan_link_sources_offset, sizeof(uint32_t) * plan_link_count },
+		{ header->plan_link_weights_offset, header->real_size * plan_link_count },
+		{ header->plan_recurrent_neurons_offset, sizeof(uint32_t) * plan_recurrent_count },
+		{ header->plan_constant_neurons_offset, sizeof(uint32_t) * plan_constant_count },
+		{ header->plan_constant_values_offset, header->real_size * plan_constant_count }
+	};
+
+	for (uint32_t i(0); i < sizeof(sections) / sizeof(sections[0]); ++i) {
+		ERR_FAIL_COND_V(sections[i][0] % SECTION_ALIGNMENT, false);
+		ERR_FAIL_COND_V(sections[i][0] < sizeof(ModelHeader), false);
+		ERR_FAIL_COND_V(sections[i][0] > header->model_size, false);
+		ERR_FAIL_COND_V(sections[i][1] > header->model_size - sections[i][0], false);
+	}
+
+	/// Step 2. Check the content, so the ids can be used without checks
+	const uint32_t *activations = reinterpret_cast<const uint32_t *>(p_data + header->activations_offset);
+	for (uint64_t n(0); n < neuron_count; ++n) {
+		ERR_FAIL_COND_V(activations[n] >= BrainArea::ACTIVATION_MAX, false);
+	}
+
+	const uint32_t *parent_offsets = reinterpret_cast<const uint32_t *>(p_data + header->parent_offsets_offset);
+	ERR_FAIL_COND_V(parent_offsets[0] != 0, false);
+	ERR_FAIL_COND_V(parent_offsets[neuron_count] != link_count, false);
+	for (uint64_t n(0); n < neuron_count; ++n) {
+		ERR_FAIL_COND_V(parent_offsets[n] > parent_offsets[n + 1], false);
+	}
+
+	const uint32_t *link_parents = reinterpret_cast<const uint32_t *>(p_data + header->link_parents_offset);
+	for (uint64_t l(0); l < link_count; ++l) {
+		ERR_FAIL_COND_V(link_parents[l] >= neuron_count, false);
+	}
+
+	const uint8_t *link_recurrents = p_data + header->link_recurrents_offset;
+	for (uint64_t l(0); l < link_count; ++l) {
+		ERR_FAIL_COND_V(link_recurrents[l] > 1, false);
+	}
+
+	// A parent can be linked only once to the same child, as add_link does.
+	// `last_child` tells the last child of each parent.
+	std::vector<uint32_t> last_child(neuron_count, UINT32_MAX);
+	for (uint64_t n(0); n < neuron_count; ++n) {
+		for (uint32_t l(parent_offsets[n]); l < parent_offsets[n + 1]; ++l) {
+			ERR_FAIL_COND_V(last_child[link_parents[l]] == n, false);
+			last_child[link_parents[l]] = n;
+		}
+	}
+
+	const uint32_t *inputs = reinterpret_cast<const uint32_t *>(p_data + header->inputs_offset);
+	for (uint32_t i(0); i < header->input_count; ++i) {
+		ERR_FAIL_COND_V(inputs[i] >= neuron_count, false);
+	}
+
+	const uint32_t *outputs = reinterpret_cast<const uint32_t *>(p_data + header->outputs_offset);
+	for (uint32_t i(0); i < header->output_count; ++i) {
+		ERR_FAIL_COND_V(outputs[i] >= neuron_count, false);
+	}
+
+	/// Step 3. Check the plan, the link sources can also read the
+	/// recurrent slots that follow the neurons
+	const uint32_t *plan_neurons = get_section<uint32_t>(p_data, header->plan_neurons_offset);
+	for (uint64_t n(0); n < plan_neuron_count; ++n) {
+		ERR_FAIL_COND_V(plan_neurons[n] >= neuron_count, false);
+	}
+
+	const uint32_t *plan_level_offsets = get_section<uint32_t>(p_data, header->plan_level_offsets_offset);
+	ERR_FAIL_COND_V(plan_level_offsets[0] != 0, false);
+	ERR_FAIL_COND_V(plan_level_offsets[plan_level_count] != plan_neuron_count, false);
+	for (uint64_t l(0); l < plan_level_count; ++l) {
+		ERR_FAIL_COND_V(plan_level_offsets[l] > plan_level_offsets[l + 1], false);
+	}
+
+	const uint32_t *plan_link_offsets = get_section<uint32_t>(p_data, header->plan_link_offsets_offset);
+	ERR_FAIL_COND_V(plan_link_offsets[0] != 0, false);
+	ERR_FAIL_COND_V(plan_link_offsets[plan_neuron_count] != plan_link_count, false);
+	for (uint64_t n(0); n < plan_neuron_count; ++n) {
+		ERR_FAIL_COND_V(plan_link_offsets[n] > plan_link_offsets[n + 1], false);
+	}
+
+	const uint32_t *plan_link_sources = get_section<uint32_t>(p_data, header->plan_link_sources_offset);
+	for (uint64_t l(0); l < plan_link_count; ++l) {
+		ERR_FAIL_COND_V(plan_link_sources[l] >= neuron_count + plan_recurrent_count, false);
+	}
+
+	const uint32_t *plan_recurrent_neurons = get_section<uint32_t>(p_data, header->plan_recurrent_neurons_offset);
+	for (uint64_t i(0); i < plan_recurrent_count; ++i) {
+		ERR_FAIL_COND_V(plan_recurrent_neurons[i] >= neuron_count, false);
+	}
+
+	const uint32_t *plan_constant_neurons = get_section<uint32_t>(p_data, header->plan_constant_neurons_offset);
+	for (uint64_t i(0); i < plan_constant_count; ++i) {
+		ERR_FAIL_COND_V(plan_constant_neurons[i] >= neuron_count, false);
+	}
+
+	return true;
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "brain/brain_areas/sharp_brain_area.h"
+#include <string>
+
+namespace brain {
+
+/**
+ * @brief The SharpModel class is a flat and portable representation of a
+ * SharpBrainArea, that can be used directly from the memory where it's stored.
+ *
+ * The format is little endian and all the sections are aligned to 8 bytes:
+ * - The header, with the magic, the version, the sizes and the offset of
+ *   each section from the start of the model.
+ * - The activation of each neuron, as uint32_t.
+ * - The links stored by child neuron, as the SharpBrainArea does: the
+ *   parent offsets (neuron count + 1), then the parents ids, the weights and
+ *   the recurrent flags (uint8_t).
+ * - The input ids and the output ids.
+ * - The compiled execution plan of the SharpBrainArea: the planned neurons,
+ *   the level offsets, the link offsets, sources and weights, the recurrent
+ *   neurons, the constant neurons and their values.
+ *
+ * Loading a model doesn't parse it: the file is mapped in memory and the
+ * arrays are used in place, after checking that they are consistent.
+ * The guess function of this class runs the stored plan directly from that
+ * memory, so a mapped model is used without copying it and without
+ * compiling the plan again.
+ *
+ * SharpBrainArea::set_model instead copies the arrays and compiles the plan,
+ * use it when the network must be modified or trained.
+ */
+class SharpModel {
+
+	/**
+	 * @brief data points to the model, that can be mapped by this class or
+	 * owned by someone else
+	 */
+	const uint8_t *data;
+	uint64_t size;
+
+	/**
+	 * @brief mapped tells if `data` was mapped by `map`
+	 */
+	bool mapped;
+
+public:
+	static const uint32_t MAGIC = 0x4D485342; // "BSHM"
+	static const uint32_t VERSION = 2;
+
+	SharpModel();
+	~SharpModel();
+
+	/**
+	 * @brief write stores the brain area in the model format, together with
+	 * its execution plan
+	 * @param p_brain_area must be ready
+	 * @param r_data
+	 * @return
+	 */
+	static bool write(const SharpBrainArea &p_brain_area, std::vector<uint8_t> &r_data);
+
+	/**
+	 * @brief save writes the brain area model in a file
+	 * @param p_brain_area
+	 * @param p_path
+	 * @return
+	 */
+	static bool save(const SharpBrainArea &p_brain_area, const std::string &p_path);
+
+	/**
+	 * @brief map maps the model file in memory, read only
+	 * @param p_path
+	 * @return false if the file can't be read or it's not a valid model
+	 */
+	bool map(const std::string &p_path);
+
+	/**
+	 * @brief set_data uses a model stored in memory, the memory is not
+	 * copied so it must remain valid until this model is used
+	 * @param p_data must be aligned to 8 bytes
+	 * @param p_size
+	 * @return false if it's not a valid model
+	 */
+	bool set_data(const uint8_t *p_data, uint64_t p_size);
+
+	/**
+	 * @brief unmap releases the model
+	 */
+	void unmap();
+
+	bool is_valid() const;
+
+	uint32_t get_real_size() const;
+	uint32_t get_neuron_count() const;
+	uint32_t get_link_count() const;
+	uint32_t get_input_count() const;
+	uint32_t get_output_count() const;
+
+	/// The arrays of the model, they point inside the model memory
+	const uint32_t *get_activations() const;
+	const uint32_t *get_parent_offsets() const;
+	const uint32_t *get_link_parents() const;
+
+	/**
+	 * @brief get_link_weights
+	 * @return null when the model uses a real_t of different size
+	 */
+	const real_t *get_link_weights() const;
+	const uint8_t *get_link_recurrents() const;
+	const uint32_t *get_inputs() const;
+	const uint32_t *get_outputs() const;
+
+	/// The execution plan, see SharpBrainArea
+	uint32_t get_plan_neuron_count() const;
+	uint32_t get_plan_level_count() const;
+	uint32_t get_plan_link_count() const;
+	uint32_t get_plan_recurrent_count() const;
+	uint32_t get_plan_constant_count() const;
+
+	const uint32_t *get_plan_neurons() const;
+	const uint32_t *get_plan_level_offsets() const;
+	const uint32_t *get_plan_link_offsets() const;
+	const uint32_t *get_plan_link_sources() const;
+
+	/**
+	 * @brief get_plan_link_weights
+	 * @return null when the model uses a real_t of different size
+	 */
+	const real_t *get_plan_link_weights() const;
+	const uint32_t *get_plan_recurrent_neurons() const;
+	const uint32_t *get_plan_constant_neurons() const;
+
+	/**
+	 * @brief get_plan_constant_values
+	 * @return null when the model uses a real_t of different size
+	 */
+	const real_t *get_plan_constant_values() const;
+
+	/**
+	 * @brief guess runs the stored plan on the model memory, without
+	 * copying it. The result is the same of SharpBrainArea::guess.
+	 * @param p_input the input column
+	 * @param r_guess the output column
+	 * @param r_state the recurrent memory
+	 * @return false when the model uses a real_t of different size
+	 */
+	bool guess(const Matrix &p_input, Matrix &r_guess, SharpState &r_state) const;
+
+private:
+	SharpModel(const SharpModel &) = delete;
+	SharpModel &operator=(const SharpModel &) = delete;
+
+	/**
+	 * @brief check_data tells if the passed memory contains a valid model,
+	 * it checks all the ids so the model can be used without other checks
+	 * @param p_data
+	 * @param p_size
+	 * @return
+	 */
+	static bool check_data(const uint8_t *p_data, uint64_t p_size);
+};
+
+} // namespace brain
@@ -0,0 +1,401 @@
+#include "sharp_native_area.h"
+
+#include "brain/NEAT/neat_genome.h"
+#include "brain/error_macros.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fstream>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+/**
+ * @brief The NativeReal struct contains the names used by the generated code
+ * for the real_t type in use.
+ */
+struct NativeReal {
+	const char *type;
+	const char *suffix;
+	const char *exp;
+	const char *tanh;
+	const char *pow;
+	const char *format;
+};
+
+#ifdef REAL_T_IS_DOUBLE
+static const NativeReal native_real = { "double", "", "exp", "tanh", "pow", "%.17g" };
+#else
+static const NativeReal native_real = { "float", "f", "expf", "tanhf", "powf", "%.9g" };
+#endif
+
+/// Writes the real as a literal that is parsed back to the same value
+static std::string real_literal(real_t p_value) {
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), native_real.format, double(p_value));
+
+	std::string literal(buffer);
+	if (literal.find_first_of(".e") == std::string::npos)
+		literal += ".0";
+
+	return literal + native_real.suffix;
+}
+
+static std::string value_name(brain::NeuronId p_neuron_id) {
+	return "v" + brain::itos(p_neuron_id);
+}
+
+brain::SharpNativeArea::SharpNativeArea() :
+		library(nullptr),
+		guess_function(nullptr),
+		input_size(0),
+		output_size(0),
+		state_size(0) {
+}
+
+brain::SharpNativeArea::~SharpNativeArea() {
+	unload();
+}
+
+bool brain::SharpNativeArea::generate_source(
+		const SharpBrainArea &p_brain_area,
+		std::string &r_source) {
+
+	ERR_FAIL_COND_V(!p_brain_area.is_ready(), false);
+
+	const uint32_t state_size =
+			p_brain_area.get_neuron_count() +
+			p_brain_area.plan_recurrent_neurons.size();
+
+	r_source = "// Generated by brain::SharpNativeArea, don't edit\n\n";
+	r_source += "#include <math.h>\n";
+	r_source += "#include <stdint.h>\n\n";
+	r_source += "typedef " + std::string(native_real.type) + " native_real_t;\n\n";
+
+	ERR_FAIL_COND_V(!generate_code(
+							p_brain_area,
+							"extern \"C\" void brain_native_guess(const native_real_t *p_input, native_real_t *r_output, native_real_t *r_state)",
+							r_source),
+			false);
+
+	// The info used by `load` to check the library
+	r_source += "\nextern \"C\" void brain_native_get_info(uint32_t *r_info) {\n";
+	r_source += "\tr_info[0] = sizeof(native_real_t);\n";
+	r_source += "\tr_info[1] = " + itos(p_brain_area.get_input_layer_size()) + ";\n";
+	r_source += "\tr_info[2] = " + itos(p_brain_area.get_output_layer_size()) + ";\n";
+	r_source += "\tr_info[3] = " + itos(state_size) + ";\n";
+	r_source += "}\n";
+
+	return true;
+}
+
+bool brain::SharpNativeArea::generate_header(
+		const SharpBrainArea &p_brain_area,
+		const std::string &p_namespace,
+		std::string &r_header) {
+
+	ERR_FAIL_COND_V(!p_brain_area.is_ready(), false);
+	ERR_FAIL_COND_V(p_namespace.empty(), false);
+
+	const uint32_t state_size =
+			p_brain_area.get_neuron_count() +
+			p_brain_area.plan_recurrent_neurons.size();
+
+	r_header = "// Generated by brain::SharpNativeArea, don't edit\n\n";
+	r_header += "#pragma once\n\n";
+	r_header += "#include <math.h>\n";
+	r_header += "#include <stdint.h>\n\n";
+	r_header += "namespace " + p_namespace + " {\n\n";
+	r_header += "typedef " + std::string(native_real.type) + " native_real_t;\n\n";
+	r_header += "static const uint32_t INPUT_SIZE = " + itos(p_brain_area.get_input_layer_size()) + ";\n";
+	r_header += "static const uint32_t OUTPUT_SIZE = " + itos(p_brain_area.get_output_layer_size()) + ";\n";
+	r_header += "static const uint32_t STATE_SIZE = " + itos(state_size) + ";\n\n";
+
+	ERR_FAIL_COND_V(!generate_code(
+							p_brain_area,
+							"inline void guess(const native_real_t *p_input, native_real_t *r_output, native_real_t *r_state)",
+							r_header),
+			false);
+
+	r_header += "\n} // namespace " + p_namespace + "\n";
+
+	return true;
+}
+
+bool brain::SharpNativeArea::generate_code(
+		const SharpBrainArea &p_brain_area,
+		const std::string &p_function_declaration,
+		std::string &r_code) {
+
+	const std::vector<uint32_t> &offsets = p_brain_area.plan_link_offsets;
+	const std::vector<uint32_t> &sources = p_brain_area.plan_link_sources;
+	const std::vector<real_t> &weights = p_brain_area.plan_link_weights;
+
+	for (auto it = weights.begin(); it != weights.end(); ++it) {
+		if (!std::isfinite(*it)) {
+			ERR_EXPLAIN("The network has a weight that is not finite, it can't be written as a constant");
+			ERR_FAIL_V(false);
+		}
+	}
+
+	for (auto it = p_brain_area.plan_constant_values.begin(); it != p_brain_area.plan_constant_values.end(); ++it) {
+		if (!std::isfinite(*it)) {
+			ERR_EXPLAIN("The network has a constant neuron that is not finite");
+			ERR_FAIL_V(false);
+		}
+	}
+
+	const std::string type(native_real.type);
+	const std::string zero(real_literal(0));
+	const std::string one(real_literal(1));
+
+	/// Step 1. The activation functions, they are the same of brain::Math
+	r_code += "static inline " + type + " activation_sigmoid(" + type + " x) { return " + one + " / (" + one + " + " + native_real.exp + "(-x)); }\n";
+	r_code += "static inline " + type + " activation_relu(" + type + " x) { return x > " + zero + " ? x : " + zero + "; }\n";
+	r_code += "static inline " + type + " activation_leaky_relu(" + type + " x) { return x < " + zero + " ? x * " + real_literal(0.01) + " : x; }\n";
+	r_code += "static inline " + type + " activation_tanh(" + type + " x) { return " + native_real.tanh + "(x); }\n";
+	r_code += "static inline " + type + " activation_linear(" + type + " x) { return x; }\n";
+	r_code += "static inline " + type + " activation_binary_step(" + type + " x) { return x < " + zero + " ? " + zero + " : " + one + "; }\n\n";
+
+	static const char *activation_names[] = {
+		"activation_sigmoid",
+		"activation_relu",
+		"activation_leaky_relu",
+		"activation_tanh",
+		"activation_linear",
+		"activation_binary_step",
+		// Softmax is performed on the outputs
+		"activation_linear"
+	};
+
+	const uint32_t neuron_count = p_brain_area.get_neuron_count();
+	const std::vector<NeuronId> &inputs = p_brain_area.inputs;
+	const std::vector<NeuronId> &outputs = p_brain_area.outputs;
+	const std::vector<NeuronId> &recurrent_neurons = p_brain_area.plan_recurrent_neurons;
+
+	r_code += p_function_declaration + " {\n";
+
+	/// Step 2. Read the values of the previous guess
+	for (uint32_t i(0); i < recurrent_neurons.size(); ++i) {
+		r_code += "\tconst " + type + " r" + itos(i) + " = r_state[" + itos(recurrent_neurons[i]) + "];\n";
+	}
+
+	/// Step 3. Read the inputs and write the constants
+	for (uint32_t i(0); i < inputs.size(); ++i) {
+		r_code += "\tconst " + type + " " + value_name(inputs[i]) + " = p_input[" + itos(i) + "];\n";
+	}
+
+	for (uint32_t i(0); i < p_brain_area.plan_constant_neurons.size(); ++i) {
+		r_code += "\tconst " + type + " " + value_name(p_brain_area.plan_constant_neurons[i]) + " = " +
+				  real_literal(p_brain_area.plan_constant_values[i]) + ";\n";
+	}
+
+	/// Step 4. Compute the neurons in the plan order, each one is a single
+	/// expression summed in the same order of SharpBrainArea::guess
+	for (uint32_t n(0); n < p_brain_area.plan_neurons.size(); ++n) {
+		const NeuronId id = p_brain_area.plan_neurons[n];
+
+		std::string sum(zero);
+		for (uint32_t l(offsets[n]); l < offsets[n + 1]; ++l) {
+			const std::string source = sources[l] < neuron_count ?
+											   value_name(sources[l]) :
+											   "r" + itos(sources[l] - neuron_count);
+
+			sum += " + " + source + " * " + real_literal(weights[l]);
+		}
+
+		r_code += "\tconst " + type + " " + value_name(id) + " = " +
+				  activation_names[p_brain_area.neuron_activations[id]] + "(" + sum + ");\n";
+	}
+
+	/// Step 5. Write the outputs, the final value of each neuron is stored
+	/// as the SharpBrainArea does
+	std::vector<std::string> final_names(neuron_count);
+	for (uint32_t n(0); n < p_brain_area.plan_neurons.size(); ++n) {
+		final_names[p_brain_area.plan_neurons[n]] = value_name(p_brain_area.plan_neurons[n]);
+	}
+
+	for (uint32_t i(0); i < p_brain_area.plan_constant_neurons.size(); ++i) {
+		final_names[p_brain_area.plan_constant_neurons[i]] = value_name(p_brain_area.plan_constant_neurons[i]);
+	}
+
+	if (BrainArea::ACTIVATION_SOFTMAX == p_brain_area.neuron_activations[outputs[0]]) {
+
+		r_code += "\t" + type + " sum_exp(" + zero + ");\n";
+		for (uint32_t i(0); i < outputs.size(); ++i) {
+			r_code += "\tsum_exp += " + std::string(native_real.exp) + "(" + value_name(outputs[i]) + ");\n";
+		}
+
+		for (uint32_t i(0); i < outputs.size(); ++i) {
+			final_names[outputs[i]] = "o" + itos(i);
+			r_code += "\tconst " + type + " o" + itos(i) + " = " +
+					  native_real.pow + "(" + real_literal(Math_E) + ", " + value_name(outputs[i]) + ") / sum_exp;\n";
+		}
+	}
+
+	for (uint32_t i(0); i < outputs.size(); ++i) {
+		r_code += "\tr_output[" + itos(i) + "] = " + final_names[outputs[i]] + ";\n";
+	}
+
+	/// Step 6. Store the values read by the next guess
+	for (uint32_t i(0); i < recurrent_neurons.size(); ++i) {
+		r_code += "\tr_state[" + itos(recurrent_neurons[i]) + "] = " + final_names[recurrent_neurons[i]] + ";\n";
+	}
+
+	r_code += "}\n";
+
+	return true;
+}
+
+bool brain::SharpNativeArea::compile(
+		const SharpBrainArea &p_brain_area,
+		const std::string &p_library_path,
+		const std::string &p_compiler) {
+
+	unload();
+
+	std::string source;
+	ERR_FAIL_COND_V(!generate_source(p_brain_area, source), false);
+
+	const std::string source_path = p_library_path + ".cpp";
+
+	{
+		std::ofstream file(source_path.c_str());
+		if (!file) {
+			ERR_EXPLAIN("Can't write the native source: " + source_path);
+			ERR_FAIL_V(false);
+		}
+		file << source;
+	}
+
+	// The contraction in FMA is disabled, so the result doesn't change from
+	// the one of SharpBrainArea.
+	// The compiler is spawned without a shell, so the paths are passed as
+	// they are and can't be interpreted
+	const char *const arguments[] = {
+		p_compiler.c_str(),
+		"-O2",
+		"-ffp-contract=off",
+		"-shared",
+		"-fPIC",
+		"-o",
+		p_library_path.c_str(),
+		source_path.c_str(),
+		nullptr
+	};
+
+	pid_t pid;
+	if (posix_spawnp(&pid, p_compiler.c_str(), nullptr, nullptr, const_cast<char *const *>(arguments), environ) != 0) {
+		ERR_EXPLAIN("Can't run the native compiler: " + p_compiler);
+		ERR_FAIL_V(false);
+	}
+
+	int status(0);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		ERR_EXPLAIN("The native compilation failed: " + source_path);
+		ERR_FAIL_V(false);
+	}
+
+	return load(p_library_path);
+}
+
+bool brain::SharpNativeArea::compile(
+		const NtGenome &p_genome,
+		const std::string &p_library_path,
+		const std::string &p_compiler) {
+
+	SharpBrainArea brain_area;
+	p_genome.generate_neural_network(brain_area);
+
+	return compile(brain_area, p_library_path, p_compiler);
+}
+
+bool brain::SharpNativeArea::load(const std::string &p_library_path) {
+
+	unload();
+
+	library = dlopen(p_library_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!library) {
+		ERR_EXPLAIN("Can't load the native library: " + std::string(dlerror()));
+		ERR_FAIL_V(false);
+	}
+
+	typedef void (*native_get_info_func)(uint32_t *r_info);
+
+	native_get_info_func get_info = (native_get_info_func)dlsym(library, "brain_native_get_info");
+	guess_function = (native_guess_func)dlsym(library, "brain_native_guess");
+
+	if (!get_info || !guess_function) {
+		unload();
+		ERR_EXPLAIN("The library is not a native brain area: " + p_library_path);
+		ERR_FAIL_V(false);
+	}
+
+	uint32_t info[4];
+	get_info(info);
+
+	if (info[0] != sizeof(real_t)) {
+		unload();
+		ERR_EXPLAIN("The native library uses a different real_t size: " + p_library_path);
+		ERR_FAIL_V(false);
+	}
+
+	input_size = info[1];
+	output_size = info[2];
+	state_size = info[3];
+
+	return true;
+}
+
+void brain::SharpNativeArea::unload() {
+	if (library)
+		dlclose(library);
+
+	library = nullptr;
+	guess_function = nullptr;
+	input_size = 0;
+	output_size = 0;
+	state_size = 0;
+	state.values.clear();
+}
+
+bool brain::SharpNativeArea::is_loaded() const {
+	return guess_function;
+}
+
+uint32_t brain::SharpNativeArea::get_input_layer_size() const {
+	return input_size;
+}
+
+uint32_t brain::SharpNativeArea::get_output_layer_size() const {
+	return output_size;
+}
+
+bool brain::SharpNativeArea::guess(
+		const Matrix &p_input,
+		Matrix &r_guess) const {
+
+	return guess(p_input, r_guess, state);
+}
+
+bool brain::SharpNativeArea::guess(
+		const Matrix &p_input,
+		Matrix &r_guess,
+		SharpState &r_state) const {
+
+	ERR_FAIL_COND_V(!guess_function, false);
+	ERR_FAIL_COND_V(p_input.get_row_count() != input_size, false);
+	ERR_FAIL_COND_V(p_input.get_column_count() != 1, false);
+
+	r_guess.resize(output_size, 1);
+
+	// The state is new or it belongs to another network
+	if (r_state.values.size() != state_size)
+		r_state.values.assign(state_size, 0.f);
+
+	guess_function(p_input.get_matrix(), r_guess.get_matrix_mutable(), r_state.values.data());
+
+	return true;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "brain/brain_areas/sharp_brain_area.h"
+#include <string>
+
+namespace brain {
+
+class NtGenome;
+
+/**
+ * @brief The SharpNativeArea class executes a SharpBrainArea compiled to
+ * native code.
+ *
+ * The network is translated to straight line C++: each neuron becomes an
+ * expression with the weights as constants, without loops or indirection.
+ * The source is then built by the system compiler in a shared object that
+ * is loaded with `dlopen`.
+ *
+ * The generated code computes exactly what SharpBrainArea::guess computes,
+ * and its state has the same layout of the SharpState, so the recurrent
+ * memory is kept in the same way.
+ *
+ * The network is specialized, so any change to the SharpBrainArea requires
+ * a new compilation.
+ */
+class SharpNativeArea {
+
+	typedef void (*native_guess_func)(const real_t *p_input, real_t *r_output, real_t *r_state);
+
+	void *library;
+	native_guess_func guess_function;
+
+	uint32_t input_size;
+	uint32_t output_size;
+	uint32_t state_size;
+
+	/**
+	 * @brief state used by the guess function that doesn't take a state
+	 */
+	mutable SharpState state;
+
+public:
+	SharpNativeArea();
+	~SharpNativeArea();
+
+	/**
+	 * @brief generate_source writes the source of the shared object, it
+	 * exports the C functions loaded by `load`
+	 * @param p_brain_area must be ready
+	 * @param r_source
+	 * @return
+	 */
+	static bool generate_source(const SharpBrainArea &p_brain_area, std::string &r_source);
+
+	/**
+	 * @brief generate_header writes a self contained header, that can be
+	 * compiled directly in another program. All its content is put inside
+	 * the passed namespace, the network is executed by calling:
+	 *
+	 * `p_namespace::guess(const real_t *input, real_t *output, real_t *state)`
+	 *
+	 * where the state has `p_namespace::STATE_SIZE` elements, initialized
+	 * to zero.
+	 *
+	 * @param p_brain_area must be ready
+	 * @param p_namespace
+	 * @param r_header
+	 * @return
+	 */
+	static bool generate_header(
+			const SharpBrainArea &p_brain_area,
+			const std::string &p_namespace,
+			std::string &r_header);
+
+	/**
+	 * @brief compile generates the source of the brain area, builds it and
+	 * loads the library.
+	 *
+	 * The source is written next to the library, with `.cpp` appended.
+	 * The compiler is executed directly, without a shell.
+	 *
+	 * @param p_brain_area
+	 * @param p_library_path
+	 * @param p_compiler the compiler executable, searched in the PATH
+	 * @return
+	 */
+	bool compile(
+			const SharpBrainArea &p_brain_area,
+			const std::string &p_library_path,
+			const std::string &p_compiler = "c++");
+
+	/**
+	 * @brief compile the neural network of the genome
+	 * @param p_genome
+	 * @param p_library_path
+	 * @param p_compiler the compiler executable, searched in the PATH
+	 * @return
+	 */
+	bool compile(
+			const NtGenome &p_genome,
+			const std::string &p_library_path,
+			const std::string &p_compiler = "c++");
+
+	/**
+	 * @brief load a library already compiled
+	 * @param p_library_path
+	 * @return
+	 */
+	bool load(const std::string &p_library_path);
+
+	void unload();
+
+	bool is_loaded() const;
+
+	uint32_t get_input_layer_size() const;
+	uint32_t get_output_layer_size() const;
+
+	/**
+	 * @brief guess has the same behaviour of SharpBrainArea::guess
+	 * @param p_input Input data
+	 * @param r_guess result
+	 * @return
+	 */
+	bool guess(
+			const Matrix &p_input,
+			Matrix &r_guess) const;
+
+	/**
+	 * @brief guess has the same behaviour of SharpBrainArea::guess, it's
+	 * safe to call it from many threads each one with its own state
+	 * @param p_input Input data
+	 * @param r_guess result
+	 * @param r_state
+	 * @return
+	 */
+	bool guess(
+			const Matrix &p_input,
+			Matrix &r_guess,
+			SharpState &r_state) const;
+
+private:
+	SharpNativeArea(const SharpNativeArea &) = delete;
+	SharpNativeArea &operator=(const SharpNativeArea &) = delete;
+
+	/**
+	 * @brief generate_code writes the activation functions and the guess
+	 * function, shared by the source and the header
+	 * @param p_brain_area
+	 * @param p_function_declaration
+	 * @param r_code
+	 * @return
+	 */
+	static bool generate_code(
+			const SharpBrainArea &p_brain_area,
+			const std::string &p_function_declaration,
+			std::string &r_code);
+};
+
+} // namespace brain
@@ -2,6 +2,8 @@
 
 #include "brain/error_macros.h"
 #include "brain/math/math_funcs.h"
+#include "brain/math/matrix_kernels.h"
+#include <algorithm>
 
 #define INPUT_INDEX 0
 #define HIDDEN_INDEX(layer) (layer + 1)
@@ -96,7 +98,7 @@ void brain::UniformBrainArea::set_hidden_layers_count(uint32_t p_count) {
 	activations.resize(p_count + 2 - 1);
 
 	set_layer_size(OUTPUT_INDEX, prev_size_output_layer);
-	activations[OUTPUT_INDEX] = prev_activ_output_layer;
+	activations[ACTIVATION_INDEX(OUTPUT_INDEX)] = prev_activ_output_layer;
 }
 
 uint32_t brain::UniformBrainArea::get_hidden_layers_count() const {
@@ -185,6 +187,80 @@ void brain::UniformBrainArea::set_layer_activation(int p_layer, Activation p_act
 	activations[ACTIVATION_INDEX(p_layer)] = p_activation;
 }
 
+/**
+ * @brief activate applies the activation function in place, the kernel is
+ * picked one time per layer.
+ */
+static _FORCE_INLINE_ void activate(
+		brain::BrainArea::Activation p_activation,
+		real_t *r_data,
+		uint32_t p_size) {
+
+	brain::BrainArea::activation_kernels[p_activation](r_data, r_data, p_size);
+}
+
+/**
+ * @brief activate_batch applies the activation function in place to a
+ * layer of a batch, where each column is a sample.
+ *
+ * The element wise functions don't care about the layout, while the softmax
+ * is normalized per column.
+ */
+static void activate_batch(
+		brain::BrainArea::Activation p_activation,
+		real_t *r_data,
+		uint32_t p_rows,
+		uint32_t p_columns) {
+
+	if (p_activation != brain::BrainArea::ACTIVATION_SOFTMAX) {
+		activate(p_activation, r_data, p_rows * p_columns);
+		return;
+	}
+
+	/// Subtract the max of each column, so the exponentials can't overflow
+	for (uint32_t c(0); c < p_columns; ++c) {
+		real_t max = r_data[c];
+		for (uint32_t r(1); r < p_rows; ++r)
+			max = MAX(max, r_data[r * p_columns + c]);
+		for (uint32_t r(0); r < p_rows; ++r)
+			r_data[r * p_columns + c] -= max;
+	}
+
+	brain::kernels::exp(r_data, r_data, p_rows * p_columns);
+
+	for (uint32_t c(0); c < p_columns; ++c) {
+		real_t summ(0);
+		for (uint32_t r(0); r < p_rows; ++r)
+			summ += r_data[r * p_columns + c];
+		const real_t inv_summ = real_t(1) / summ;
+		for (uint32_t r(0); r < p_rows; ++r)
+			r_data[r * p_columns + c] *= inv_summ;
+	}
+}
+
+/**
+ * @brief compute_derivative computes the derivative of the layer, when
+ * possible it's computed from the cached output to not activate again.
+ */
+static void compute_derivative(
+		brain::BrainArea::Activation p_activation,
+		const real_t *p_input,
+		const real_t *p_output,
+		real_t *r_derivative,
+		uint32_t p_size) {
+
+	switch (p_activation) {
+		case brain::BrainArea::ACTIVATION_SIGMOID:
+			brain::kernels::sigmoid_derivative_from_output(p_output, r_derivative, p_size);
+			break;
+		case brain::BrainArea::ACTIVATION_TANH:
+			brain::kernels::tanh_derivative_from_output(p_output, r_derivative, p_size);
+			break;
+		default:
+			brain::BrainArea::derivative_kernels[p_activation](p_input, r_derivative, p_size);
+	}
+}
+
 real_t brain::UniformBrainArea::learn(
 		const Matrix &p_input,
 		const Matrix &p_expected,
@@ -228,9 +304,10 @@ real_t brain::UniformBrainArea::learn(
 		r_gradients->biases.resize(biases.size());
 	}
 
-	const bool is_using_shared_cache = r_ld;
-	if (!is_using_shared_cache) {
-		r_ld = new LearningData;
+	if (!r_ld) {
+		// Reused between the calls, so the learning doesn't allocate
+		static thread_local LearningData learning_data;
+		r_ld = &learning_data;
 	}
 
 	/// --- Take the NN output ---
@@ -240,69 +317,296 @@ real_t brain::UniformBrainArea::learn(
 
 	/// --- Back propagation phase ---
 
-	Matrix propagated_error = p_expected - guess_res;
+	const uint32_t output_size = get_layer_size(OUTPUT_INDEX);
+	const real_t *guess = guess_res.get_matrix();
+	const real_t *expected = p_expected.get_matrix();
+
+	r_ld->layer_error.resize(output_size);
 
 	// Total error = Σ((expected - guess)^2)
-	real_t total_error = propagated_error.mapped(brain::Math::pow, 2).summation();
+	real_t total_error(0);
+	for (uint32_t i(0); i < output_size; ++i) {
+		r_ld->layer_error[i] = expected[i] - guess[i];
+		total_error += r_ld->layer_error[i] * r_ld->layer_error[i];
+	}
 
-	Matrix layer_error;
 	for (int layer(get_layer_count() - 1); 1 <= layer; --layer) {
 
-		layer_error = propagated_error;
-
-		/// Step 1. Progate the error backward.
-		if (layer > 0) {
-			// Skip for the penultimate layer since we are done.
-			propagated_error =
-					weights[WEIGHT_INDEX(layer - 1)].transposed() * propagated_error;
+		const Matrix &w = weights[WEIGHT_INDEX(layer - 1)];
+		const uint32_t layer_size = w.get_row_count();
+		const uint32_t prev_layer_size = w.get_column_count();
+		const Activation activation = activations[ACTIVATION_INDEX(layer)];
+
+		DEBUG_ONLY(ERR_FAIL_COND_V(activation == ACTIVATION_MAX, 10000));
+
+		/// Step 1. Progate the error backward: W^T * error
+		/// Skip for the first layer since we are done.
+		if (layer > 1) {
+			r_ld->propagated_error.resize(prev_layer_size);
+			kernels::gemv_t(
+					w.get_matrix(),
+					r_ld->layer_error.data(),
+					r_ld->propagated_error.data(),
+					layer_size,
+					prev_layer_size);
 		}
 
 		/// Step 2. Calculate the layer input signal derivative
-		Matrix derivative = r_ld->layers_input_signal[layer];
+		r_ld->gradient.resize(layer_size);
+		real_t *gradient = r_ld->gradient.data();
+		const real_t *error = r_ld->layer_error.data();
 
-		if (activations[ACTIVATION_INDEX(layer)] == ACTIVATION_SOFTMAX) {
+		if (activation == ACTIVATION_SOFTMAX) {
 
 			/// This is a special gradient (cost function) calculation when
 			/// the soft max activation function is used
 			/// Explanation:
 			///		https://www.youtube.com/watch?v=mlaLLQofmR8
 			///		https://math.stackexchange.com/questions/945871/derivative-of-softmax-loss-function
-			derivative = layer_error;
+			std::copy(error, error + layer_size, gradient);
 
 		} else {
 
-			DEBUG_ONLY(ERR_FAIL_COND_V(activations[ACTIVATION_INDEX(layer)] == ACTIVATION_MAX, 10000));
-			derivative.map(activation_derivatives[activations[ACTIVATION_INDEX(layer)]]);
+			compute_derivative(
+					activation,
+					r_ld->layers_input_signal[layer].get_matrix(),
+					r_ld->layers_output_signal[layer].get_matrix(),
+					gradient,
+					layer_size);
 		}
 
-		const Matrix transposed_output_prev_layer(r_ld->layers_output_signal[layer - 1].transposed());
-
 		/// Step 3. Calculate the gradient
-		/// Note: The output is multiplied later for performance reason
-		Matrix &gradient = derivative;
-		gradient.element_wise_multiplicate(layer_error);
-
-		/// Step 4. Scake and multipling with -1 since we have a minus at the
+		/// Step 4. Scale and multiply with -1 since we have a minus at the
 		/// start of the equation
-		gradient *= -p_learn_rate;
+		/// Note: The output is multiplied later, by the rank-1 update
+		for (uint32_t i(0); i < layer_size; ++i) {
+			gradient[i] *= error[i] * -p_learn_rate;
+		}
+
+		const real_t *output_prev_layer = r_ld->layers_output_signal[layer - 1].get_matrix();
+
+		if (r_gradients) {
+			Matrix &delta_weights = r_gradients->weights[WEIGHT_INDEX(layer - 1)];
+			delta_weights.resize(layer_size, prev_layer_size);
+			kernels::ger(
+					gradient,
+					output_prev_layer,
+					delta_weights.get_matrix_mutable(),
+					layer_size,
+					prev_layer_size,
+					1,
+					false);
+
+			Matrix &delta_biases = r_gradients->biases[BIAS_INDEX(layer - 1)];
+			delta_biases.resize(layer_size, 1);
+			delta_biases.unsafe_set(gradient);
+		}
 
 		/// Step 5. Update phase
 		if (p_update_weights) {
 			// Subtract the gradient since we want to descent the slope
-			weights[WEIGHT_INDEX(layer - 1)] -= gradient * transposed_output_prev_layer;
-			biases[BIAS_INDEX(layer - 1)] -= gradient;
+			kernels::ger(
+					gradient,
+					output_prev_layer,
+					weights[WEIGHT_INDEX(layer - 1)].get_matrix_mutable(),
+					layer_size,
+					prev_layer_size,
+					-1);
+
+			real_t *b = biases[BIAS_INDEX(layer - 1)].get_matrix_mutable();
+			for (uint32_t i(0); i < layer_size; ++i) {
+				b[i] -= gradient[i];
+			}
 		}
 
-		if (r_gradients) {
-			r_gradients->weights[WEIGHT_INDEX(layer - 1)] = gradient * transposed_output_prev_layer;
-			r_gradients->biases[BIAS_INDEX(layer - 1)] = gradient;
+		r_ld->layer_error.swap(r_ld->propagated_error);
+	}
+
+	return total_error;
+}
+
+real_t brain::UniformBrainArea::learn_batch(
+		const Matrix &p_inputs,
+		const Matrix &p_expected,
+		real_t p_learn_rate,
+		bool p_update_weights,
+		DeltaGradients *r_gradients,
+		BatchLearningData *r_cache) {
+
+	ERR_FAIL_COND_V(p_inputs.get_column_count() == 0, 0);
+
+	if (!r_gradients) {
+		static thread_local DeltaGradients gradients;
+		r_gradients = &gradients;
+	}
+
+	if (!r_cache) {
+		static thread_local BatchLearningData cache;
+		r_cache = &cache;
+	}
+
+	const real_t total_error = _learn_batch(
+			p_inputs,
+			p_expected,
+			p_learn_rate,
+			*r_gradients,
+			*r_cache);
+
+	*r_gradients /= p_inputs.get_column_count();
+
+	if (p_update_weights)
+		update_weights(*r_gradients);
+
+	return total_error;
+}
+
+real_t brain::UniformBrainArea::_learn_batch(
+		const Matrix &p_inputs,
+		const Matrix &p_expected,
+		real_t p_learn_rate,
+		DeltaGradients &r_gradients,
+		BatchLearningData &r_ld) const {
+
+	///
+	/// This is the same back propagation performed by `learn`, check it
+	/// for the explanation. Here each column is a sample so all the
+	/// operations are performed on the entire batch.
+	///
+	/// The gradient of the weights is the sum of the gradients of each
+	/// sample, that is: gradient * output_previous_layer^T
+	///
+
+	const uint32_t samples = p_inputs.get_column_count();
+
+	ERR_FAIL_COND_V(p_inputs.get_row_count() != get_layer_size(INPUT_INDEX), 10000);
+	ERR_FAIL_COND_V(p_expected.get_row_count() != get_layer_size(OUTPUT_INDEX), 10000);
+	ERR_FAIL_COND_V(p_expected.get_column_count() != samples, 10000);
+
+	r_gradients.weights.resize(weights.size());
+	r_gradients.biases.resize(biases.size());
+
+	r_ld.layers_input_signal.resize(get_layer_count());
+	r_ld.layers_output_signal.resize(get_layer_count());
+	r_ld.layers_input_signal[0] = p_inputs;
+	r_ld.layers_output_signal[0] = p_inputs;
+
+	/// --- Forward phase ---
+
+	for (int layer(0); layer < weights.size(); ++layer) {
+
+		const Matrix &w = weights[WEIGHT_INDEX(layer)];
+		const real_t *bias = biases[BIAS_INDEX(layer)].get_matrix();
+		const uint32_t layer_size = w.get_row_count();
+		const Activation activation = activations[ACTIVATION_INDEX(layer + 1)];
+
+		DEBUG_ONLY(ERR_FAIL_COND_V(activation == ACTIVATION_MAX, 10000));
+
+		Matrix &input_signal = r_ld.layers_input_signal[layer + 1];
+		input_signal.resize(layer_size, samples);
+		real_t *z = input_signal.get_matrix_mutable();
+
+		for (uint32_t r(0); r < layer_size; ++r) {
+			std::fill(z + r * samples, z + (r + 1) * samples, bias[r]);
 		}
+
+		kernels::gemm(
+				w.get_matrix(),
+				r_ld.layers_output_signal[layer].get_matrix(),
+				z,
+				layer_size,
+				w.get_column_count(),
+				samples,
+				true);
+
+		Matrix &output_signal = r_ld.layers_output_signal[layer + 1];
+		output_signal.resize(layer_size, samples);
+		output_signal.unsafe_set(z);
+
+		activate_batch(activation, output_signal.get_matrix_mutable(), layer_size, samples);
+	}
+
+	/// --- Back propagation phase ---
+
+	const uint32_t output_count = get_layer_size(OUTPUT_INDEX) * samples;
+	const real_t *guess = r_ld.layers_output_signal[get_layer_count() - 1].get_matrix();
+	const real_t *expected = p_expected.get_matrix();
+
+	r_ld.layer_error.resize(output_count);
+
+	real_t total_error(0);
+	for (uint32_t i(0); i < output_count; ++i) {
+		r_ld.layer_error[i] = expected[i] - guess[i];
+		total_error += r_ld.layer_error[i] * r_ld.layer_error[i];
 	}
 
-	if (!is_using_shared_cache) {
-		// Clear cache
-		delete r_ld;
-		r_ld = nullptr;
+	for (int layer(get_layer_count() - 1); 1 <= layer; --layer) {
+
+		const Matrix &w = weights[WEIGHT_INDEX(layer - 1)];
+		const uint32_t layer_size = w.get_row_count();
+		const uint32_t prev_layer_size = w.get_column_count();
+		const uint32_t count = layer_size * samples;
+		const Activation activation = activations[ACTIVATION_INDEX(layer)];
+
+		/// Step 1. Progate the error backward: W^T * error
+		if (layer > 1) {
+			r_ld.propagated_error.resize(prev_layer_size * samples);
+
+			kernels::gemm_tn(
+					w.get_matrix(),
+					r_ld.layer_error.data(),
+					r_ld.propagated_error.data(),
+					prev_layer_size,
+					layer_size,
+					samples);
+		}
+
+		/// Step 2. Calculate the gradient: derivative * error * -learning rate
+		r_ld.gradient.resize(count);
+		real_t *gradient = r_ld.gradient.data();
+		const real_t *error = r_ld.layer_error.data();
+
+		if (activation == ACTIVATION_SOFTMAX) {
+			// See `learn` for the explanation of this special case
+			for (uint32_t i(0); i < count; ++i) {
+				gradient[i] = error[i] * error[i] * -p_learn_rate;
+			}
+		} else {
+			compute_derivative(
+					activation,
+					r_ld.layers_input_signal[layer].get_matrix(),
+					r_ld.layers_output_signal[layer].get_matrix(),
+					gradient,
+					count);
+			for (uint32_t i(0); i < count; ++i) {
+				gradient[i] *= error[i] * -p_learn_rate;
+			}
+		}
+
+		/// Step 3. Sum the gradients of all samples
+		/// weights: gradient * output_previous_layer^T
+		/// biases: gradient rows summation
+		Matrix &delta_weights = r_gradients.weights[WEIGHT_INDEX(layer - 1)];
+		delta_weights.resize(layer_size, prev_layer_size);
+		kernels::gemm_nt(
+				gradient,
+				r_ld.layers_output_signal[layer - 1].get_matrix(),
+				delta_weights.get_matrix_mutable(),
+				layer_size,
+				samples,
+				prev_layer_size);
+
+		Matrix &delta_biases = r_gradients.biases[BIAS_INDEX(layer - 1)];
+		delta_biases.resize(layer_size, 1);
+		real_t *db = delta_biases.get_matrix_mutable();
+		for (uint32_t r(0); r < layer_size; ++r) {
+			real_t t(0);
+			for (uint32_t c(0); c < samples; ++c) {
+				t += gradient[r * samples + c];
+			}
+			db[r] = t;
+		}
+
+		r_ld.layer_error.swap(r_ld.propagated_error);
 	}
 
 	return total_error;
@@ -313,7 +617,7 @@ void brain::UniformBrainArea::update_weights(const DeltaGradients &p_gradients)
 	ERR_FAIL_COND(p_gradients.weights.size() != weights.size());
 	ERR_FAIL_COND(p_gradients.biases.size() != biases.size());
 
-	for (int l(0); l < get_layer_count(); ++l) {
+	for (int l(0); l < weights.size(); ++l) {
 
 		// Subtract the gradient since we want to descent the slope
 		weights[WEIGHT_INDEX(l)] -= p_gradients.weights[WEIGHT_INDEX(l)];
@@ -328,47 +632,206 @@ bool brain::UniformBrainArea::guess(
 	return _guess(p_input, r_guess);
 }
 
+bool brain::UniformBrainArea::guess(
+		const Matrix &p_input,
+		Matrix &r_guess,
+		GuessWorkspace &r_workspace) const {
+
+	return _guess(p_input, r_guess, nullptr, &r_workspace);
+}
+
 bool brain::UniformBrainArea::_guess(
 		const Matrix &p_input,
-		Matrix &r_data,
-		LearningData *p_ld) const {
+		Matrix &r_guess,
+		LearningData *r_ld,
+		GuessWorkspace *r_workspace) const {
 
 	ERR_FAIL_COND_V(p_input.get_row_count() != get_layer_size(INPUT_INDEX), false);
 	ERR_FAIL_COND_V(p_input.get_column_count() != 1, false);
 
-	r_data = p_input;
+	///
+	/// Each layer is computed with a single fused pass (weights * input + bias)
+	/// and then activated in place.
+	///
+	/// The intermediate layers are written in the learning data, when
+	/// provided, or in the workspace; the buffers are reused between the calls
+	/// so a steady state guess doesn't allocate any memory.
+	///
+
+	if (r_ld) {
+		r_ld->layers_input_signal.resize(get_layer_count());
+		r_ld->layers_output_signal.resize(get_layer_count());
+		r_ld->layers_input_signal[0] = p_input;
+		r_ld->layers_output_signal[0] = p_input;
+
+	} else {
+
+		if (!r_workspace) {
+			static thread_local GuessWorkspace workspace;
+			r_workspace = &workspace;
+		}
 
-	if (p_ld) {
-		p_ld->layers_input_signal.resize(get_layer_count());
-		p_ld->layers_output_signal.resize(get_layer_count());
-		p_ld->layers_input_signal[0] = r_data;
-		p_ld->layers_output_signal[0] = r_data;
+		uint32_t biggest_layer(0);
+		for (int l(1); l < get_layer_count(); ++l) {
+			biggest_layer = MAX(biggest_layer, get_layer_size(l));
+		}
+
+		// Doesn't shrink, so the memory is allocated only the first time
+		r_workspace->buffers[0].resize(biggest_layer);
+		r_workspace->buffers[1].resize(biggest_layer);
 	}
 
+	const int last_layer = weights.size() - 1;
+
+	// The guess can't be written in place if it's also the input
+	const bool write_guess = &r_guess != &p_input;
+
+	const real_t *layer_input = p_input.get_matrix();
+
 	for (int layer(0); layer < weights.size(); ++layer) {
 
-		// Move the data forward to the next layer
-		r_data = (weights[WEIGHT_INDEX(layer)] * r_data) + biases[BIAS_INDEX(layer)];
+		const Matrix &w = weights[WEIGHT_INDEX(layer)];
+		const uint32_t layer_size = w.get_row_count();
+		const Activation activation = activations[ACTIVATION_INDEX(layer + 1)];
+
+		DEBUG_ONLY(ERR_FAIL_COND_V(activation == ACTIVATION_MAX, false));
 
-		if (p_ld)
-			p_ld->layers_input_signal[layer + 1] = r_data;
+		real_t *layer_output;
 
-		// Compute next layer activation
-		DEBUG_ONLY(ERR_FAIL_COND_V(activations[ACTIVATION_INDEX(layer + 1)] == ACTIVATION_MAX, false));
+		if (r_ld) {
 
-		if (activations[ACTIVATION_INDEX(layer + 1)] == ACTIVATION_SOFTMAX) {
+			Matrix &input_signal = r_ld->layers_input_signal[layer + 1];
+			input_signal.resize(layer_size, 1);
 
-			const real_t summ = r_data.exp_summation();
-			r_data.map(brain::Math::soft_max_fast, summ);
+			kernels::gemv_bias(
+					w.get_matrix(),
+					layer_input,
+					biases[BIAS_INDEX(layer)].get_matrix(),
+					input_signal.get_matrix_mutable(),
+					layer_size,
+					w.get_column_count());
+
+			// Copy the data instead of sharing the buffer, so writing the
+			// output doesn't trigger the copy on write
+			Matrix &output_signal = r_ld->layers_output_signal[layer + 1];
+			output_signal.resize(layer_size, 1);
+			output_signal.unsafe_set(input_signal.get_matrix());
+			layer_output = output_signal.get_matrix_mutable();
 
 		} else {
 
-			r_data.map(
-					activation_functions[activations[ACTIVATION_INDEX(layer + 1)]]);
+			if (layer == last_layer && write_guess) {
+				r_guess.resize(layer_size, 1);
+				layer_output = r_guess.get_matrix_mutable();
+			} else {
+				// Ping pong between the two buffers
+				layer_output = r_workspace->buffers[layer % 2].data();
+			}
+
+			kernels::gemv_bias(
+					w.get_matrix(),
+					layer_input,
+					biases[BIAS_INDEX(layer)].get_matrix(),
+					layer_output,
+					layer_size,
+					w.get_column_count());
 		}
 
-		if (p_ld)
-			p_ld->layers_output_signal[layer + 1] = r_data;
+		activate(activation, layer_output, layer_size);
+
+		layer_input = layer_output;
+	}
+
+	if (r_ld) {
+		r_guess = r_ld->layers_output_signal[get_layer_count() - 1];
+	} else if (!write_guess) {
+		r_guess.resize(get_layer_size(OUTPUT_INDEX), 1);
+		r_guess.unsafe_set(layer_input);
+	}
+
+	return true;
+}
+
+bool brain::UniformBrainArea::guess_batch(
+		const Matrix &p_inputs,
+		Matrix &r_outputs,
+		GuessWorkspace *r_workspace) const {
+
+	ERR_FAIL_COND_V(p_inputs.get_row_count() != get_layer_size(INPUT_INDEX), false);
+
+	const uint32_t samples = p_inputs.get_column_count();
+
+	if (!samples) {
+		r_outputs.resize(get_layer_size(OUTPUT_INDEX), 0);
+		return true;
+	}
+
+	if (!r_workspace) {
+		static thread_local GuessWorkspace workspace;
+		r_workspace = &workspace;
+	}
+
+	uint32_t biggest_layer(0);
+	for (int l(1); l < get_layer_count(); ++l) {
+		biggest_layer = MAX(biggest_layer, get_layer_size(l));
+	}
+
+	// Doesn't shrink, so the memory is allocated only the first time
+	r_workspace->buffers[0].resize(biggest_layer * samples);
+	r_workspace->buffers[1].resize(biggest_layer * samples);
+
+	const int last_layer = weights.size() - 1;
+
+	// The outputs can't be written in place if they are also the inputs
+	const bool write_outputs = &r_outputs != &p_inputs;
+
+	const real_t *layer_input = p_inputs.get_matrix();
+
+	for (int layer(0); layer < weights.size(); ++layer) {
+
+		const Matrix &w = weights[WEIGHT_INDEX(layer)];
+		const real_t *bias = biases[BIAS_INDEX(layer)].get_matrix();
+		const uint32_t layer_size = w.get_row_count();
+		const Activation activation = activations[ACTIVATION_INDEX(layer + 1)];
+
+		DEBUG_ONLY(ERR_FAIL_COND_V(activation == ACTIVATION_MAX, false));
+
+		real_t *layer_output;
+		if (layer == last_layer && write_outputs) {
+			r_outputs.resize(layer_size, samples);
+			layer_output = r_outputs.get_matrix_mutable();
+		} else {
+			// Ping pong between the two buffers
+			layer_output = r_workspace->buffers[layer % 2].data();
+		}
+
+		/// Step 1. Broadcast the bias to all the samples
+		for (uint32_t r(0); r < layer_size; ++r) {
+			std::fill(
+					layer_output + r * samples,
+					layer_output + (r + 1) * samples,
+					bias[r]);
+		}
+
+		/// Step 2. Accumulate the weighted inputs of the entire batch
+		kernels::gemm(
+				w.get_matrix(),
+				layer_input,
+				layer_output,
+				layer_size,
+				w.get_column_count(),
+				samples,
+				true);
+
+		/// Step 3. Activate
+		activate_batch(activation, layer_output, layer_size, samples);
+
+		layer_input = layer_output;
+	}
+
+	if (!write_outputs) {
+		r_outputs.resize(get_layer_size(OUTPUT_INDEX), samples);
+		r_outputs.unsafe_set(layer_input);
 	}
 
 	return true;
@@ -43,6 +43,50 @@ public:
 		 * @brief layers_output has the actived data
 		 */
 		std::vector<brain::Matrix> layers_output_signal;
+
+		/**
+		 * @brief scratch buffers of the back propagation
+		 */
+		std::vector<real_t> layer_error;
+		std::vector<real_t> propagated_error;
+		std::vector<real_t> gradient;
+	};
+
+	/**
+	 * @brief The BatchLearningData struct holds the information used during
+	 * the learning phase of a batch, each column is a sample.
+	 *
+	 * Reusing it between the calls the buffers are allocated only once.
+	 */
+	struct BatchLearningData {
+
+		/**
+		 * @brief layers_input has the not yet actived data
+		 */
+		std::vector<brain::Matrix> layers_input_signal;
+
+		/**
+		 * @brief layers_output has the actived data
+		 */
+		std::vector<brain::Matrix> layers_output_signal;
+
+		/**
+		 * @brief scratch buffers of the back propagation
+		 */
+		std::vector<real_t> layer_error;
+		std::vector<real_t> propagated_error;
+		std::vector<real_t> gradient;
+	};
+
+	/**
+	 * @brief The GuessWorkspace struct holds the intermediate layers data
+	 * of the forward pass.
+	 *
+	 * Reusing the same workspace between the calls, the guess doesn't
+	 * perform any memory allocation.
+	 */
+	struct GuessWorkspace {
+		std::vector<real_t> buffers[2];
 	};
 
 private:
@@ -130,7 +174,7 @@ public:
 	 *			Useful when you need to take the delta weight
 	 * @param r_gradients if not null, it's filled with the delta gradients
 	 *			calculated, then is possible to use them in
-	 * @param r_cache if null the cache is cleared for each call
+	 * @param r_cache if null an internal per thread cache is used
 	 * @return Returns the error of this guess, 0 == Accurate
 	 *
 	 * This function can be used to train the brain area.
@@ -145,6 +189,50 @@ public:
 			DeltaGradients *r_gradients = NULL,
 			LearningData *r_cache = NULL);
 
+	/**
+	 * @brief learn_batch performs the mini batch gradient descent on the
+	 * entire batch at once, each column of the inputs and of the expected
+	 * is a sample.
+	 *
+	 * The result is the same of calling `learn` for each sample, summing
+	 * the gradients and dividing them by the samples count; but the forward
+	 * and the backward passes are performed using matrix matrix products.
+	 *
+	 * @param p_inputs input layer size x samples count
+	 * @param p_expected output layer size x samples count
+	 * @param p_learn_rate
+	 * @param p_update_weights if false the weights will not updated.
+	 * @param r_gradients if not null, it's filled with the averaged delta
+	 *			gradients
+	 * @param r_cache if null an internal per thread cache is used
+	 * @return Returns the sum of the errors of all the samples
+	 */
+	real_t learn_batch(
+			const Matrix &p_inputs,
+			const Matrix &p_expected,
+			real_t p_learn_rate,
+			bool p_update_weights = true,
+			DeltaGradients *r_gradients = NULL,
+			BatchLearningData *r_cache = NULL);
+
+	/**
+	 * @brief _learn_batch computes the gradients of the batch without
+	 * touching the weights, so it's possible to call it from many threads.
+	 *
+	 * @param p_inputs
+	 * @param p_expected
+	 * @param p_learn_rate
+	 * @param r_gradients filled with the sum of the gradients of all samples
+	 * @param r_cache
+	 * @return Returns the sum of the errors of all the samples
+	 */
+	real_t _learn_batch(
+			const Matrix &p_inputs,
+			const Matrix &p_expected,
+			real_t p_learn_rate,
+			DeltaGradients &r_gradients,
+			BatchLearningData &r_cache) const;
+
 	/**
 	 * @brief update_weights can be used to updated the weights using the DeltaGradients.
 	 * This function is useful to perform Batch or mini batch gradient descent
@@ -159,16 +247,47 @@ public:
 	 * @param r_guess result
 	 * @param r_ld is the learning data, pass null if you don't need to know
 	 *			these info
+	 * @param r_workspace the buffers used for the intermediate layers, when
+	 *			null an internal per thread workspace is used
 	 */
 	bool _guess(
 			const Matrix &p_input,
 			Matrix &r_guess,
-			LearningData *r_ld = nullptr) const;
+			LearningData *r_ld = nullptr,
+			GuessWorkspace *r_workspace = nullptr) const;
 
 	virtual bool guess(
 			const Matrix &p_input,
 			Matrix &r_guess) const;
 
+	/**
+	 * @brief guess using a caller provided workspace
+	 * @param p_input
+	 * @param r_guess
+	 * @param r_workspace
+	 */
+	bool guess(
+			const Matrix &p_input,
+			Matrix &r_guess,
+			GuessWorkspace &r_workspace) const;
+
+	/**
+	 * @brief guess_batch computes the guess of many samples at once
+	 *
+	 * Each column of the inputs is a sample, the outputs have one column
+	 * per sample too. The layers are computed using matrix matrix
+	 * multiplications across the whole batch.
+	 *
+	 * @param p_inputs input layer size x samples count
+	 * @param r_outputs output layer size x samples count
+	 * @param r_workspace the buffers used for the intermediate layers, when
+	 *			null an internal per thread workspace is used
+	 */
+	bool guess_batch(
+			const Matrix &p_inputs,
+			Matrix &r_outputs,
+			GuessWorkspace *r_workspace = nullptr) const;
+
 	/**
 	 * @brief The MetadataIndices enum
 	 * First is an uint32_t with the size of the entire buffer
@@ -0,0 +1,130 @@
+#include "uniform_parallel_trainer.h"
+
+#include "brain/error_macros.h"
+#include <utility>
+
+brain::UniformParallelTrainer::UniformParallelTrainer(
+		UniformBrainArea *p_brain_area,
+		uint32_t p_thread_count) :
+		brain_area(p_brain_area),
+		pool(p_thread_count),
+		batch_inputs(nullptr),
+		batch_expected(nullptr),
+		batch_learn_rate(0),
+		reduction_stride(0) {
+
+	workers.resize(pool.get_thread_count());
+}
+
+real_t brain::UniformParallelTrainer::learn_batch(
+		const Matrix &p_inputs,
+		const Matrix &p_expected,
+		real_t p_learn_rate,
+		bool p_update_weights,
+		UniformBrainArea::DeltaGradients *r_gradients) {
+
+	ERR_FAIL_COND_V(!brain_area, 0);
+	ERR_FAIL_COND_V(p_inputs.get_column_count() == 0, 0);
+	ERR_FAIL_COND_V(p_inputs.get_column_count() != p_expected.get_column_count(), 0);
+
+	batch_inputs = &p_inputs;
+	batch_expected = &p_expected;
+	batch_learn_rate = p_learn_rate;
+
+	/// Step 1. Each worker computes the gradients of its slice
+	pool.parallel_for(workers.size(), learn_slice, this);
+
+	/// Step 2. Tree reduction, at each level the worker `i` absorbs the
+	/// worker `i + stride`; the pairs of the same level are independent.
+	const uint32_t worker_count = workers.size();
+	for (reduction_stride = 1; reduction_stride < worker_count; reduction_stride *= 2) {
+		const uint32_t pairs = (worker_count + reduction_stride * 2 - 1) / (reduction_stride * 2);
+		pool.parallel_for(pairs, reduce_pair, this);
+	}
+
+	batch_inputs = nullptr;
+	batch_expected = nullptr;
+
+	/// Step 3. Average and update
+	Worker &root = workers[0];
+	ERR_FAIL_COND_V(!root.has_samples, 0);
+
+	root.gradients /= p_inputs.get_column_count();
+
+	if (p_update_weights)
+		brain_area->update_weights(root.gradients);
+
+	if (r_gradients)
+		*r_gradients = root.gradients;
+
+	return root.error;
+}
+
+void brain::UniformParallelTrainer::learn_slice(uint32_t p_worker, void *p_data) {
+	UniformParallelTrainer *self = static_cast<UniformParallelTrainer *>(p_data);
+	Worker &worker = self->workers[p_worker];
+
+	const Matrix &inputs = *self->batch_inputs;
+	const Matrix &expected = *self->batch_expected;
+
+	uint32_t begin, end;
+	ThreadPool::get_chunk(
+			p_worker,
+			self->workers.size(),
+			inputs.get_column_count(),
+			begin,
+			end);
+
+	worker.error = 0;
+	worker.has_samples = begin < end;
+
+	if (!worker.has_samples)
+		return;
+
+	const uint32_t samples = end - begin;
+
+	/// Copy the slice columns, the matrices are row major
+	worker.inputs.resize(inputs.get_row_count(), samples);
+	for (uint32_t r(0); r < inputs.get_row_count(); ++r) {
+		worker.inputs.unsafe_set_row(r, inputs.get_matrix() + r * inputs.get_column_count() + begin);
+	}
+
+	worker.expected.resize(expected.get_row_count(), samples);
+	for (uint32_t r(0); r < expected.get_row_count(); ++r) {
+		worker.expected.unsafe_set_row(r, expected.get_matrix() + r * expected.get_column_count() + begin);
+	}
+
+	worker.error = self->brain_area->_learn_batch(
+			worker.inputs,
+			worker.expected,
+			self->batch_learn_rate,
+			worker.gradients,
+			worker.learning_data);
+}
+
+void brain::UniformParallelTrainer::reduce_pair(uint32_t p_pair, void *p_data) {
+	UniformParallelTrainer *self = static_cast<UniformParallelTrainer *>(p_data);
+
+	const uint32_t a = p_pair * self->reduction_stride * 2;
+	const uint32_t b = a + self->reduction_stride;
+
+	if (b >= self->workers.size())
+		return;
+
+	Worker &worker_a = self->workers[a];
+	Worker &worker_b = self->workers[b];
+
+	if (!worker_b.has_samples)
+		return;
+
+	if (worker_a.has_samples) {
+		worker_a.gradients += worker_b.gradients;
+		worker_a.error += worker_b.error;
+	} else {
+		// When the batch is smaller than the workers count, some slices
+		// are empty
+		std::swap(worker_a.gradients, worker_b.gradients);
+		worker_a.error = worker_b.error;
+		worker_a.has_samples = true;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "brain/brain_areas/uniform_brain_area.h"
+#include "brain/thread_pool.h"
+#include <vector>
+
+namespace brain {
+
+/**
+ * @brief The UniformParallelTrainer class trains a UniformBrainArea using
+ * many threads.
+ *
+ * Each mini batch is split in contiguous slices of samples, one per worker;
+ * each worker computes the gradients of its slice with its own scratch
+ * buffers, then the gradients are combined using a tree reduction and
+ * the weights are updated.
+ *
+ * The slices and the reduction order depend only on the batch size and on
+ * the thread count, so given the same thread count the result is
+ * deterministic.
+ */
+class UniformParallelTrainer {
+
+	struct Worker {
+		Matrix inputs;
+		Matrix expected;
+		UniformBrainArea::BatchLearningData learning_data;
+		UniformBrainArea::DeltaGradients gradients;
+		real_t error;
+		bool has_samples;
+	};
+
+	UniformBrainArea *brain_area;
+	ThreadPool pool;
+	std::vector<Worker> workers;
+
+	/// The data of the batch in execution
+	const Matrix *batch_inputs;
+	const Matrix *batch_expected;
+	real_t batch_learn_rate;
+	uint32_t reduction_stride;
+
+public:
+	/**
+	 * @brief UniformParallelTrainer
+	 * @param p_brain_area the brain area to train
+	 * @param p_thread_count the threads count, 0 means one thread per core
+	 */
+	UniformParallelTrainer(UniformBrainArea *p_brain_area, uint32_t p_thread_count = 0);
+
+	uint32_t get_thread_count() const { return pool.get_thread_count(); }
+
+	/**
+	 * @brief learn_batch has the same behaviour of
+	 * UniformBrainArea::learn_batch, but the batch is split between the
+	 * threads.
+	 *
+	 * @param p_inputs input layer size x samples count
+	 * @param p_expected output layer size x samples count
+	 * @param p_learn_rate
+	 * @param p_update_weights if false the weights will not updated.
+	 * @param r_gradients if not null, it's filled with the averaged delta
+	 *			gradients
+	 * @return Returns the sum of the errors of all the samples
+	 */
+	real_t learn_batch(
+			const Matrix &p_inputs,
+			const Matrix &p_expected,
+			real_t p_learn_rate,
+			bool p_update_weights = true,
+			UniformBrainArea::DeltaGradients *r_gradients = NULL);
+
+private:
+	static void learn_slice(uint32_t p_worker, void *p_data);
+	static void reduce_pair(uint32_t p_pair, void *p_data);
+};
+
+} // namespace brain
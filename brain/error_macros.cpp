@@ -30,8 +30,8 @@
 
 #include "error_macros.h"
 
-bool brain::_err_error_exists = false;
-std::string brain::_last_error("");
+thread_local bool brain::_err_error_exists = false;
+thread_local std::string brain::_last_error("");
 
 static brain::ErrorHandlerList *error_handler_list = NULL;
 
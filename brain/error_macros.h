@@ -64,8 +64,9 @@ void _err_print_index_error(const char *p_function, const char *p_file, int p_li
 
 /** An index has failed if m_index<0 or m_index >=m_size, the function exists */
 
-extern bool _err_error_exists;
-extern std::string _last_error;
+/** The last error is per thread, so the checks can run concurrently */
+extern thread_local bool _err_error_exists;
+extern thread_local std::string _last_error;
 } // namespace brain
 
 #ifndef _STR
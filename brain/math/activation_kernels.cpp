@@ -0,0 +1,174 @@
+#include "activation_kernels.h"
+
+#include "brain/math/matrix_kernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86_ENABLED
+#endif
+
+/// The scalar kernels are the same code using vectors of one element.
+#define KERNEL_NAMESPACE scalar
+#define KERNEL_VECTOR_BYTES sizeof(real_t)
+#include "activation_kernels.inc"
+#undef KERNEL_NAMESPACE
+#undef KERNEL_VECTOR_BYTES
+
+#ifdef KERNELS_X86_ENABLED
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#define KERNEL_NAMESPACE sse
+#define KERNEL_VECTOR_BYTES 16
+#include "activation_kernels.inc"
+#undef KERNEL_NAMESPACE
+#undef KERNEL_VECTOR_BYTES
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define KERNEL_NAMESPACE avx2
+#define KERNEL_VECTOR_BYTES 32
+#include "activation_kernels.inc"
+#undef KERNEL_NAMESPACE
+#undef KERNEL_VECTOR_BYTES
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#define KERNEL_NAMESPACE avx512
+#define KERNEL_VECTOR_BYTES 64
+#include "activation_kernels.inc"
+#undef KERNEL_NAMESPACE
+#undef KERNEL_VECTOR_BYTES
+#pragma GCC pop_options
+
+#endif
+
+namespace {
+
+struct ActivationTable {
+	brain::kernels::activation_kernel exp;
+	brain::kernels::activation_kernel sigmoid;
+	brain::kernels::activation_kernel relu;
+	brain::kernels::activation_kernel leaky_relu;
+	brain::kernels::activation_kernel tanh;
+	brain::kernels::activation_kernel binary_step;
+	brain::kernels::activation_kernel softmax;
+	brain::kernels::activation_kernel sigmoid_derivative;
+	brain::kernels::activation_kernel relu_derivative;
+	brain::kernels::activation_kernel leaky_relu_derivative;
+	brain::kernels::activation_kernel tanh_derivative;
+	brain::kernels::activation_kernel one;
+	brain::kernels::activation_kernel softmax_derivative;
+	brain::kernels::activation_kernel sigmoid_derivative_from_output;
+	brain::kernels::activation_kernel tanh_derivative_from_output;
+};
+
+#define ACTIVATION_TABLE(m_namespace) \
+	{                                 \
+		m_namespace::exp,             \
+		m_namespace::sigmoid,         \
+		m_namespace::relu,            \
+		m_namespace::leaky_relu,      \
+		m_namespace::tanh,            \
+		m_namespace::binary_step,     \
+		m_namespace::softmax,         \
+		m_namespace::sigmoid_derivative, \
+		m_namespace::relu_derivative, \
+		m_namespace::leaky_relu_derivative, \
+		m_namespace::tanh_derivative, \
+		m_namespace::one,             \
+		m_namespace::softmax_derivative, \
+		m_namespace::sigmoid_derivative_from_output, \
+		m_namespace::tanh_derivative_from_output \
+	}
+
+const ActivationTable activation_tables[brain::kernels::ISA_MAX] = {
+	ACTIVATION_TABLE(scalar),
+#ifdef KERNELS_X86_ENABLED
+	ACTIVATION_TABLE(sse),
+	ACTIVATION_TABLE(avx2),
+	ACTIVATION_TABLE(avx512),
+#else
+	ACTIVATION_TABLE(scalar),
+	ACTIVATION_TABLE(scalar),
+	ACTIVATION_TABLE(scalar),
+#endif
+};
+
+_FORCE_INLINE_ const ActivationTable &table() {
+	return activation_tables[brain::kernels::get_isa()];
+}
+
+} // namespace
+
+void brain::kernels::exp(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().exp(p_x, r_y, p_size);
+}
+
+void brain::kernels::sigmoid(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().sigmoid(p_x, r_y, p_size);
+}
+
+void brain::kernels::relu(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().relu(p_x, r_y, p_size);
+}
+
+void brain::kernels::leaky_relu(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().leaky_relu(p_x, r_y, p_size);
+}
+
+void brain::kernels::tanh(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().tanh(p_x, r_y, p_size);
+}
+
+void brain::kernels::linear(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	if (p_x != r_y)
+		std::copy(p_x, p_x + p_size, r_y);
+}
+
+void brain::kernels::binary_step(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().binary_step(p_x, r_y, p_size);
+}
+
+void brain::kernels::softmax(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().softmax(p_x, r_y, p_size);
+}
+
+void brain::kernels::sigmoid_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().sigmoid_derivative(p_x, r_y, p_size);
+}
+
+void brain::kernels::relu_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().relu_derivative(p_x, r_y, p_size);
+}
+
+void brain::kernels::leaky_relu_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().leaky_relu_derivative(p_x, r_y, p_size);
+}
+
+void brain::kernels::tanh_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().tanh_derivative(p_x, r_y, p_size);
+}
+
+void brain::kernels::linear_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().one(p_x, r_y, p_size);
+}
+
+void brain::kernels::binary_step_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().one(p_x, r_y, p_size);
+}
+
+void brain::kernels::softmax_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size) {
+	table().softmax_derivative(p_x, r_y, p_size);
+}
+
+void brain::kernels::sigmoid_derivative_from_output(const real_t *p_output, real_t *r_y, uint32_t p_size) {
+	table().sigmoid_derivative_from_output(p_output, r_y, p_size);
+}
+
+void brain::kernels::tanh_derivative_from_output(const real_t *p_output, real_t *r_y, uint32_t p_size) {
+	table().tanh_derivative_from_output(p_output, r_y, p_size);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "brain/math/math_defs.h"
+#include "brain/typedefs.h"
+
+namespace brain {
+
+/**
+ * The activation kernels apply an activation function, or its derivative,
+ * to an entire buffer at once.
+ *
+ * All of them have the same signature: r_y[i] = f(p_x[i]), so they can be
+ * stored in tables; p_x and r_y can point to the same buffer to work in place.
+ *
+ * As the matrix kernels they have a vectorized version for each supported
+ * instruction set, picked using the ISA selected in `matrix_kernels.h`.
+ */
+namespace kernels {
+
+typedef void (*activation_kernel)(const real_t *p_x, real_t *r_y, uint32_t p_size);
+
+void exp(const real_t *p_x, real_t *r_y, uint32_t p_size);
+
+void sigmoid(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void relu(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void leaky_relu(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void tanh(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void linear(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void binary_step(const real_t *p_x, real_t *r_y, uint32_t p_size);
+
+/**
+ * @brief softmax normalizes the entire buffer, it's computed subtracting
+ * the max value so the exponentials can't overflow.
+ */
+void softmax(const real_t *p_x, real_t *r_y, uint32_t p_size);
+
+/// The derivatives accept the not activated input
+void sigmoid_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void relu_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void leaky_relu_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void tanh_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void linear_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size);
+void binary_step_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size);
+
+/// Accepts the softmax output
+void softmax_derivative(const real_t *p_x, real_t *r_y, uint32_t p_size);
+
+/// These derivatives accept the already activated output, so they don't
+/// need to compute the activation again.
+void sigmoid_derivative_from_output(const real_t *p_output, real_t *r_y, uint32_t p_size);
+void tanh_derivative_from_output(const real_t *p_output, real_t *r_y, uint32_t p_size);
+
+} // namespace kernels
+} // namespace brain
@@ -2,7 +2,10 @@
 
 #include "brain/error_macros.h"
 #include "brain/math/math_funcs.h"
+#include "brain/math/matrix_kernels.h"
 #include <algorithm>
+#include <atomic>
+#include <new>
 
 #define GET_ID(row, col) (row * columns + col)
 #define TRANSPOSED_GET_ID(row, col) (col * rows + row)
@@ -13,6 +16,29 @@
 
 #define ELEMENT matrix[i]
 
+/// The buffer is prefixed by its reference counter, the offset keeps the
+/// data aligned as returned by the allocator.
+#define BUFFER_HEADER_SIZE 16
+#define BUFFER_REFCOUNT(m_data) (reinterpret_cast<std::atomic<uint32_t> *>(reinterpret_cast<uint8_t *>(m_data) - BUFFER_HEADER_SIZE))
+
+static_assert(sizeof(std::atomic<uint32_t>) <= BUFFER_HEADER_SIZE, "The buffer header is too small");
+
+static real_t *buffer_alloc(uint32_t p_size) {
+	uint8_t *mem = new uint8_t[BUFFER_HEADER_SIZE + p_size * sizeof(real_t)];
+	new (mem) std::atomic<uint32_t>(1);
+	return reinterpret_cast<real_t *>(mem + BUFFER_HEADER_SIZE);
+}
+
+static void buffer_reference(real_t *p_data) {
+	BUFFER_REFCOUNT(p_data)->fetch_add(1, std::memory_order_relaxed);
+}
+
+static void buffer_unreference(real_t *p_data) {
+	if (1 == BUFFER_REFCOUNT(p_data)->fetch_sub(1, std::memory_order_acq_rel)) {
+		delete[](reinterpret_cast<uint8_t *>(p_data) - BUFFER_HEADER_SIZE);
+	}
+}
+
 brain::Matrix::Matrix() :
 		rows(0),
 		columns(0),
@@ -33,9 +59,22 @@ brain::Matrix::Matrix(
 }
 
 brain::Matrix::Matrix(const brain::Matrix &p_other) :
-		brain::Matrix(p_other.rows, p_other.columns, nullptr) {
+		rows(p_other.rows),
+		columns(p_other.columns),
+		matrix(p_other.matrix) {
+
+	if (matrix)
+		buffer_reference(matrix);
+}
+
+brain::Matrix::Matrix(brain::Matrix &&p_other) noexcept :
+		rows(p_other.rows),
+		columns(p_other.columns),
+		matrix(p_other.matrix) {
 
-	unsafe_set(p_other.matrix);
+	p_other.rows = 0;
+	p_other.columns = 0;
+	p_other.matrix = nullptr;
 }
 
 brain::Matrix::~Matrix() {
@@ -52,19 +91,22 @@ void brain::Matrix::resize(const uint32_t p_rows, const uint32_t p_columns) {
 }
 
 void brain::Matrix::unsafe_set(const real_t *const p_matrix) {
-	if (0 >= rows && 0 >= columns)
+	if (0 >= rows || 0 >= columns)
 		return;
+	copy_on_write();
 	std::copy(p_matrix, p_matrix + rows * columns, matrix);
 }
 
 void brain::Matrix::unsafe_set_row(const uint32_t p_row, const real_t *const p_data) {
-	ERR_FAIL_COND(p_row > rows);
-	std::copy(p_data, p_data + columns, matrix + p_row);
+	ERR_FAIL_COND(p_row >= rows);
+	copy_on_write();
+	std::copy(p_data, p_data + columns, matrix + p_row * columns);
 }
 
 void brain::Matrix::set(int p_row, int p_column, real_t p_value) {
 	ERR_FAIL_COND(p_row >= rows);
 	ERR_FAIL_COND(p_column >= columns);
+	copy_on_write();
 	matrix[GET_ID(p_row, p_column)] = p_value;
 }
 
@@ -75,12 +117,14 @@ real_t brain::Matrix::get(int p_row, int p_column) const {
 }
 
 void brain::Matrix::set_all(real_t p_value) {
+	copy_on_write();
 	FOREACH {
 		ELEMENT = p_value;
 	}
 }
 
 void brain::Matrix::map(matrix_map p_func) {
+	copy_on_write();
 	FOREACH {
 		ELEMENT = p_func(ELEMENT);
 	}
@@ -93,6 +137,7 @@ brain::Matrix brain::Matrix::mapped(matrix_map p_func) const {
 }
 
 void brain::Matrix::map(matrix_map_a1 p_func, real_t p_arg1) {
+	copy_on_write();
 	FOREACH {
 		ELEMENT = p_func(ELEMENT, p_arg1);
 	}
@@ -124,6 +169,8 @@ void brain::Matrix::element_wise_multiplicate(const Matrix &p_other) {
 	ERR_FAIL_COND(get_row_count() != p_other.get_row_count());
 	ERR_FAIL_COND(get_column_count() != p_other.get_column_count());
 
+	copy_on_write();
+
 	for (int r(0); r < rows; ++r) {
 		for (int c(0); c < columns; ++c) {
 
@@ -143,7 +190,7 @@ void brain::Matrix::transpose() {
 	if (0 >= rows || 0 >= columns)
 		return;
 
-	real_t *new_matrix = new real_t[rows * columns];
+	real_t *new_matrix = buffer_alloc(rows * columns);
 
 	for (int r(0); r < rows; ++r) {
 		for (int c(0); c < columns; ++c) {
@@ -192,9 +239,39 @@ void brain::Matrix::to_byte(uint8_t *r_buffer) const {
 			(real_t *)(r_buffer + sizeof(uint32_t) * 2));
 }
 
-void brain::Matrix::operator=(const Matrix &p_other) {
-	resize(p_other.rows, p_other.columns);
-	unsafe_set(p_other.matrix);
+brain::Matrix &brain::Matrix::operator=(const Matrix &p_other) {
+	if (matrix == p_other.matrix) {
+		// Same buffer, or both empty
+		rows = p_other.rows;
+		columns = p_other.columns;
+		return *this;
+	}
+
+	free();
+	rows = p_other.rows;
+	columns = p_other.columns;
+	matrix = p_other.matrix;
+
+	if (matrix)
+		buffer_reference(matrix);
+
+	return *this;
+}
+
+brain::Matrix &brain::Matrix::operator=(Matrix &&p_other) noexcept {
+	if (this == &p_other)
+		return *this;
+
+	free();
+	rows = p_other.rows;
+	columns = p_other.columns;
+	matrix = p_other.matrix;
+
+	p_other.rows = 0;
+	p_other.columns = 0;
+	p_other.matrix = nullptr;
+
+	return *this;
 }
 
 brain::Matrix brain::Matrix::operator*(const brain::Matrix &p_other) const {
@@ -203,21 +280,18 @@ brain::Matrix brain::Matrix::operator*(const brain::Matrix &p_other) const {
 
 	ERR_FAIL_COND_V(get_column_count() != p_other.get_row_count(), res);
 
-	for (int o_c(0); o_c < p_other.get_column_count(); ++o_c) {
-
-		for (int r(0); r < rows; ++r) {
-			real_t e(0);
-			for (int c(0); c < columns; ++c) {
-				e += matrix[GET_ID(r, c)] * p_other.get(c, o_c);
-			}
-			res.set(r, o_c, e);
-		}
+	if (1 == p_other.get_column_count()) {
+		// Single column, use the dedicated matrix vector kernel
+		kernels::gemv(matrix, p_other.matrix, res.matrix, rows, columns);
+	} else {
+		kernels::gemm(matrix, p_other.matrix, res.matrix, rows, columns, p_other.columns);
 	}
 
 	return res;
 }
 
-void brain::Matrix::operator*=(real_t p_num) const {
+void brain::Matrix::operator*=(real_t p_num) {
+	copy_on_write();
 	FOREACH {
 		ELEMENT *= p_num;
 	}
@@ -234,6 +308,8 @@ void brain::Matrix::operator+=(const brain::Matrix &p_other) {
 	ERR_FAIL_COND(get_row_count() != p_other.get_row_count());
 	ERR_FAIL_COND(get_column_count() != p_other.get_column_count());
 
+	copy_on_write();
+
 	for (int r(0); r < rows; ++r) {
 		for (int c(0); c < columns; ++c) {
 
@@ -253,6 +329,8 @@ void brain::Matrix::operator-=(const brain::Matrix &p_other) {
 	ERR_FAIL_COND(get_row_count() != p_other.get_row_count());
 	ERR_FAIL_COND(get_column_count() != p_other.get_column_count());
 
+	copy_on_write();
+
 	for (int r(0); r < rows; ++r) {
 		for (int c(0); c < columns; ++c) {
 
@@ -271,6 +349,8 @@ brain::Matrix brain::Matrix::operator-(const brain::Matrix &p_other) const {
 void brain::Matrix::operator/=(int p_num) {
 	ERR_FAIL_COND(p_num <= 0);
 
+	copy_on_write();
+
 	for (int r(0); r < rows; ++r) {
 		for (int c(0); c < columns; ++c) {
 
@@ -306,13 +386,28 @@ brain::Matrix::operator std::string() const {
 void brain::Matrix::init() {
 	if (0 >= rows || 0 >= columns)
 		return;
-	matrix = new real_t[rows * columns];
+	matrix = buffer_alloc(rows * columns);
 }
 
 void brain::Matrix::free() {
-	delete[] matrix;
+	if (matrix)
+		buffer_unreference(matrix);
 
 	rows = 0;
 	columns = 0;
 	matrix = nullptr;
 }
+
+void brain::Matrix::copy_on_write() {
+	if (!matrix)
+		return;
+
+	if (1 == BUFFER_REFCOUNT(matrix)->load(std::memory_order_acquire))
+		return;
+
+	real_t *new_matrix = buffer_alloc(rows * columns);
+	std::copy(matrix, matrix + rows * columns, new_matrix);
+
+	buffer_unreference(matrix);
+	matrix = new_matrix;
+}
@@ -6,8 +6,16 @@
 typedef real_t (*matrix_map)(real_t p_val);
 typedef real_t (*matrix_map_a1)(real_t p_val, real_t p_arg1);
 
-// TODO make this class COW please
 namespace brain {
+
+/**
+ * @brief The Matrix class is a row major matrix of real_t.
+ *
+ * The storage is copy on write: a copy shares the buffer with the original
+ * and the data is duplicated only when one of the two is modified.
+ * The buffer reference counter is atomic so it's safe to copy and destroy
+ * the matrices from different threads.
+ */
 class Matrix {
 
 	uint32_t rows;
@@ -22,6 +30,7 @@ public:
 			const real_t *const p_matrix = nullptr);
 
 	Matrix(const Matrix &p_other);
+	Matrix(Matrix &&p_other) noexcept;
 
 	~Matrix();
 
@@ -48,6 +57,14 @@ public:
 
 	const real_t *get_matrix() const { return matrix; }
 
+	/**
+	 * Returns the writable buffer, if it's shared it's duplicated first.
+	 */
+	real_t *get_matrix_mutable() {
+		copy_on_write();
+		return matrix;
+	}
+
 	// Map each element in the matrix
 	void map(matrix_map p_func);
 	Matrix mapped(matrix_map p_func) const;
@@ -72,11 +89,12 @@ public:
 	void from_byte(const uint8_t *r_buffer, int p_size_of_real);
 	void to_byte(uint8_t *r_buffer) const;
 
-	void operator=(const Matrix &p_other);
+	Matrix &operator=(const Matrix &p_other);
+	Matrix &operator=(Matrix &&p_other) noexcept;
 
 	Matrix operator*(const Matrix &p_other) const;
 
-	void operator*=(real_t p_num) const;
+	void operator*=(real_t p_num);
 	Matrix operator*(real_t p_num) const;
 
 	void operator+=(const Matrix &p_other);
@@ -93,5 +111,10 @@ public:
 private:
 	void init();
 	void free();
+
+	/**
+	 * Makes sure that the buffer is not shared before writing it
+	 */
+	void copy_on_write();
 };
 } // namespace brain
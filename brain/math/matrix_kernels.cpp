@@ -0,0 +1,422 @@
+#include "matrix_kernels.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86_ENABLED
+#endif
+
+/// Scalar kernels, used when no vector instruction set is available.
+namespace scalar {
+
+static void gemv(
+		const real_t *p_a,
+		const real_t *p_x,
+		real_t *r_y,
+		uint32_t p_m,
+		uint32_t p_k) {
+
+	for (uint32_t r(0); r < p_m; ++r) {
+		const real_t *a = p_a + r * p_k;
+		real_t t(0);
+		for (uint32_t c(0); c < p_k; ++c) {
+			t += a[c] * p_x[c];
+		}
+		r_y[r] = t;
+	}
+}
+
+static void gemv_bias(
+		const real_t *p_a,
+		const real_t *p_x,
+		const real_t *p_bias,
+		real_t *r_y,
+		uint32_t p_m,
+		uint32_t p_k) {
+
+	for (uint32_t r(0); r < p_m; ++r) {
+		const real_t *a = p_a + r * p_k;
+		real_t t(0);
+		for (uint32_t c(0); c < p_k; ++c) {
+			t += a[c] * p_x[c];
+		}
+		r_y[r] = t + p_bias[r];
+	}
+}
+
+static void gemv_t(
+		const real_t *p_a,
+		const real_t *p_x,
+		real_t *r_y,
+		uint32_t p_m,
+		uint32_t p_k) {
+
+	std::fill(r_y, r_y + p_k, real_t(0));
+
+	// Row by row so A is read sequentially
+	for (uint32_t r(0); r < p_m; ++r) {
+		const real_t *a = p_a + r * p_k;
+		for (uint32_t c(0); c < p_k; ++c) {
+			r_y[c] += a[c] * p_x[r];
+		}
+	}
+}
+
+static void ger(
+		const real_t *p_x,
+		const real_t *p_y,
+		real_t *r_a,
+		uint32_t p_m,
+		uint32_t p_k,
+		real_t p_alpha,
+		bool p_accumulate) {
+
+	for (uint32_t r(0); r < p_m; ++r) {
+		real_t *a = r_a + r * p_k;
+		const real_t s = p_alpha * p_x[r];
+		if (p_accumulate) {
+			for (uint32_t c(0); c < p_k; ++c) {
+				a[c] += p_y[c] * s;
+			}
+		} else {
+			for (uint32_t c(0); c < p_k; ++c) {
+				a[c] = p_y[c] * s;
+			}
+		}
+	}
+}
+
+static void weighted_sum(
+		const real_t *p_values,
+		const uint32_t *p_sources,
+		const real_t *p_weights,
+		uint32_t p_count,
+		real_t *r_y,
+		uint32_t p_lanes) {
+
+	for (uint32_t j(0); j < p_lanes; ++j) {
+		real_t acc(0);
+		for (uint32_t i(0); i < p_count; ++i) {
+			acc += p_values[p_sources[i] * p_lanes + j] * p_weights[i];
+		}
+		r_y[j] = acc;
+	}
+}
+
+static void gemm(
+		const real_t *p_a,
+		const real_t *p_b,
+		real_t *r_c,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_accumulate) {
+
+	// The loop order i-p-j reads B and writes C sequentially
+	for (uint32_t i(0); i < p_m; ++i) {
+		real_t *c = r_c + i * p_n;
+
+		if (!p_accumulate)
+			std::fill(c, c + p_n, real_t(0));
+
+		for (uint32_t p(0); p < p_k; ++p) {
+			const real_t a = p_a[i * p_k + p];
+			const real_t *b = p_b + p * p_n;
+			for (uint32_t j(0); j < p_n; ++j) {
+				c[j] += a * b[j];
+			}
+		}
+	}
+}
+
+static void gemm_tn(
+		const real_t *p_a,
+		const real_t *p_b,
+		real_t *r_c,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_accumulate) {
+
+	// As gemm, A is read by columns
+	for (uint32_t i(0); i < p_m; ++i) {
+		real_t *c = r_c + i * p_n;
+
+		if (!p_accumulate)
+			std::fill(c, c + p_n, real_t(0));
+
+		for (uint32_t p(0); p < p_k; ++p) {
+			const real_t a = p_a[p * p_m + i];
+			const real_t *b = p_b + p * p_n;
+			for (uint32_t j(0); j < p_n; ++j) {
+				c[j] += a * b[j];
+			}
+		}
+	}
+}
+
+static void gemm_nt(
+		const real_t *p_a,
+		const real_t *p_b,
+		real_t *r_c,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_accumulate) {
+
+	// A and B are both read by rows, each element of C is a dot product
+	for (uint32_t i(0); i < p_m; ++i) {
+		const real_t *a = p_a + i * p_k;
+		real_t *c = r_c + i * p_n;
+
+		for (uint32_t j(0); j < p_n; ++j) {
+			const real_t *b = p_b + j * p_k;
+			real_t acc = p_accumulate ? c[j] : 0;
+			for (uint32_t p(0); p < p_k; ++p) {
+				acc += a[p] * b[p];
+			}
+			c[j] = acc;
+		}
+	}
+}
+} // namespace scalar
+
+#ifdef KERNELS_X86_ENABLED
+
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#define KERNEL_NAMESPACE sse
+#define KERNEL_VECTOR_BYTES 16
+#include "matrix_kernels.inc"
+#undef KERNEL_NAMESPACE
+#undef KERNEL_VECTOR_BYTES
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#define KERNEL_NAMESPACE avx2
+#define KERNEL_VECTOR_BYTES 32
+#include "matrix_kernels.inc"
+#undef KERNEL_NAMESPACE
+#undef KERNEL_VECTOR_BYTES
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#define KERNEL_NAMESPACE avx512
+#define KERNEL_VECTOR_BYTES 64
+#include "matrix_kernels.inc"
+#undef KERNEL_NAMESPACE
+#undef KERNEL_VECTOR_BYTES
+#pragma GCC pop_options
+
+#endif
+
+namespace {
+
+struct KernelTable {
+	void (*gemm)(const real_t *, const real_t *, real_t *, uint32_t, uint32_t, uint32_t, bool);
+	void (*gemm_tn)(const real_t *, const real_t *, real_t *, uint32_t, uint32_t, uint32_t, bool);
+	void (*gemm_nt)(const real_t *, const real_t *, real_t *, uint32_t, uint32_t, uint32_t, bool);
+	void (*gemv)(const real_t *, const real_t *, real_t *, uint32_t, uint32_t);
+	void (*gemv_bias)(const real_t *, const real_t *, const real_t *, real_t *, uint32_t, uint32_t);
+	void (*gemv_t)(const real_t *, const real_t *, real_t *, uint32_t, uint32_t);
+	void (*ger)(const real_t *, const real_t *, real_t *, uint32_t, uint32_t, real_t, bool);
+	void (*weighted_sum)(const real_t *, const uint32_t *, const real_t *, uint32_t, real_t *, uint32_t);
+};
+
+const KernelTable kernel_tables[brain::kernels::ISA_MAX] = {
+	{ scalar::gemm, scalar::gemm_tn, scalar::gemm_nt, scalar::gemv, scalar::gemv_bias, scalar::gemv_t, scalar::ger, scalar::weighted_sum },
+#ifdef KERNELS_X86_ENABLED
+	{ sse::gemm, sse::gemm_tn, sse::gemm_nt, sse::gemv, sse::gemv_bias, sse::gemv_t, sse::ger, sse::weighted_sum },
+	{ avx2::gemm, avx2::gemm_tn, avx2::gemm_nt, avx2::gemv, avx2::gemv_bias, avx2::gemv_t, avx2::ger, avx2::weighted_sum },
+	{ avx512::gemm, avx512::gemm_tn, avx512::gemm_nt, avx512::gemv, avx512::gemv_bias, avx512::gemv_t, avx512::ger, avx512::weighted_sum },
+#else
+	{ scalar::gemm, scalar::gemm_tn, scalar::gemm_nt, scalar::gemv, scalar::gemv_bias, scalar::gemv_t, scalar::ger, scalar::weighted_sum },
+	{ scalar::gemm, scalar::gemm_tn, scalar::gemm_nt, scalar::gemv, scalar::gemv_bias, scalar::gemv_t, scalar::ger, scalar::weighted_sum },
+	{ scalar::gemm, scalar::gemm_tn, scalar::gemm_nt, scalar::gemv, scalar::gemv_bias, scalar::gemv_t, scalar::ger, scalar::weighted_sum },
+#endif
+};
+
+brain::kernels::ISA detect_isa() {
+#ifdef KERNELS_X86_ENABLED
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		return brain::kernels::ISA_AVX512;
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return brain::kernels::ISA_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return brain::kernels::ISA_SSE;
+#endif
+	return brain::kernels::ISA_SCALAR;
+}
+
+const brain::kernels::ISA best_isa = detect_isa();
+
+/// set_isa can run while other threads use the kernels, each kernel call
+/// reads the instruction set once. The tables are constant so the relaxed
+/// order is enough
+std::atomic<brain::kernels::ISA> current_isa(best_isa);
+
+const KernelTable *current_table() {
+	return kernel_tables + current_isa.load(std::memory_order_relaxed);
+}
+
+} // namespace
+
+brain::kernels::ISA brain::kernels::get_isa() {
+	return current_isa.load(std::memory_order_relaxed);
+}
+
+brain::kernels::ISA brain::kernels::get_best_isa() {
+	return best_isa;
+}
+
+void brain::kernels::set_isa(ISA p_isa) {
+	current_isa.store(MIN(p_isa, best_isa), std::memory_order_relaxed);
+}
+
+const char *brain::kernels::get_isa_name(ISA p_isa) {
+	switch (p_isa) {
+		case ISA_SCALAR: return "Scalar";
+		case ISA_SSE: return "SSE";
+		case ISA_AVX2: return "AVX2";
+		case ISA_AVX512: return "AVX-512";
+		default: return "Unknown";
+	}
+}
+
+void brain::kernels::gemm(
+		const real_t *p_a,
+		const real_t *p_b,
+		real_t *r_c,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_accumulate) {
+
+	if (!p_k) {
+		// Nothing to multiply, the result is zero
+		if (!p_accumulate)
+			std::fill(r_c, r_c + p_m * p_n, real_t(0));
+		return;
+	}
+
+	current_table()->gemm(p_a, p_b, r_c, p_m, p_k, p_n, p_accumulate);
+}
+
+void brain::kernels::gemm_tn(
+		const real_t *p_a,
+		const real_t *p_b,
+		real_t *r_c,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_accumulate) {
+
+	if (!p_k) {
+		if (!p_accumulate)
+			std::fill(r_c, r_c + p_m * p_n, real_t(0));
+		return;
+	}
+
+	current_table()->gemm_tn(p_a, p_b, r_c, p_m, p_k, p_n, p_accumulate);
+}
+
+void brain::kernels::gemm_nt(
+		const real_t *p_a,
+		const real_t *p_b,
+		real_t *r_c,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_accumulate) {
+
+	if (!p_k) {
+		if (!p_accumulate)
+			std::fill(r_c, r_c + p_m * p_n, real_t(0));
+		return;
+	}
+
+	current_table()->gemm_nt(p_a, p_b, r_c, p_m, p_k, p_n, p_accumulate);
+}
+
+void brain::kernels::gemv(
+		const real_t *p_a,
+		const real_t *p_x,
+		real_t *r_y,
+		uint32_t p_m,
+		uint32_t p_k) {
+
+	current_table()->gemv(p_a, p_x, r_y, p_m, p_k);
+}
+
+void brain::kernels::gemv_bias(
+		const real_t *p_a,
+		const real_t *p_x,
+		const real_t *p_bias,
+		real_t *r_y,
+		uint32_t p_m,
+		uint32_t p_k) {
+
+	current_table()->gemv_bias(p_a, p_x, p_bias, r_y, p_m, p_k);
+}
+
+void brain::kernels::gemv_t(
+		const real_t *p_a,
+		const real_t *p_x,
+		real_t *r_y,
+		uint32_t p_m,
+		uint32_t p_k) {
+
+	current_table()->gemv_t(p_a, p_x, r_y, p_m, p_k);
+}
+
+void brain::kernels::ger(
+		const real_t *p_x,
+		const real_t *p_y,
+		real_t *r_a,
+		uint32_t p_m,
+		uint32_t p_k,
+		real_t p_alpha,
+		bool p_accumulate) {
+
+	current_table()->ger(p_x, p_y, r_a, p_m, p_k, p_alpha, p_accumulate);
+}
+
+void brain::kernels::weighted_sum(
+		const real_t *p_values,
+		const uint32_t *p_sources,
+		const real_t *p_weights,
+		uint32_t p_count,
+		real_t *r_y,
+		uint32_t p_lanes) {
+
+	current_table()->weighted_sum(p_values, p_sources, p_weights, p_count, r_y, p_lanes);
+}
+
+void brain::kernels::transpose(
+		const real_t *p_src,
+		real_t *r_dst,
+		uint32_t p_rows,
+		uint32_t p_columns) {
+
+	// Tiled, so both the reads and the writes stay in cache; it's memory
+	// bound so there is no vectorized version.
+	const uint32_t TILE = 32;
+
+	for (uint32_t rt(0); rt < p_rows; rt += TILE) {
+		const uint32_t r_end = MIN(rt + TILE, p_rows);
+
+		for (uint32_t ct(0); ct < p_columns; ct += TILE) {
+			const uint32_t c_end = MIN(ct + TILE, p_columns);
+
+			for (uint32_t r(rt); r < r_end; ++r) {
+				for (uint32_t c(ct); c < c_end; ++c) {
+					r_dst[c * p_rows + r] = p_src[r * p_columns + c];
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "brain/math/math_defs.h"
+#include "brain/typedefs.h"
+
+namespace brain {
+
+/**
+ * @brief The kernels namespace collects the low level routines used by the
+ * Matrix class to perform the heavy math.
+ *
+ * All the kernels work on raw row major buffers, they don't perform any
+ * check and don't allocate memory.
+ *
+ * Each kernel has a scalar implementation and a vectorized one for each
+ * supported instruction set (SSE, AVX2, AVX-512), the best one available
+ * on the running CPU is picked at runtime.
+ */
+namespace kernels {
+
+/**
+ * @brief The ISA enum lists the instruction sets that the kernels can use
+ */
+enum ISA {
+	ISA_SCALAR,
+	ISA_SSE,
+	ISA_AVX2,
+	ISA_AVX512,
+	ISA_MAX
+};
+
+/**
+ * @brief get_isa returns the instruction set currently in use
+ * @return
+ */
+ISA get_isa();
+
+/**
+ * @brief get_best_isa returns the best instruction set supported by the CPU
+ * @return
+ */
+ISA get_best_isa();
+
+/**
+ * @brief set_isa force the use of a specific instruction set, if the CPU
+ * doesn't support it the best supported one is used.
+ *
+ * This is useful to debug and to compare the results of the various kernels.
+ *
+ * It's safe to call it while other threads use the kernels: each kernel call
+ * runs entirely with one instruction set, but a computation in progress may
+ * mix the results of the old and the new one.
+ * @param p_isa
+ */
+void set_isa(ISA p_isa);
+
+/**
+ * @brief get_isa_name
+ * @param p_isa
+ * @return
+ */
+const char *get_isa_name(ISA p_isa);
+
+/**
+ * @brief gemm performs the matrix matrix multiplication
+ *
+ * r_c (MxN) = p_a (MxK) * p_b (KxN)
+ *
+ * When p_accumulate is true the result is added to r_c instead.
+ *
+ * @param p_a
+ * @param p_b
+ * @param r_c
+ * @param p_m
+ * @param p_k
+ * @param p_n
+ * @param p_accumulate
+ */
+void gemm(
+		const real_t *p_a,
+		const real_t *p_b,
+		real_t *r_c,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_accumulate = false);
+
+/**
+ * @brief gemm_tn performs the matrix matrix multiplication with A
+ * transposed, without materializing the transposed matrix
+ *
+ * r_c (MxN) = p_a (KxM)^T * p_b (KxN)
+ *
+ * When p_accumulate is true the result is added to r_c instead.
+ *
+ * @param p_a
+ * @param p_b
+ * @param r_c
+ * @param p_m
+ * @param p_k
+ * @param p_n
+ * @param p_accumulate
+ */
+void gemm_tn(
+		const real_t *p_a,
+		const real_t *p_b,
+		real_t *r_c,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_accumulate = false);
+
+/**
+ * @brief gemm_nt performs the matrix matrix multiplication with B
+ * transposed, without materializing the transposed matrix
+ *
+ * r_c (MxN) = p_a (MxK) * p_b (NxK)^T
+ *
+ * When p_accumulate is true the result is added to r_c instead.
+ *
+ * @param p_a
+ * @param p_b
+ * @param r_c
+ * @param p_m
+ * @param p_k
+ * @param p_n
+ * @param p_accumulate
+ */
+void gemm_nt(
+		const real_t *p_a,
+		const real_t *p_b,
+		real_t *r_c,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_accumulate = false);
+
+/**
+ * @brief gemv performs the matrix vector multiplication
+ *
+ * r_y (M) = p_a (MxK) * p_x (K)
+ *
+ * @param p_a
+ * @param p_x
+ * @param r_y
+ * @param p_m
+ * @param p_k
+ */
+void gemv(
+		const real_t *p_a,
+		const real_t *p_x,
+		real_t *r_y,
+		uint32_t p_m,
+		uint32_t p_k);
+
+/**
+ * @brief gemv_bias performs the matrix vector multiplication and adds the
+ * bias in the same pass
+ *
+ * r_y (M) = p_a (MxK) * p_x (K) + p_bias (M)
+ *
+ * @param p_a
+ * @param p_x
+ * @param p_bias
+ * @param r_y
+ * @param p_m
+ * @param p_k
+ */
+void gemv_bias(
+		const real_t *p_a,
+		const real_t *p_x,
+		const real_t *p_bias,
+		real_t *r_y,
+		uint32_t p_m,
+		uint32_t p_k);
+
+/**
+ * @brief gemv_t performs the multiplication of the transposed matrix with
+ * a vector, without materializing the transposed matrix
+ *
+ * r_y (K) = p_a (MxK)^T * p_x (M)
+ *
+ * @param p_a
+ * @param p_x
+ * @param r_y
+ * @param p_m
+ * @param p_k
+ */
+void gemv_t(
+		const real_t *p_a,
+		const real_t *p_x,
+		real_t *r_y,
+		uint32_t p_m,
+		uint32_t p_k);
+
+/**
+ * @brief ger performs the rank-1 update (outer product)
+ *
+ * r_a (MxK) += p_alpha * p_x (M) * p_y (K)^T
+ *
+ * When p_accumulate is false r_a is overwritten instead.
+ *
+ * @param p_x
+ * @param p_y
+ * @param r_a
+ * @param p_m
+ * @param p_k
+ * @param p_alpha
+ * @param p_accumulate
+ */
+void ger(
+		const real_t *p_x,
+		const real_t *p_y,
+		real_t *r_a,
+		uint32_t p_m,
+		uint32_t p_k,
+		real_t p_alpha = 1,
+		bool p_accumulate = true);
+
+/**
+ * @brief weighted_sum sums the weighted rows of a lanes buffer, the rows
+ * are picked by index so it works on sparse connections
+ *
+ * r_y (N) = sum(p_weights[i] * p_values[p_sources[i]] (N)) for i < p_count
+ *
+ * p_values is row major and each row has N (p_lanes) elements; r_y must not
+ * overlap the rows that are read.
+ *
+ * @param p_values
+ * @param p_sources
+ * @param p_weights
+ * @param p_count
+ * @param r_y
+ * @param p_lanes
+ */
+void weighted_sum(
+		const real_t *p_values,
+		const uint32_t *p_sources,
+		const real_t *p_weights,
+		uint32_t p_count,
+		real_t *r_y,
+		uint32_t p_lanes);
+
+/**
+ * @brief transpose writes the transposed of p_src into r_dst, the two buffers
+ * must not overlap
+ *
+ * r_dst (CxR) = p_src (RxC)^T
+ *
+ * @param p_src
+ * @param r_dst
+ * @param p_rows
+ * @param p_columns
+ */
+void transpose(
+		const real_t *p_src,
+		real_t *r_dst,
+		uint32_t p_rows,
+		uint32_t p_columns);
+
+} // namespace kernels
+} // namespace brain
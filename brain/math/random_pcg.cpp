@@ -29,6 +29,7 @@
 /*************************************************************************/
 
 #include "random_pcg.h"
+#include <math.h>
 #include <time.h>
 
 brain::RandomPCG::RandomPCG(uint64_t p_seed, uint64_t p_inc) :
@@ -53,3 +54,10 @@ float brain::RandomPCG::random(float p_from, float p_to) {
 	float ret = (float)r / (float)RANDOM_MAX;
 	return (ret) * (p_to - p_from) + p_from;
 }
+
+double brain::RandomPCG::randfn(double p_mean, double p_deviation) {
+	// Never 0, so the logarithm is finite
+	const double u1 = ((double)rand() + 1.0) / ((double)RANDOM_MAX + 1.0);
+	const double u2 = randd();
+	return p_mean + p_deviation * (::sqrt(-2.0 * ::log(u1)) * ::cos(Math_TAU * u2));
+}
@@ -64,6 +64,9 @@ public:
 	_FORCE_INLINE_ double randd() { return (double)rand() / (double)RANDOM_MAX; }
 	_FORCE_INLINE_ float randf() { return (float)rand() / (float)RANDOM_MAX; }
 
+	/// Normally distributed number, generated with the Box-Muller transform
+	double randfn(double p_mean, double p_deviation);
+
 	double random(double p_from, double p_to);
 	float random(float p_from, float p_to);
 	real_t random(int p_from, int p_to) { return (real_t)random((real_t)p_from, (real_t)p_to); }
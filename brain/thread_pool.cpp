@@ -0,0 +1,113 @@
+#include "thread_pool.h"
+
+#include "brain/error_macros.h"
+
+brain::ThreadPool::ThreadPool(uint32_t p_thread_count) :
+		thread_count(p_thread_count),
+		generation(0),
+		pending_workers(0),
+		exit(false),
+		task(nullptr),
+		task_data(nullptr),
+		task_count(0) {
+
+	if (!thread_count)
+		thread_count = MAX(1u, std::thread::hardware_concurrency());
+
+	// The thread 0 is the caller
+	workers.reserve(thread_count - 1);
+	for (uint32_t t(1); t < thread_count; ++t) {
+		workers.push_back(std::thread(&ThreadPool::worker_main, this, t));
+	}
+}
+
+brain::ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		exit = true;
+	}
+	work_condition.notify_all();
+
+	for (uint32_t t(0); t < workers.size(); ++t) {
+		workers[t].join();
+	}
+}
+
+void brain::ThreadPool::parallel_for(uint32_t p_count, task_func p_task, void *p_data) {
+	ERR_FAIL_COND(!p_task);
+
+	if (!p_count)
+		return;
+
+	if (thread_count == 1 || p_count == 1) {
+		// Nothing to split
+		for (uint32_t i(0); i < p_count; ++i) {
+			p_task(i, p_data);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		task = p_task;
+		task_data = p_data;
+		task_count = p_count;
+		pending_workers = workers.size();
+		++generation;
+	}
+	work_condition.notify_all();
+
+	execute_chunk(0);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done_condition.wait(lock, [this] { return pending_workers == 0; });
+
+	task = nullptr;
+	task_data = nullptr;
+}
+
+void brain::ThreadPool::get_chunk(
+		uint32_t p_thread,
+		uint32_t p_thread_count,
+		uint32_t p_count,
+		uint32_t &r_begin,
+		uint32_t &r_end) {
+
+	r_begin = uint64_t(p_count) * p_thread / p_thread_count;
+	r_end = uint64_t(p_count) * (p_thread + 1) / p_thread_count;
+}
+
+void brain::ThreadPool::worker_main(uint32_t p_thread) {
+
+	uint64_t executed_generation(0);
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_condition.wait(lock, [&] { return exit || generation != executed_generation; });
+
+			if (exit)
+				return;
+
+			executed_generation = generation;
+		}
+
+		execute_chunk(p_thread);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--pending_workers;
+			if (pending_workers == 0)
+				done_condition.notify_one();
+		}
+	}
+}
+
+void brain::ThreadPool::execute_chunk(uint32_t p_thread) {
+	uint32_t begin, end;
+	get_chunk(p_thread, thread_count, task_count, begin, end);
+
+	for (uint32_t i(begin); i < end; ++i) {
+		task(i, task_data);
+	}
+}
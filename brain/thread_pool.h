@@ -0,0 +1,91 @@
+#pragma once
+
+#include "brain/typedefs.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace brain {
+
+/**
+ * @brief The ThreadPool class keeps a set of threads alive to execute
+ * parallel loops without paying the thread creation at each call.
+ *
+ * The indices of a parallel loop are split statically: the thread `t` always
+ * executes the same contiguous chunk, so given the same thread count the
+ * work distribution is deterministic.
+ *
+ * The calling thread takes part to the execution, so a pool of N threads
+ * spawns N - 1 workers.
+ */
+class ThreadPool {
+
+public:
+	/**
+	 * @brief task_func is the function executed for each index
+	 * @param p_index
+	 * @param p_data the user data passed to parallel_for
+	 */
+	typedef void (*task_func)(uint32_t p_index, void *p_data);
+
+private:
+	uint32_t thread_count;
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable work_condition;
+	std::condition_variable done_condition;
+
+	/// Incremented each time a new loop is submitted
+	uint64_t generation;
+	uint32_t pending_workers;
+	bool exit;
+
+	task_func task;
+	void *task_data;
+	uint32_t task_count;
+
+public:
+	/**
+	 * @brief ThreadPool
+	 * @param p_thread_count the threads count, 0 means one thread per core
+	 */
+	ThreadPool(uint32_t p_thread_count = 0);
+	~ThreadPool();
+
+	uint32_t get_thread_count() const { return thread_count; }
+
+	/**
+	 * @brief parallel_for executes p_task for each index in [0, p_count)
+	 * and returns when all are done.
+	 *
+	 * It must not be called from a task of the same pool.
+	 *
+	 * @param p_count
+	 * @param p_task
+	 * @param p_data
+	 */
+	void parallel_for(uint32_t p_count, task_func p_task, void *p_data);
+
+	/**
+	 * @brief get_chunk returns the range of indices executed by a thread
+	 * @param p_thread
+	 * @param p_thread_count
+	 * @param p_count
+	 * @param r_begin
+	 * @param r_end
+	 */
+	static void get_chunk(
+			uint32_t p_thread,
+			uint32_t p_thread_count,
+			uint32_t p_count,
+			uint32_t &r_begin,
+			uint32_t &r_end);
+
+private:
+	void worker_main(uint32_t p_thread);
+	void execute_chunk(uint32_t p_thread);
+};
+
+} // namespace brain
@@ -1,13 +1,21 @@
 
 
+#include "brain/brain_areas/sharp_model.h"
+#include "brain/brain_areas/sharp_native_area.h"
 #include "brain/brain_areas/uniform_brain_area.h"
 #include "brain/error_handler.h"
 #include "brain/math/math_funcs.h"
 #include "brain/math/matrix.h"
+#include "brain/math/matrix_kernels.h"
 #include "brain/string.h"
 #include "brain/typedefs.h"
 #include <time.h>
+#include <unistd.h>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include <random>
 
 void print_line(const std::string &p_msg) {
@@ -17,6 +25,9 @@ void print_line(const std::string &p_msg) {
 	fflush(stdout);
 }
 
+/// The checks that expect an error disable the print
+static bool print_errors = true;
+
 void print_error_callback(
 		void *p_user_data,
 		const char *p_function,
@@ -26,6 +37,9 @@ void print_error_callback(
 		const char *p_explain,
 		brain::ErrorHandlerType p_type) {
 
+	if (!print_errors)
+		return;
+
 	std::string msg =
 			std::string() +
 			(p_type == brain::ERR_HANDLER_ERROR ? "[ERROR] " : "[WARN]") +
@@ -379,6 +393,1243 @@ void test_NEAT_XOR() {
 	int b = 0;
 }
 
+/**
+ * @brief NEAT_XOR_fitness evaluates the XOR, it's called from many threads
+ */
+real_t NEAT_XOR_fitness(
+		uint32_t p_organism_i,
+		const brain::SharpBrainArea &p_brain_area,
+		void *p_data) {
+
+	const real_t inputs[4][3] = { { 1, 1, 0 }, { 1, 0, 1 }, { 1, 1, 1 }, { 1, 0, 0 } };
+	const real_t expected[4] = { 1, 1, 0, 0 };
+
+	brain::Matrix result;
+	real_t total_error(0);
+	for (int k(0); k < 4; ++k) {
+		const brain::Matrix input(3, 1, inputs[k]);
+		if (p_brain_area.guess(input, result)) {
+			total_error += ABS(result.get(0, 0) - expected[k]);
+		} else {
+			total_error += 1;
+		}
+	}
+	return 1.f - (total_error / 4);
+}
+
+/**
+ * @brief run_NEAT_XOR evolves a population and collects, for each epoch, the
+ * fitness of all organisms and the species count
+ */
+bool run_NEAT_XOR(
+		const brain::NtPopulationSettings &p_settings,
+		int p_epochs,
+		std::vector<real_t> &r_fitnesses,
+		std::vector<int> &r_species_counts) {
+
+	brain::NtPopulationSettings settings(p_settings);
+
+	// The ancestor genome weights are taken from the global generator
+	brain::Math::seed(settings.seed);
+
+	brain::NtPopulation population(
+			brain::NtGenome(
+					3,
+					1,
+					true,
+					brain::BrainArea::ACTIVATION_RELU,
+					brain::BrainArea::ACTIVATION_BINARY),
+			100 /*population size*/,
+			settings);
+
+	for (int epoch(0); epoch < p_epochs; ++epoch) {
+
+		population.evaluate_all(NEAT_XOR_fitness, nullptr);
+
+		for (int i = 0; i < population.get_population_size(); ++i) {
+			r_fitnesses.push_back(population.organism_get_fitness(i));
+		}
+
+		if (!population.epoch_advance())
+			return false;
+
+		r_species_counts.push_back(population.get_epoch_statistics().species_count);
+	}
+	return true;
+}
+
+/**
+ * @brief test_NEAT_determinism checks that the evolution doesn't depend on
+ * the thread count, nor on the compatibility computed with the bitsets
+ */
+bool test_NEAT_determinism() {
+
+	const int epochs(20);
+
+	struct Config {
+		uint32_t thread_count;
+		bool bitset;
+	};
+	const Config configs[] = { { 1, false }, { 4, false }, { 1, true }, { 4, true } };
+
+	std::vector<real_t> reference_fitnesses;
+	std::vector<int> reference_species_counts;
+
+	for (int c(0); c < 4; ++c) {
+
+		brain::NtPopulationSettings settings;
+		settings.seed = 1554825747;
+		settings.thread_count = configs[c].thread_count;
+		settings.genetic_compatibility_bitset = configs[c].bitset;
+
+		std::vector<real_t> fitnesses;
+		std::vector<int> species_counts;
+		if (!run_NEAT_XOR(settings, epochs, fitnesses, species_counts)) {
+			print_line("NEAT determinism: the epoch advance failed");
+			return false;
+		}
+
+		if (c == 0) {
+			reference_fitnesses = fitnesses;
+			reference_species_counts = species_counts;
+		} else if (fitnesses != reference_fitnesses || species_counts != reference_species_counts) {
+			print_line(
+					"NEAT determinism: the result changes with " +
+					brain::itos(configs[c].thread_count) + " threads and bitset " +
+					brain::itos(configs[c].bitset));
+			return false;
+		}
+	}
+
+	print_line("NEAT determinism: OK");
+	return true;
+}
+
+/**
+ * @brief build_chain_links adds one by one `p_parents` links to each neuron
+ * from the neurons that come before it, and returns the seconds taken
+ * including the placement of the links
+ */
+double build_chain_links(uint32_t p_neuron_count, uint32_t p_parents) {
+
+	const auto begin = std::chrono::steady_clock::now();
+
+	brain::SharpBrainArea area;
+	for (uint32_t n(0); n < p_neuron_count; ++n) {
+		area.add_neuron();
+	}
+	area.set_neuron_as_input(0);
+	area.set_neuron_as_output(p_neuron_count - 1);
+
+	for (uint32_t n(1); n < p_neuron_count; ++n) {
+		for (uint32_t p(1); p <= MIN(p_parents, n); ++p) {
+			area.add_link(n - p, n, 0.5f);
+		}
+	}
+
+	if (!area.is_ready())
+		return -1;
+
+	const std::chrono::duration<double> time = std::chrono::steady_clock::now() - begin;
+	return time.count();
+}
+
+/**
+ * @brief test_sharp_add_link_scaling checks that adding the links one by one
+ * takes linear time: with 4 times the links it must not take 16 times longer
+ */
+bool test_sharp_add_link_scaling() {
+
+	const uint32_t parents(10);
+
+	// The best of some runs, to ignore the noise of the machine
+	double small_time(1e9);
+	double big_time(1e9);
+	for (int i(0); i < 3; ++i) {
+		small_time = MIN(small_time, build_chain_links(10000, parents));
+		big_time = MIN(big_time, build_chain_links(40000, parents));
+	}
+
+	if (small_time < 0 || big_time < 0) {
+		print_line("Sharp add_link scaling: the network is not ready");
+		return false;
+	}
+
+	// The small build can be too fast to be measured
+	if (big_time > 8 * MAX(small_time, 0.001)) {
+		print_line(
+				"Sharp add_link scaling: " + brain::rtos(small_time) +
+				"s for 100k links, " + brain::rtos(big_time) + "s for 400k links");
+		return false;
+	}
+
+	print_line("Sharp add_link scaling: OK");
+	return true;
+}
+
+/**
+ * @brief sharp_sequence_loss is the loss of learn, 1/2 Σ((expected - guess)^2),
+ * of the whole sequence starting from an empty memory
+ */
+real_t sharp_sequence_loss(
+		brain::SharpBrainArea &p_area,
+		const brain::Matrix &p_inputs,
+		const brain::Matrix &p_expected) {
+
+	p_area.get_state().reset();
+	return p_area.learn(p_inputs, p_expected, 1, 0, false) * 0.5f;
+}
+
+/**
+ * @brief test_sharp_learn_gradients compares the gradients of the back
+ * propagation through time with the finite differences of the loss, on a
+ * small network with recurrent links
+ */
+bool test_sharp_learn_gradients() {
+
+	brain::SharpBrainArea area;
+	for (int n(0); n < 6; ++n) {
+		area.add_neuron();
+	}
+	area.set_neuron_as_input(0);
+	area.set_neuron_as_input(1);
+	area.set_neuron_activation(2, brain::BrainArea::ACTIVATION_TANH);
+	area.set_neuron_activation(3, brain::BrainArea::ACTIVATION_SIGMOID);
+	area.set_neuron_activation(4, brain::BrainArea::ACTIVATION_TANH);
+	area.set_neuron_activation(5, brain::BrainArea::ACTIVATION_SIGMOID);
+	area.set_neuron_as_output(5);
+
+	area.add_link(0, 2, 0.7f);
+	area.add_link(1, 2, -0.4f);
+	area.add_link(0, 3, 0.3f);
+	area.add_link(2, 3, 0.9f);
+	area.add_link(1, 4, 0.5f);
+	area.add_link(3, 4, -0.8f);
+	area.add_link(2, 5, 0.6f);
+	area.add_link(4, 5, -1.1f);
+	area.add_link(5, 2, 0.45f, true);
+	area.add_link(3, 3, -0.35f, true);
+	area.add_link(4, 3, 0.25f, true);
+
+	const int steps(6);
+	const real_t inputs[2][steps] = {
+		{ 1, 1, 1, 1, 1, 1 },
+		{ 0.2f, -0.7f, 0.9f, 0.1f, -0.3f, 0.5f }
+	};
+	const real_t expected[1][steps] = { { 0.1f, 0.8f, 0.3f, 0.9f, 0.2f, 0.6f } };
+	const brain::Matrix sequence_inputs(2, steps, &inputs[0][0]);
+	const brain::Matrix sequence_expected(1, steps, &expected[0][0]);
+
+	/// Step 1. The gradients of the back propagation, with learn rate 1
+	std::vector<real_t> gradients;
+	area.get_state().reset();
+	area.learn(sequence_inputs, sequence_expected, 1, 0, false, &gradients);
+
+	/// Step 2. The central finite difference of each weight
+	const real_t h(1e-2f);
+	std::vector<real_t> shift(gradients.size(), 0.f);
+
+	for (uint32_t l(0); l < gradients.size(); ++l) {
+
+		// update_weights subtracts the passed values
+		shift[l] = -h;
+		area.update_weights(shift);
+		const real_t loss_plus = sharp_sequence_loss(area, sequence_inputs, sequence_expected);
+
+		shift[l] = 2 * h;
+		area.update_weights(shift);
+		const real_t loss_minus = sharp_sequence_loss(area, sequence_inputs, sequence_expected);
+
+		shift[l] = -h;
+		area.update_weights(shift);
+		shift[l] = 0;
+
+		const real_t numeric = (loss_plus - loss_minus) / (2 * h);
+		if (ABS(numeric - gradients[l]) > 1e-3f + 1e-2f * ABS(numeric)) {
+			print_line(
+					"Sharp learn gradients: link " + brain::itos(l) +
+					" back propagation " + brain::rtos(gradients[l]) +
+					" finite difference " + brain::rtos(numeric));
+			return false;
+		}
+	}
+
+	print_line("Sharp learn gradients: OK");
+	return true;
+}
+
+/**
+ * @brief build_random_sharp_area builds a random network with forward and
+ * recurrent links. It also creates what the plan simplifies: zero weight
+ * links, linear neurons that forward a single parent and neurons without
+ * parents.
+ */
+void build_random_sharp_area(
+		brain::SharpBrainArea &r_area,
+		std::mt19937 &p_rng,
+		uint32_t p_input_count,
+		uint32_t p_hidden_count,
+		uint32_t p_output_count,
+		bool p_softmax) {
+
+	std::uniform_real_distribution<real_t> weight(-1, 1);
+	const uint32_t neuron_count = p_input_count + p_hidden_count + p_output_count;
+	const uint32_t first_output = p_input_count + p_hidden_count;
+
+	r_area.clear();
+	for (uint32_t n(0); n < neuron_count; ++n) {
+		r_area.add_neuron();
+	}
+	for (uint32_t n(0); n < p_input_count; ++n) {
+		r_area.set_neuron_as_input(n);
+	}
+	for (uint32_t n(first_output); n < neuron_count; ++n) {
+		r_area.set_neuron_as_output(n);
+	}
+
+	for (uint32_t n(p_input_count); n < neuron_count; ++n) {
+		const bool output = n >= first_output;
+
+		if (output && p_softmax) {
+			r_area.set_neuron_activation(n, brain::BrainArea::ACTIVATION_SOFTMAX);
+		} else {
+			r_area.set_neuron_activation(n, brain::BrainArea::Activation(p_rng() % 5));
+		}
+
+		if (!output && p_rng() % 6 == 0) {
+			// Constant neuron
+			continue;
+		}
+
+		if (!output && p_rng() % 4 == 0) {
+			// Linear neuron that forwards its parent
+			r_area.set_neuron_activation(n, brain::BrainArea::ACTIVATION_LINEAR);
+			r_area.add_link(p_rng() % n, n, p_rng() % 2 ? 1.f : weight(p_rng));
+			continue;
+		}
+
+		for (uint32_t p(0); p < neuron_count; ++p) {
+			const uint32_t kind = p_rng() % 100;
+			const real_t w = kind % 5 == 0 ? 0.f : (kind % 5 == 1 ? 1.f : weight(p_rng));
+
+			if (p < MIN(n, first_output) && kind < 40) {
+				r_area.add_link(p, n, w);
+			} else if (kind >= 92) {
+				r_area.add_link(p, n, w, true);
+			}
+		}
+	}
+}
+
+/**
+ * @brief test_sharp_plan_simplification checks that the simplified plan gives
+ * the outputs of the full network, with finite inputs
+ */
+bool test_sharp_plan_simplification() {
+
+	std::mt19937 rng(1554825747);
+	std::uniform_real_distribution<real_t> input(-1, 1);
+
+	for (uint32_t net(0); net < 40; ++net) {
+
+		brain::SharpBrainArea simplified;
+		build_random_sharp_area(simplified, rng, 2 + net % 4, 4 + net % 17, 1 + net % 3, net % 5 == 4);
+
+		brain::SharpBrainArea full(simplified);
+		full.set_plan_simplification(false);
+
+		brain::Matrix in(simplified.get_input_layer_size(), 1);
+		brain::Matrix simplified_out;
+		brain::Matrix full_out;
+
+		// Many steps, so the recurrent memory is used too
+		for (int step(0); step < 8; ++step) {
+			for (uint32_t i(0); i < simplified.get_input_layer_size(); ++i) {
+				in.set(i, 0, input(rng));
+			}
+
+			if (!simplified.guess(in, simplified_out) || !full.guess(in, full_out)) {
+				print_line("Sharp plan simplification: the network is not ready");
+				return false;
+			}
+
+			for (uint32_t o(0); o < simplified.get_output_layer_size(); ++o) {
+				const real_t a = simplified_out.get(o, 0);
+				const real_t b = full_out.get(o, 0);
+				if (ABS(a - b) > 1e-5f * MAX(1.f, ABS(b))) {
+					print_line(
+							"Sharp plan simplification: network " + brain::itos(net) +
+							" output " + brain::itos(o) + " is " + brain::rtos(a) +
+							" instead of " + brain::rtos(b));
+					return false;
+				}
+			}
+		}
+	}
+
+	print_line("Sharp plan simplification: OK");
+	return true;
+}
+
+/**
+ * @brief is_same_value compares bit by bit, so NaN is equal to NaN
+ */
+bool is_same_value(real_t p_a, real_t p_b) {
+	return memcmp(&p_a, &p_b, sizeof(real_t)) == 0;
+}
+
+/**
+ * @brief is_model_accepted tells if the first `p_size` bytes of the buffer
+ * are a valid model
+ */
+bool is_model_accepted(const std::vector<uint8_t> &p_data, uint64_t p_size) {
+	brain::SharpModel model;
+	print_errors = false;
+	const bool accepted = model.set_data(p_data.data(), p_size);
+	print_errors = true;
+	return accepted;
+}
+
+/**
+ * @brief corrupt_model_word returns a copy of the model with the value
+ * written in the word `p_word`, that points inside `p_data`
+ */
+std::vector<uint8_t> corrupt_model_word(
+		const std::vector<uint8_t> &p_data,
+		const void *p_word,
+		uint32_t p_value) {
+
+	std::vector<uint8_t> data(p_data);
+	const uint64_t offset = static_cast<const uint8_t *>(p_word) - p_data.data();
+	memcpy(data.data() + offset, &p_value, sizeof(uint32_t));
+	return data;
+}
+
+/**
+ * @brief test_sharp_model saves and maps the models of random networks, and
+ * checks that the truncated and corrupted models are rejected
+ */
+bool test_sharp_model() {
+
+	const std::string path("sharp_model_test.bshm");
+	std::mt19937 rng(1554825747);
+	std::uniform_real_distribution<real_t> input(-1, 1);
+
+	/// Step 1. The mapped model guesses as the network it comes from, both
+	/// in place and loaded in a new network
+	for (uint32_t net(0); net < 20; ++net) {
+
+		brain::SharpBrainArea area;
+		build_random_sharp_area(area, rng, 2 + net % 4, 4 + net % 17, 1 + net % 3, net % 5 == 4);
+
+		brain::SharpModel model;
+		if (!brain::SharpModel::save(area, path) || !model.map(path)) {
+			print_line("Sharp model: can't save and map the model");
+			return false;
+		}
+
+		brain::SharpBrainArea loaded;
+		if (!loaded.set_model(model)) {
+			print_line("Sharp model: can't load the model");
+			return false;
+		}
+
+		brain::SharpState model_state;
+		brain::Matrix in(area.get_input_layer_size(), 1);
+		brain::Matrix area_out;
+		brain::Matrix model_out;
+		brain::Matrix loaded_out;
+
+		for (int step(0); step < 8; ++step) {
+			for (uint32_t i(0); i < area.get_input_layer_size(); ++i) {
+				in.set(i, 0, input(rng));
+			}
+
+			area.guess(in, area_out);
+			loaded.guess(in, loaded_out);
+			if (!model.guess(in, model_out, model_state)) {
+				print_line("Sharp model: the guess failed");
+				return false;
+			}
+
+			for (uint32_t o(0); o < area.get_output_layer_size(); ++o) {
+				if (!is_same_value(area_out.get(o, 0), model_out.get(o, 0)) ||
+						!is_same_value(area_out.get(o, 0), loaded_out.get(o, 0))) {
+					print_line("Sharp model: network " + brain::itos(net) + " guesses a different output");
+					return false;
+				}
+			}
+		}
+	}
+
+	/// Step 2. The corrupted models are rejected
+	brain::SharpBrainArea area;
+	build_random_sharp_area(area, rng, 3, 12, 2, false);
+
+	std::vector<uint8_t> data;
+	brain::SharpModel model;
+	if (!brain::SharpModel::write(area, data) || !model.set_data(data.data(), data.size())) {
+		print_line("Sharp model: can't write the model");
+		return false;
+	}
+
+	const uint32_t neuron_count = model.get_neuron_count();
+	const uint32_t link_count = model.get_link_count();
+	const uint32_t plan_neuron_count = model.get_plan_neuron_count();
+	const uint32_t plan_link_count = model.get_plan_link_count();
+	const uint32_t *parent_offsets = model.get_parent_offsets();
+	const uint32_t *link_parents = model.get_link_parents();
+
+	// A child with at least two parents, to duplicate a link
+	uint32_t child(0);
+	while (child < neuron_count && parent_offsets[child + 1] - parent_offsets[child] < 2) {
+		++child;
+	}
+
+	if (child == neuron_count || !plan_link_count) {
+		print_line("Sharp model: the test network is too small");
+		return false;
+	}
+
+	const std::vector<uint8_t> corrupted_models[] = {
+		corrupt_model_word(data, data.data(), 0),
+		corrupt_model_word(data, model.get_activations(), brain::BrainArea::ACTIVATION_MAX),
+		corrupt_model_word(data, parent_offsets + neuron_count, link_count + 1),
+		corrupt_model_word(data, parent_offsets + child, parent_offsets[child + 1] + 1),
+		corrupt_model_word(data, link_parents, neuron_count),
+		corrupt_model_word(data, link_parents + parent_offsets[child] + 1, link_parents[parent_offsets[child]]),
+		corrupt_model_word(data, model.get_link_recurrents(), 2),
+		corrupt_model_word(data, model.get_inputs(), neuron_count),
+		corrupt_model_word(data, model.get_outputs(), neuron_count),
+		corrupt_model_word(data, model.get_plan_neurons(), neuron_count),
+		corrupt_model_word(data, model.get_plan_level_offsets() + model.get_plan_level_count(), plan_neuron_count + 1),
+		corrupt_model_word(data, model.get_plan_link_offsets() + plan_neuron_count, plan_link_count + 1),
+		corrupt_model_word(data, model.get_plan_link_offsets() + 1, plan_link_count + 1),
+		corrupt_model_word(data, model.get_plan_link_sources(), neuron_count + model.get_plan_recurrent_count())
+	};
+
+	for (uint32_t i(0); i < sizeof(corrupted_models) / sizeof(corrupted_models[0]); ++i) {
+		if (is_model_accepted(corrupted_models[i], corrupted_models[i].size())) {
+			print_line("Sharp model: the corrupted model " + brain::itos(i) + " is accepted");
+			return false;
+		}
+	}
+
+	/// Step 3. The truncated models are rejected, also from a file
+	for (uint64_t size(0); size < data.size(); size += 4) {
+		if (is_model_accepted(data, size)) {
+			print_line("Sharp model: the model truncated at " + brain::itos(size) + " bytes is accepted");
+			return false;
+		}
+	}
+
+	FILE *file = fopen(path.c_str(), "wb");
+	fwrite(data.data(), 1, data.size() / 2, file);
+	fclose(file);
+
+	brain::SharpModel truncated;
+	print_errors = false;
+	const bool truncated_accepted = truncated.map(path);
+	print_errors = true;
+
+	std::remove(path.c_str());
+
+	if (truncated_accepted) {
+		print_line("Sharp model: the truncated file is accepted");
+		return false;
+	}
+
+	print_line("Sharp model: OK");
+	return true;
+}
+
+/**
+ * @brief is_executable_in_path tells if the program can be found in the PATH,
+ * as posix_spawnp does
+ */
+bool is_executable_in_path(const std::string &p_name) {
+	const char *path = getenv("PATH");
+	if (!path)
+		return false;
+
+	std::string directories(path);
+	size_t begin(0);
+	while (begin <= directories.size()) {
+		size_t end = directories.find(':', begin);
+		if (end == std::string::npos)
+			end = directories.size();
+
+		const std::string directory = end == begin ? "." : directories.substr(begin, end - begin);
+		if (access((directory + "/" + p_name).c_str(), X_OK) == 0)
+			return true;
+
+		begin = end + 1;
+	}
+	return false;
+}
+
+/**
+ * @brief test_sharp_native compiles random networks and checks that they
+ * guess as the SharpBrainArea does. It's skipped without a compiler.
+ */
+bool test_sharp_native() {
+
+	const std::string compiler("c++");
+	if (!is_executable_in_path(compiler)) {
+		print_line("Sharp native: skipped, the compiler `" + compiler + "` is not available");
+		return true;
+	}
+
+	std::mt19937 rng(1554825747);
+	std::uniform_real_distribution<real_t> input(-1, 1);
+
+	for (uint32_t net(0); net < 4; ++net) {
+
+		brain::SharpBrainArea area;
+		build_random_sharp_area(area, rng, 2 + net, 6 + net * 5, 1 + net % 3, net == 3);
+
+		// Each network has its own library, the loaded ones are cached by path
+		const std::string library_path("./sharp_native_test_" + brain::itos(net) + ".so");
+
+		brain::SharpNativeArea native;
+		const bool compiled = native.compile(area, library_path, compiler);
+
+		std::remove(library_path.c_str());
+		std::remove((library_path + ".cpp").c_str());
+
+		if (!compiled) {
+			print_line("Sharp native: the compilation failed");
+			return false;
+		}
+
+		brain::Matrix in(area.get_input_layer_size(), 1);
+		brain::Matrix area_out;
+		brain::Matrix native_out;
+
+		for (int step(0); step < 8; ++step) {
+			for (uint32_t i(0); i < area.get_input_layer_size(); ++i) {
+				in.set(i, 0, input(rng));
+			}
+
+			if (!area.guess(in, area_out) || !native.guess(in, native_out)) {
+				print_line("Sharp native: the guess failed");
+				return false;
+			}
+
+			for (uint32_t o(0); o < area.get_output_layer_size(); ++o) {
+				if (!is_same_value(area_out.get(o, 0), native_out.get(o, 0))) {
+					print_line(
+							"Sharp native: network " + brain::itos(net) + " output " +
+							brain::itos(o) + " is " + brain::rtos(native_out.get(o, 0)) +
+							" instead of " + brain::rtos(area_out.get(o, 0)));
+					return false;
+				}
+			}
+		}
+	}
+
+	print_line("Sharp native: OK");
+	return true;
+}
+
+/// The writes done by test_matrix_copy_on_write, each one changes all the
+/// elements or the shape of the matrix
+typedef void (*matrix_write)(brain::Matrix &r_matrix);
+
+static real_t matrix_double_value(real_t p_value) {
+	return p_value * 2;
+}
+
+static void matrix_write_set(brain::Matrix &r_matrix) {
+	r_matrix.set(1, 2, 100);
+}
+
+static void matrix_write_set_all(brain::Matrix &r_matrix) {
+	r_matrix.set_all(7);
+}
+
+static void matrix_write_unsafe_set(brain::Matrix &r_matrix) {
+	std::vector<real_t> values(r_matrix.get_row_count() * r_matrix.get_column_count(), 3);
+	r_matrix.unsafe_set(values.data());
+}
+
+static void matrix_write_unsafe_set_row(brain::Matrix &r_matrix) {
+	std::vector<real_t> values(r_matrix.get_column_count(), 5);
+	r_matrix.unsafe_set_row(0, values.data());
+}
+
+static void matrix_write_mutable(brain::Matrix &r_matrix) {
+	r_matrix.get_matrix_mutable()[0] = -1;
+}
+
+static void matrix_write_map(brain::Matrix &r_matrix) {
+	r_matrix.map(matrix_double_value);
+}
+
+static void matrix_write_multiply(brain::Matrix &r_matrix) {
+	r_matrix *= 3;
+}
+
+static void matrix_write_add(brain::Matrix &r_matrix) {
+	r_matrix += brain::Matrix(r_matrix);
+}
+
+static void matrix_write_subtract(brain::Matrix &r_matrix) {
+	brain::Matrix other(r_matrix.get_row_count(), r_matrix.get_column_count());
+	other.set_all(1);
+	r_matrix -= other;
+}
+
+static void matrix_write_divide(brain::Matrix &r_matrix) {
+	r_matrix /= 2;
+}
+
+static void matrix_write_element_wise(brain::Matrix &r_matrix) {
+	r_matrix.element_wise_multiplicate(brain::Matrix(r_matrix));
+}
+
+static void matrix_write_transpose(brain::Matrix &r_matrix) {
+	r_matrix.transpose();
+}
+
+static void matrix_write_resize(brain::Matrix &r_matrix) {
+	r_matrix.resize(2, 2);
+	r_matrix.set_all(9);
+}
+
+static void matrix_write_from_byte(brain::Matrix &r_matrix) {
+	brain::Matrix other(r_matrix.get_row_count(), r_matrix.get_column_count());
+	other.set_all(4);
+	std::vector<uint8_t> buffer(other.get_byte_size());
+	other.to_byte(buffer.data());
+	r_matrix.from_byte(buffer.data(), sizeof(real_t));
+}
+
+static void matrix_write_assign(brain::Matrix &r_matrix) {
+	brain::Matrix other(1, 1);
+	other.set(0, 0, 8);
+	r_matrix = other;
+}
+
+/**
+ * @brief is_matrix_equal tells if the matrix has the shape and the values
+ */
+bool is_matrix_equal(const brain::Matrix &p_matrix, uint32_t p_rows, uint32_t p_columns, const std::vector<real_t> &p_values) {
+	return p_matrix.get_row_count() == p_rows &&
+		   p_matrix.get_column_count() == p_columns &&
+		   std::equal(p_values.begin(), p_values.end(), p_matrix.get_matrix());
+}
+
+/**
+ * @brief test_matrix_copy_on_write checks that a write to a matrix that
+ * shares the buffer never changes the other matrices, from both sides
+ */
+bool test_matrix_copy_on_write() {
+
+	const matrix_write writes[] = {
+		matrix_write_set,
+		matrix_write_set_all,
+		matrix_write_unsafe_set,
+		matrix_write_unsafe_set_row,
+		matrix_write_mutable,
+		matrix_write_map,
+		matrix_write_multiply,
+		matrix_write_add,
+		matrix_write_subtract,
+		matrix_write_divide,
+		matrix_write_element_wise,
+		matrix_write_transpose,
+		matrix_write_resize,
+		matrix_write_from_byte,
+		matrix_write_assign
+	};
+
+	const uint32_t rows(3);
+	const uint32_t columns(4);
+	std::vector<real_t> values(rows * columns);
+	for (uint32_t i(0); i < values.size(); ++i) {
+		values[i] = i + 1;
+	}
+
+	for (uint32_t w(0); w < sizeof(writes) / sizeof(writes[0]); ++w) {
+
+		/// Step 1. Write the copy, the original and the other copies keep
+		/// their values
+		{
+			const brain::Matrix original(rows, columns, values.data());
+			brain::Matrix copy(original);
+			brain::Matrix assigned;
+			assigned = original;
+
+			writes[w](copy);
+
+			if (!is_matrix_equal(original, rows, columns, values) ||
+					!is_matrix_equal(assigned, rows, columns, values)) {
+				print_line("Matrix copy on write: the write " + brain::itos(w) + " of the copy changes the original");
+				return false;
+			}
+
+			if (is_matrix_equal(copy, rows, columns, values)) {
+				print_line("Matrix copy on write: the write " + brain::itos(w) + " doesn't change the copy");
+				return false;
+			}
+		}
+
+		/// Step 2. Write the original, the copies keep their values
+		{
+			brain::Matrix original(rows, columns, values.data());
+			const brain::Matrix copy(original);
+			brain::Matrix assigned;
+			assigned = original;
+
+			writes[w](original);
+
+			if (!is_matrix_equal(copy, rows, columns, values) ||
+					!is_matrix_equal(assigned, rows, columns, values)) {
+				print_line("Matrix copy on write: the write " + brain::itos(w) + " of the original changes the copy");
+				return false;
+			}
+		}
+	}
+
+	print_line("Matrix copy on write: OK");
+	return true;
+}
+
+/**
+ * @brief is_near tells if the two values are equal within the rounding of
+ * a different summation order, NaN is near to NaN
+ */
+bool is_near(real_t p_a, real_t p_b, real_t p_tolerance = 1e-5f) {
+	if (std::isnan(p_a) || std::isnan(p_b))
+		return std::isnan(p_a) && std::isnan(p_b);
+	return ABS(p_a - p_b) <= p_tolerance * MAX(real_t(1), ABS(p_b));
+}
+
+/**
+ * @brief is_matrix_near compares two matrices with is_near
+ */
+bool is_matrix_near(const brain::Matrix &p_a, const brain::Matrix &p_b, real_t p_tolerance = 1e-5f) {
+	if (p_a.get_row_count() != p_b.get_row_count() || p_a.get_column_count() != p_b.get_column_count())
+		return false;
+
+	for (uint32_t i(0); i < p_a.get_row_count() * p_a.get_column_count(); ++i) {
+		if (!is_near(p_a.get_matrix()[i], p_b.get_matrix()[i], p_tolerance))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief test_uniform_batch checks that the batch functions give the result
+ * of the single sample ones, called for each sample
+ */
+bool test_uniform_batch() {
+
+	const uint32_t sample_counts[] = { 1, 3, 17, 64 };
+
+	for (int softmax(0); softmax < 2; ++softmax) {
+
+		brain::Math::seed(1554825747);
+
+		brain::UniformBrainArea area(7, 2, 5);
+		area.set_hidden_layer(0, 33, brain::BrainArea::ACTIVATION_SIGMOID);
+		area.set_hidden_layer(1, 21, brain::BrainArea::ACTIVATION_LEAKY_RELU);
+		area.set_output_layer_activation(
+				softmax ?
+						brain::BrainArea::ACTIVATION_SOFTMAX :
+						brain::BrainArea::ACTIVATION_TANH);
+		area.randomize_weights(1);
+		area.randomize_biases(1);
+
+		for (uint32_t s(0); s < sizeof(sample_counts) / sizeof(sample_counts[0]); ++s) {
+			const uint32_t samples = sample_counts[s];
+
+			brain::Matrix inputs(7, samples);
+			brain::Matrix expected(5, samples);
+			for (uint32_t i(0); i < 7 * samples; ++i) {
+				inputs.get_matrix_mutable()[i] = brain::Math::random(-1.f, 1.f);
+			}
+			for (uint32_t i(0); i < 5 * samples; ++i) {
+				expected.get_matrix_mutable()[i] = brain::Math::random(0.f, 1.f);
+			}
+
+			/// Step 1. The batch guess
+			brain::Matrix batch_outputs;
+			if (!area.guess_batch(inputs, batch_outputs)) {
+				print_line("Uniform batch: guess_batch failed");
+				return false;
+			}
+
+			/// Step 2. The batch gradients, without updating the weights
+			brain::UniformBrainArea::DeltaGradients batch_gradients;
+			const real_t batch_error = area.learn_batch(inputs, expected, 0.1f, false, &batch_gradients);
+
+			/// Step 3. The same, one sample at a time
+			brain::UniformBrainArea::DeltaGradients gradients;
+			real_t error(0);
+
+			for (uint32_t j(0); j < samples; ++j) {
+				brain::Matrix input(7, 1);
+				brain::Matrix sample_expected(5, 1);
+				for (uint32_t i(0); i < 7; ++i) {
+					input.set(i, 0, inputs.get(i, j));
+				}
+				for (uint32_t i(0); i < 5; ++i) {
+					sample_expected.set(i, 0, expected.get(i, j));
+				}
+
+				brain::Matrix output;
+				area.guess(input, output);
+				for (uint32_t i(0); i < 5; ++i) {
+					if (!is_near(output.get(i, 0), batch_outputs.get(i, j))) {
+						print_line(
+								"Uniform batch: the guess of the sample " + brain::itos(j) +
+								" of " + brain::itos(samples) + " is different");
+						return false;
+					}
+				}
+
+				brain::UniformBrainArea::DeltaGradients sample_gradients;
+				error += area.learn(input, sample_expected, 0.1f, false, &sample_gradients);
+				gradients += sample_gradients;
+			}
+			gradients /= samples;
+
+			if (!is_near(batch_error, error, 1e-4f)) {
+				print_line("Uniform batch: the error of " + brain::itos(samples) + " samples is different");
+				return false;
+			}
+
+			for (uint32_t l(0); l < gradients.weights.size(); ++l) {
+				if (!is_matrix_near(batch_gradients.weights[l], gradients.weights[l]) ||
+						!is_matrix_near(batch_gradients.biases[l], gradients.biases[l])) {
+					print_line(
+							"Uniform batch: the gradients of the layer " + brain::itos(l) +
+							" with " + brain::itos(samples) + " samples are different");
+					return false;
+				}
+			}
+		}
+	}
+
+	print_line("Uniform batch: OK");
+	return true;
+}
+
+/**
+ * @brief test_sharp_batch checks that each sample of guess_batch is computed
+ * as a guess with its own state, also when the levels are split between
+ * threads
+ */
+bool test_sharp_batch() {
+
+	std::mt19937 rng(1554825747);
+	std::uniform_real_distribution<real_t> input(-1, 1);
+	brain::ThreadPool pool(2);
+
+	for (uint32_t net(0); net < 11; ++net) {
+
+		// The last network is wide enough to split its levels between the
+		// threads
+		const bool wide = net == 10;
+
+		brain::SharpBrainArea area;
+		build_random_sharp_area(area, rng, 2 + net % 4, wide ? 300 : 6 + net * 7, 1 + net % 3, net % 5 == 4);
+
+		const uint32_t samples = wide ? 128 : 1 + net * 3;
+		const uint32_t input_count = area.get_input_layer_size();
+		const uint32_t output_count = area.get_output_layer_size();
+
+		brain::ThreadPool *p_pool = net % 2 || wide ? &pool : nullptr;
+		brain::SharpState batch_state;
+		brain::SharpState serial_state;
+		std::vector<brain::SharpState> states(samples);
+
+		brain::Matrix inputs(input_count, samples);
+		brain::Matrix outputs;
+		brain::Matrix sample_input(input_count, 1);
+		brain::Matrix sample_output;
+
+		// Many steps, so the recurrent memory of each sample is used too
+		for (int step(0); step < 6; ++step) {
+			for (uint32_t i(0); i < input_count * samples; ++i) {
+				inputs.get_matrix_mutable()[i] = input(rng);
+			}
+
+			if (!area.guess_batch(inputs, outputs, &batch_state, p_pool)) {
+				print_line("Sharp batch: guess_batch failed");
+				return false;
+			}
+
+			if (wide) {
+				// The rounding of the batch sums grows too much in this deep
+				// network, so the split levels are checked against the batch
+				// computed by a single thread, that must be identical
+				brain::Matrix serial_outputs;
+				if (!area.guess_batch(inputs, serial_outputs, &serial_state, nullptr) ||
+						!is_matrix_near(serial_outputs, outputs, 0)) {
+					print_line("Sharp batch: the threads change the outputs at step " + brain::itos(step));
+					return false;
+				}
+				continue;
+			}
+
+			for (uint32_t j(0); j < samples; ++j) {
+				for (uint32_t i(0); i < input_count; ++i) {
+					sample_input.set(i, 0, inputs.get(i, j));
+				}
+
+				area.guess(sample_input, sample_output, states[j]);
+
+				for (uint32_t o(0); o < output_count; ++o) {
+					if (!is_near(sample_output.get(o, 0), outputs.get(o, j))) {
+						print_line(
+								"Sharp batch: network " + brain::itos(net) + " sample " +
+								brain::itos(j) + " step " + brain::itos(step) + " is different");
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	print_line("Sharp batch: OK");
+	return true;
+}
+
+/**
+ * @brief fill_random resizes the vector and fills it with values in [-1, 1]
+ */
+void fill_random(std::vector<real_t> &r_values, uint32_t p_size, std::mt19937 &p_rng) {
+	std::uniform_real_distribution<real_t> value(-1, 1);
+	r_values.resize(p_size);
+	for (uint32_t i(0); i < p_size; ++i) {
+		r_values[i] = value(p_rng);
+	}
+}
+
+/**
+ * @brief reference_product returns the element (r, c) of the product
+ * op(A) (MxK) * op(B) (KxN), where op transposes the operand when its flag
+ * is set. It's computed in double precision without the kernels
+ */
+double reference_product(
+		const real_t *p_a,
+		const real_t *p_b,
+		uint32_t p_m,
+		uint32_t p_k,
+		uint32_t p_n,
+		bool p_a_transposed,
+		bool p_b_transposed,
+		uint32_t p_row,
+		uint32_t p_column) {
+
+	double sum(0);
+	for (uint32_t i(0); i < p_k; ++i) {
+		const real_t a = p_a_transposed ? p_a[i * p_m + p_row] : p_a[p_row * p_k + i];
+		const real_t b = p_b_transposed ? p_b[p_column * p_k + i] : p_b[i * p_n + p_column];
+		sum += double(a) * b;
+	}
+	return sum;
+}
+
+/**
+ * @brief is_kernel_result_near compares the result of a kernel with the
+ * reference values, printing which one is different
+ */
+bool is_kernel_result_near(
+		const std::string &p_kernel,
+		const real_t *p_result,
+		const std::vector<double> &p_expected) {
+
+	for (uint32_t i(0); i < p_expected.size(); ++i) {
+		if (!is_near(p_result[i], real_t(p_expected[i]), 1e-4f)) {
+			print_line(
+					"Kernels: " + p_kernel + " element " + brain::itos(i) + " is different, " +
+					std::to_string(p_result[i]) + " != " + std::to_string(p_expected[i]));
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief check_kernels compares the kernels of the instruction set in use
+ * with the reference computation, with sizes that are not multiple of any
+ * vector width
+ */
+bool check_kernels(std::mt19937 &p_rng) {
+
+	const std::string isa_name = brain::kernels::get_isa_name(brain::kernels::get_isa());
+	const uint32_t sizes[] = { 1, 3, 7, 17, 33, 65 };
+
+	std::vector<real_t> a, b, c, initial_c, bias;
+	std::vector<double> expected;
+
+	for (uint32_t m : sizes) {
+		for (uint32_t k : sizes) {
+			fill_random(a, m * k, p_rng);
+
+			for (uint32_t n : sizes) {
+				const std::string size = brain::itos(m) + "x" + brain::itos(k) + "x" + brain::itos(n);
+
+				// The same buffers are A (MxK) or A^T (KxM), and B (KxN) or
+				// B^T (NxK)
+				fill_random(b, k * n, p_rng);
+				fill_random(initial_c, m * n, p_rng);
+
+				for (int kernel(0); kernel < 3; ++kernel) {
+					for (int accumulate(0); accumulate < 2; ++accumulate) {
+						c = initial_c;
+
+						std::string name;
+						if (kernel == 0) {
+							name = "gemm";
+							brain::kernels::gemm(a.data(), b.data(), c.data(), m, k, n, accumulate);
+						} else if (kernel == 1) {
+							name = "gemm_tn";
+							brain::kernels::gemm_tn(a.data(), b.data(), c.data(), m, k, n, accumulate);
+						} else {
+							name = "gemm_nt";
+							brain::kernels::gemm_nt(a.data(), b.data(), c.data(), m, k, n, accumulate);
+						}
+
+						expected.resize(m * n);
+						for (uint32_t r(0); r < m; ++r) {
+							for (uint32_t col(0); col < n; ++col) {
+								expected[r * n + col] =
+										(accumulate ? initial_c[r * n + col] : 0.0) +
+										reference_product(a.data(), b.data(), m, k, n, kernel == 1, kernel == 2, r, col);
+							}
+						}
+
+						if (!is_kernel_result_near(isa_name + " " + name + (accumulate ? " accumulate " : " ") + size, c.data(), expected))
+							return false;
+					}
+				}
+
+				// The Matrix product uses gemv for a single column
+				expected.resize(m * n);
+				for (uint32_t r(0); r < m; ++r) {
+					for (uint32_t col(0); col < n; ++col) {
+						expected[r * n + col] = reference_product(a.data(), b.data(), m, k, n, false, false, r, col);
+					}
+				}
+
+				const brain::Matrix product = brain::Matrix(m, k, a.data()) * brain::Matrix(k, n, b.data());
+				if (!is_kernel_result_near(isa_name + " Matrix product " + size, product.get_matrix(), expected))
+					return false;
+			}
+
+			const std::string size = brain::itos(m) + "x" + brain::itos(k);
+
+			// gemv and the fused gemv_bias, x is a new vector
+			fill_random(b, MAX(m, k), p_rng);
+			fill_random(bias, m, p_rng);
+			c.resize(MAX(m, k));
+
+			expected.resize(m);
+			for (uint32_t r(0); r < m; ++r) {
+				expected[r] = reference_product(a.data(), b.data(), m, k, 1, false, false, r, 0);
+			}
+
+			brain::kernels::gemv(a.data(), b.data(), c.data(), m, k);
+			if (!is_kernel_result_near(isa_name + " gemv " + size, c.data(), expected))
+				return false;
+
+			for (uint32_t r(0); r < m; ++r) {
+				expected[r] += bias[r];
+			}
+
+			brain::kernels::gemv_bias(a.data(), b.data(), bias.data(), c.data(), m, k);
+			if (!is_kernel_result_near(isa_name + " gemv_bias " + size, c.data(), expected))
+				return false;
+
+			// gemv_t, A^T (KxM) * x (M)
+			expected.resize(k);
+			for (uint32_t col(0); col < k; ++col) {
+				expected[col] = reference_product(a.data(), b.data(), k, m, 1, true, false, col, 0);
+			}
+
+			brain::kernels::gemv_t(a.data(), b.data(), c.data(), m, k);
+			if (!is_kernel_result_near(isa_name + " gemv_t " + size, c.data(), expected))
+				return false;
+
+			// ger, A (MxK) += alpha * x (M) * y (K)^T
+			std::vector<real_t> x, y;
+			fill_random(x, m, p_rng);
+			fill_random(y, k, p_rng);
+
+			for (int accumulate(0); accumulate < 2; ++accumulate) {
+				c = a;
+
+				expected.resize(m * k);
+				for (uint32_t r(0); r < m; ++r) {
+					for (uint32_t col(0); col < k; ++col) {
+						expected[r * k + col] = (accumulate ? a[r * k + col] : 0.0) + 0.5 * x[r] * y[col];
+					}
+				}
+
+				brain::kernels::ger(x.data(), y.data(), c.data(), m, k, 0.5f, accumulate);
+				if (!is_kernel_result_near(isa_name + " ger" + (accumulate ? " accumulate " : " ") + size, c.data(), expected))
+					return false;
+			}
+		}
+	}
+
+	// weighted_sum, m is the count of links and k the lanes
+	for (uint32_t m : sizes) {
+		for (uint32_t k : sizes) {
+			const uint32_t row_count = 2 * m;
+
+			std::vector<real_t> values, weights;
+			std::vector<uint32_t> sources(m);
+			fill_random(values, row_count * k, p_rng);
+			fill_random(weights, m, p_rng);
+			for (uint32_t i(0); i < m; ++i) {
+				sources[i] = p_rng() % row_count;
+			}
+
+			expected.assign(k, 0.0);
+			for (uint32_t i(0); i < m; ++i) {
+				for (uint32_t j(0); j < k; ++j) {
+					expected[j] += double(values[sources[i] * k + j]) * weights[i];
+				}
+			}
+
+			c.resize(k);
+			brain::kernels::weighted_sum(values.data(), sources.data(), weights.data(), m, c.data(), k);
+			if (!is_kernel_result_near(isa_name + " weighted_sum " + brain::itos(m) + "x" + brain::itos(k), c.data(), expected))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief test_kernels checks the kernels of every instruction set supported
+ * by the CPU
+ */
+bool test_kernels() {
+
+	const brain::kernels::ISA initial_isa = brain::kernels::get_isa();
+	std::mt19937 rng(1554825747);
+
+	bool success = true;
+	for (int isa(brain::kernels::ISA_SCALAR); isa <= brain::kernels::get_best_isa() && success; ++isa) {
+		brain::kernels::set_isa(brain::kernels::ISA(isa));
+		success = check_kernels(rng);
+	}
+
+	brain::kernels::set_isa(initial_isa);
+
+	if (success)
+		print_line("Kernels: OK");
+	return success;
+}
+
 int main() {
 
 	brain::ErrorHandlerList *error_handler = new brain::ErrorHandlerList;
@@ -388,5 +1639,35 @@ int main() {
 	//test_NEAT_XOR();
 	test_uniform_ba_XOR();
 
+	if (!test_matrix_copy_on_write())
+		return 1;
+
+	if (!test_kernels())
+		return 1;
+
+	if (!test_uniform_batch())
+		return 1;
+
+	if (!test_NEAT_determinism())
+		return 1;
+
+	if (!test_sharp_add_link_scaling())
+		return 1;
+
+	if (!test_sharp_learn_gradients())
+		return 1;
+
+	if (!test_sharp_plan_simplification())
+		return 1;
+
+	if (!test_sharp_batch())
+		return 1;
+
+	if (!test_sharp_model())
+		return 1;
+
+	if (!test_sharp_native())
+		return 1;
+
 	return 0;
 }